@@ -1,103 +1,163 @@
 #include "carray.h"
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
 // align to qword
 #define ALIGN(n) (((n) + 7) & ~7)
 
+#define INDEX_MASK ((1 << ARRAY_INDEX_BITS) - 1)
+#define GEN_MASK   ((1 << ARRAY_GEN_BITS) - 1)
+#define MAX_SLOT   INDEX_MASK
+
 struct array_node {
 	struct array_node * next;
+	int id;
+	int alive;
 };
 
-int
-array_size(int n, int sz) {
-	sz = ALIGN(sz);
-	return n * sz;
+#define NODE_SIZE ALIGN(sizeof(struct array_node))
+
+static inline struct array_node *
+node_of(void *v) {
+	return (struct array_node *)((char *)v - NODE_SIZE);
 }
 
-void
-array_init(struct array *p, void * buffer, int n, int nsz) {
-	int sz = ALIGN(nsz);
-	char * ptr = (char *)buffer;
+static inline void *
+data_of(struct array_node *node) {
+	return (char *)node + NODE_SIZE;
+}
+
+static inline struct array_node *
+node_at(struct array *p, int idx) {
+	int mask = (1 << p->chunk_shift) - 1;
+	return (struct array_node *)(p->chunks[idx >> p->chunk_shift] + (idx & mask) * p->sz);
+}
+
+static int
+array_grow(struct array *p) {
+	int chunk = 1 << p->chunk_shift;
+	if (p->n + chunk > MAX_SLOT) {
+		return 0;
+	}
+	char ** chunks = (char **)realloc(p->chunks, (p->chunk_n + 1) * sizeof(char *));
+	if (chunks == NULL) {
+		return 0;
+	}
+	p->chunks = chunks;
+	char * buffer = (char *)malloc(chunk * p->sz);
+	if (buffer == NULL) {
+		return 0;
+	}
+	p->chunks[p->chunk_n++] = buffer;
+
+	// push in reverse, so slots are handed out in order
 	int i;
-	for (i=0;i<n-1;i++) {
-		struct array_node * node = (struct array_node *)(ptr + i*sz);
-		struct array_node * node_next = (struct array_node *)(ptr + (i+1)*sz);
-		node->next = node_next;
+	for (i=chunk-1;i>=0;i--) {
+		struct array_node * node = (struct array_node *)(buffer + i*p->sz);
+		node->id = p->n + i + 1;
+		node->alive = 0;
+		node->next = p->freelist;
+		p->freelist = node;
 	}
-	struct array_node * node = (struct array_node *)(ptr + (n-1)*sz);
-	node->next = NULL;
-	p->n = n;
-	p->sz = sz;
-	p->buffer = (char*)buffer;
-	p->freelist = (struct array_node*)buffer;
+	p->n += chunk;
+	return 1;
+}
+
+void
+array_init(struct array *p, int chunk, int nsz) {
+	int shift = 0;
+	while ((1 << shift) < chunk && shift < ARRAY_INDEX_BITS - 1) {
+		++shift;
+	}
+	p->n = 0;
+	p->sz = NODE_SIZE + ALIGN(nsz);
+	p->chunk_shift = shift;
+	p->chunk_n = 0;
+	p->chunks = NULL;
+	p->freelist = NULL;
 }
 
 void *
 array_alloc(struct array *p) {
-	struct array_node * node = p->freelist;
-	if (node == NULL) {
+	if (p->freelist == NULL && !array_grow(p)) {
 		return NULL;
 	}
+	struct array_node * node = p->freelist;
 	p->freelist = node->next;
-	memset(node, 0, p->sz);
-	return node;
+	node->next = NULL;
+	node->alive = 1;
+	void * v = data_of(node);
+	memset(v, 0, p->sz - NODE_SIZE);
+	return v;
 }
 
 void
 array_free(struct array *p, void *v) {
-	struct array_node * node = (struct array_node *)v;
-	if (node) {
-		node->next = p->freelist;
-		p->freelist = node;
+	if (v == NULL) {
+		return;
 	}
+	struct array_node * node = node_of(v);
+	assert(node->alive);
+	int gen = ((node->id >> ARRAY_INDEX_BITS) + 1) & GEN_MASK;
+	node->id = (gen << ARRAY_INDEX_BITS) | (node->id & INDEX_MASK);
+	node->alive = 0;
+	node->next = p->freelist;
+	p->freelist = node;
 }
 
 int
 array_id(struct array *p, void *v) {
+	(void)p;
 	if (v == NULL)
 		return 0;
-	int idx = ((char *)v - p->buffer) / p->sz;
-	assert(idx >= 0 && idx < p->n);
-
-	return idx + 1;
+	return node_of(v)->id;
 }
 
 void *
 array_ref(struct array *p, int id) {
-	if (id == 0)
+	if (id <= 0)
+		return NULL;
+	int idx = (id & INDEX_MASK) - 1;
+	if (idx >= p->n)
+		return NULL;
+	struct array_node * node = node_at(p, idx);
+	// stale or released id
+	if (node->id != id || !node->alive)
 		return NULL;
-	--id;
-	assert(id >= 0 && id < p->n);
-	void * ptr = p->buffer + p->sz * id;
-	return ptr;
+	return data_of(node);
 }
 
-#ifdef _MSC_VER
-#	include <malloc.h>
-#	define ARRAY(type, name, size) type* name = (type*)_alloca((size) * sizeof(type))
-#else
-#	define ARRAY(type, name, size) type name[size]
-#endif
-
 void
-array_exit(struct array *p, void (*close)(void *p, void *ud), void *ud) {
-	ARRAY(char, flag, p->n);
-	memset(flag, 0, p->n);
-	struct array_node * n = p->freelist;
-	while (n) {
-		int idx = array_id(p, n) - 1;
-		flag[idx] = 1;
-		n = n->next;
-	}
+array_foreach(struct array *p, void (*visit)(void *p, int id, void *ud), void *ud) {
 	int i;
 	for (i=0;i<p->n;i++) {
-		if (flag[i] == 0) {
-			struct array_node * n = (struct array_node *)array_ref(p, i + 1);
-			close(n, ud);
+		struct array_node * node = node_at(p, i);
+		if (node->alive) {
+			visit(data_of(node), node->id, ud);
 		}
 	}
 }
 
+void
+array_exit(struct array *p, void (*close)(void *p, void *ud), void *ud) {
+	int i;
+	if (close) {
+		for (i=0;i<p->n;i++) {
+			struct array_node * node = node_at(p, i);
+			if (node->alive) {
+				close(data_of(node), ud);
+			}
+		}
+	}
+	for (i=0;i<p->chunk_n;i++) {
+		free(p->chunks[i]);
+	}
+	free(p->chunks);
+	p->chunks = NULL;
+	p->chunk_n = 0;
+	p->n = 0;
+	p->freelist = NULL;
+}
@@ -1,17 +1,26 @@
 #ifndef ejoy3d_array_h
 #define ejoy3d_array_h
 
+// id = (generation << ARRAY_INDEX_BITS) | (slot + 1)
+// The generation is bumped each time a slot is freed, so a stale id is
+// rejected until the slot has been reused 1 << ARRAY_GEN_BITS (512) times;
+// freed slots are reused first, a busy slot can get there quickly.
+#define ARRAY_INDEX_BITS 22
+#define ARRAY_GEN_BITS   9
+
 struct array_node;
 
 struct array {
 	int n;
 	int sz;
-	char * buffer;
+	int chunk_shift;
+	int chunk_n;
+	char ** chunks;
 	struct array_node * freelist;
 };
 
-int array_size(int n, int sz);
-void array_init(struct array *p, void * buffer, int n, int sz);
+// chunk is the slot count per allocation, rounded up to power of 2
+void array_init(struct array *p, int chunk, int sz);
 void * array_alloc(struct array *p);
 void array_free(struct array *p, void *v);
 void array_exit(struct array *p, void (*close)(void *p, void *ud), void *ud);
@@ -19,4 +28,7 @@ void array_exit(struct array *p, void (*close)(void *p, void *ud), void *ud);
 int array_id(struct array *p, void *);
 void * array_ref(struct array *p, int id);
 
+// visit the live objects in slot order
+void array_foreach(struct array *p, void (*visit)(void *p, int id, void *ud), void *ud);
+
 #endif
@@ -1,7 +1,6 @@
 #include "render.h"
 #include "opengl.h"
 #include "carray.h"
-#include "block2.h"
 
 #include <logger.h>
 
@@ -27,9 +26,22 @@
 
 #endif
 
+#if defined (GL_VERSION_4_2) || defined (GL_ES_VERSION_3_0)
+#define TEXTURE_STORAGE_ENABLE
+#endif
+
+#if defined (GL_VERSION_3_3) || defined (GL_ES_VERSION_3_0)
+#define SAMPLER_OBJECT_ENABLE
+#endif
+
+#if defined (GL_VERSION_3_0) || defined (GL_ES_VERSION_3_0)
+#define MIPMAP_BLIT_ENABLE
+#endif
+
 #define MAX_VB_SLOT			8
 #define MAX_ATTRIB			16
 #define MAX_TEXTURE			8
+#define MAX_SAMPLER			32
 
 #define CHANGE_VERTEXARRAY	0x1
 #define CHANGE_TEXTURE		0x2
@@ -64,16 +76,23 @@
 struct buffer {
 	GLuint glid;
 	GLenum gltype;
+	int size;
+	int create_frame;
+	int last_frame;
 };
 
 struct attrib {
 	int n;
 	struct vertex_attrib a[MAX_ATTRIB];
+	int create_frame;
+	int last_frame;
 };
 
 struct target {
 	GLuint glid;
 	RID tex;
+	int create_frame;
+	int last_frame;
 };
 
 struct texture {
@@ -85,6 +104,26 @@ struct texture {
 	enum EJ_TEXTURE_FORMAT format;
 	enum EJ_TEXTURE_TYPE type;
 	int memsize;
+	int create_frame;
+	int last_frame;
+	int evicted;
+	int immutable;
+	// 0 for the state on the texture object
+	GLuint sampler;
+	// last params, the texture object keeps them too
+	enum EJ_TEXTURE_WRAP wrap;
+	enum EJ_TEXTURE_FILTER filter;
+	// levels in [base_level, max_level] are sampled and resident
+	int streaming;
+	int base_level;
+	int max_level;
+	// levels above 0 uploaded by the user, never generated
+	int explicit_mips;
+};
+
+struct sampler {
+	uint32_t key;
+	GLuint glid;
 };
 
 struct attrib_layout {
@@ -107,6 +146,8 @@ struct shader {
 	struct attrib_layout a[MAX_ATTRIB];
 	int texture_n;
 	int texture_uniform[MAX_TEXTURE];
+	int create_frame;
+	int last_frame;
 };
 
 struct rstate {
@@ -139,6 +180,18 @@ struct render {
 	struct array target;
 	struct array texture;
 	struct array shader;
+	int64_t memory[EJ_MEMORY_COUNT];
+	uint32_t features;
+	GLuint clear_fbo;
+	// read and draw
+	GLuint blit_fbo[2];
+	int sampler_n;
+	struct sampler samplers[MAX_SAMPLER];
+	GLuint last_sampler[MAX_TEXTURE];
+	int frame;
+	int touch_frame;
+	render_texture_reload reload;
+	void * reload_ud;
 };
 
 static inline void
@@ -179,9 +232,12 @@ render_buffer_create(struct render *R, enum EJ_RENDER_OBJ what, const void *data
 	if (buf == NULL)
 		return 0;
 	glGenBuffers(1, &buf->glid);
+	buf->create_frame = buf->last_frame = R->frame;
 	glBindBuffer(gltype, buf->glid);
 	if (data && size > 0) {
 		glBufferData(gltype, size, data, GL_STATIC_DRAW);
+		buf->size = size;
+		R->memory[EJ_MEMORY_BUFFER] += size;
 	}
 	buf->gltype = gltype;
 
@@ -199,13 +255,17 @@ render_buffer_update(struct render *R, RID id, const void* data, int size) {
 	R->changeflag |= CHANGE_VERTEXARRAY;
 	glBindBuffer(buf->gltype, buf->glid);
 	glBufferData(buf->gltype, size, data, GL_DYNAMIC_DRAW);
+	R->memory[EJ_MEMORY_BUFFER] += size - buf->size;
+	buf->size = size;
 	CHECK_GL_ERROR
 }
 
 static void
-close_buffer(void *p, void *R) {
+close_buffer(void *p, void *ud) {
+	struct render * R = (struct render *)ud;
 	struct buffer * buf = (struct buffer *)p;
 	glDeleteBuffers(1,&buf->glid);
+	R->memory[EJ_MEMORY_BUFFER] -= buf->size;
 
 	CHECK_GL_ERROR
 }
@@ -220,6 +280,7 @@ render_register_vertexlayout(struct render *R, int n, struct vertex_attrib * att
 
 	a->n = n;
 	memcpy(a->a, attrib, n * sizeof(struct vertex_attrib));
+	a->create_frame = a->last_frame = R->frame;
 
 	RID id = array_id(&R->attrib, a);
 
@@ -403,6 +464,7 @@ render_shader_create(struct render *R, struct shader_init_args *args) {
 		return 0;
 	}
 	s->glid = glCreateProgram();
+	s->create_frame = s->last_frame = R->frame;
 
     if (args->cs) {
         if (!compile_link_cs(R, s, args->cs)) {
@@ -449,9 +511,13 @@ close_shader(void *p, void *R) {
 }
 
 static void
-close_texture(void *p, void *R) {
+close_texture(void *p, void *ud) {
+	struct render * R = (struct render *)ud;
 	struct texture * tex = (struct texture *)p;
 	glDeleteTextures(1,&tex->glid);
+	if (!tex->evicted) {
+		R->memory[EJ_MEMORY_TEXTURE] -= tex->memsize;
+	}
 
 	CHECK_GL_ERROR
 }
@@ -464,6 +530,14 @@ close_target(void *p, void *R) {
 	CHECK_GL_ERROR
 }
 
+static void
+stale_release(struct render *R, enum EJ_RENDER_OBJ what, RID id) {
+	if (id != 0) {
+		logger_printf(&R->log, "release stale id (type %d, id 0x%x)\n", what, id);
+		assert(0);
+	}
+}
+
 void
 render_release(struct render *R, enum EJ_RENDER_OBJ what, RID id) {
 	switch (what) {
@@ -473,6 +547,8 @@ render_release(struct render *R, enum EJ_RENDER_OBJ what, RID id) {
 		if (buf) {
 			close_buffer(buf, R);
 			array_free(&R->buffer, buf);
+		} else {
+			stale_release(R, what, id);
 		}
 		break;
 	}
@@ -481,6 +557,8 @@ render_release(struct render *R, enum EJ_RENDER_OBJ what, RID id) {
 		if (shader) {
 			close_shader(shader, R);
 			array_free(&R->shader, shader);
+		} else {
+			stale_release(R, what, id);
 		}
 		break;
 	}
@@ -495,6 +573,8 @@ render_release(struct render *R, enum EJ_RENDER_OBJ what, RID id) {
 			}
 			close_texture(tex, R);
 			array_free(&R->texture, tex);
+		} else {
+			stale_release(R, what, id);
 		}
 		break;
 	}
@@ -503,6 +583,8 @@ render_release(struct render *R, enum EJ_RENDER_OBJ what, RID id) {
 		if (tar) {
 			close_target(tar, R);
 			array_free(&R->target, tar);
+		} else {
+			stale_release(R, what, id);
 		}
 		break;
 	}
@@ -510,6 +592,8 @@ render_release(struct render *R, enum EJ_RENDER_OBJ what, RID id) {
 		struct attrib * attr = (struct attrib *)array_ref(&R->attrib, id);
 		if (attr) {
 			array_free(&R->attrib, attr);
+		} else {
+			stale_release(R, what, id);
 		}
 		break;
 	default:
@@ -578,6 +662,7 @@ render_shader_bind(struct render *R, RID id) {
 	R->changeflag |= CHANGE_VERTEXARRAY;
 	struct shader * s = (struct shader *)array_ref(&R->shader, id);
 	if (s) {
+		s->last_frame = R->frame;
 		glUseProgram(s->glid);
 		apply_texture_uniform(s);
 	} else {
@@ -589,33 +674,23 @@ render_shader_bind(struct render *R, RID id) {
 
 int
 render_size(struct render_init_args *args) {
-	return sizeof(struct render) +
-		array_size(args->max_buffer, sizeof(struct buffer)) +
-		array_size(args->max_layout, sizeof(struct attrib)) +
-		array_size(args->max_target, sizeof(struct target)) +
-		array_size(args->max_texture, sizeof(struct texture)) +
-		array_size(args->max_shader, sizeof(struct shader));
-}
-
-static void
-new_array(struct block *B, struct array *A, int n, int sz) {
-	int s = array_size(n, sz);
-	void * buffer = block_slice(B, s);
-	array_init(A, buffer, n, sz);
+	(void)args;
+	return sizeof(struct render);
 }
 
 struct render *
 render_init(struct render_init_args *args, void * buffer, int sz) {
-	struct block B;
-	block_init(&B, buffer, sz);
-	struct render * R = (struct render *)block_slice(&B, sizeof(struct render));
+	assert(sz >= (int)sizeof(struct render));
+	struct render * R = (struct render *)buffer;
 	memset(R, 0, sizeof(*R));
 	logger_init(&R->log, stderr);
-	new_array(&B, &R->buffer, args->max_buffer, sizeof(struct buffer));
-	new_array(&B, &R->attrib, args->max_layout, sizeof(struct attrib));
-	new_array(&B, &R->target, args->max_target, sizeof(struct target));
-	new_array(&B, &R->texture, args->max_texture, sizeof(struct texture));
-	new_array(&B, &R->shader, args->max_shader, sizeof(struct shader));
+	R->touch_frame = -1;
+	// max_* are the slots per chunk, pools grow on demand
+	array_init(&R->buffer, args->max_buffer, sizeof(struct buffer));
+	array_init(&R->attrib, args->max_layout, sizeof(struct attrib));
+	array_init(&R->target, args->max_target, sizeof(struct target));
+	array_init(&R->texture, args->max_texture, sizeof(struct texture));
+	array_init(&R->shader, args->max_shader, sizeof(struct shader));
 
 	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &R->default_framebuffer);
 
@@ -630,6 +705,194 @@ render_exit(struct render * R) {
 	array_exit(&R->shader, close_shader, R);
 	array_exit(&R->texture, close_texture, R);
 	array_exit(&R->target, close_target, R);
+	array_exit(&R->attrib, NULL, NULL);
+	if (R->clear_fbo) {
+		glDeleteFramebuffers(1, &R->clear_fbo);
+	}
+	if (R->blit_fbo[0]) {
+		glDeleteFramebuffers(2, R->blit_fbo);
+	}
+#ifdef SAMPLER_OBJECT_ENABLE
+	int i;
+	for (i = 0; i < R->sampler_n; ++i) {
+		glDeleteSamplers(1, &R->samplers[i].glid);
+	}
+#endif // SAMPLER_OBJECT_ENABLE
+}
+
+int64_t
+render_memory_usage(struct render *R, enum EJ_MEMORY_TYPE type) {
+	assert(type >= 0 && type < EJ_MEMORY_COUNT);
+	return R->memory[type];
+}
+
+void
+render_set_features(struct render *R, uint32_t features) {
+	R->features = features;
+}
+
+void
+render_set_frame(struct render *R, int frame) {
+	R->frame = frame;
+}
+
+void
+render_set_texture_reload(struct render *R, render_texture_reload reload, void *ud) {
+	R->reload = reload;
+	R->reload_ud = ud;
+}
+
+void
+render_texture_evict(struct render *R, RID id) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	if (tex == NULL || tex->evicted)
+		return;
+	int i;
+	for (i = 0; i < MAX_TEXTURE; ++i) {
+		if (R->last.texture[i] == id) {
+			R->last.texture[i] = 0;
+		}
+	}
+	R->changeflag |= CHANGE_TEXTURE;
+	// keep the id, drop the storage
+	glDeleteTextures(1, &tex->glid);
+	glGenTextures(1, &tex->glid);
+	tex->evicted = 1;
+	tex->immutable = 0;
+	R->memory[EJ_MEMORY_TEXTURE] -= tex->memsize;
+
+	CHECK_GL_ERROR
+}
+
+int
+render_texture_resident(struct render *R, RID id) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	return tex && !tex->evicted;
+}
+
+int
+render_texture_last_frame(struct render *R, RID id) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	return tex ? tex->last_frame : -1;
+}
+
+static int
+query_object(struct render *R, enum EJ_RENDER_OBJ what, RID id, void *p, struct render_object_info *info) {
+	(void)R;
+	memset(info, 0, sizeof(*info));
+	info->type = what;
+	info->id = id;
+	switch (what) {
+	case EJ_VERTEXBUFFER:
+	case EJ_INDEXBUFFER: {
+		struct buffer * buf = (struct buffer *)p;
+		GLenum gltype = what == EJ_VERTEXBUFFER ? GL_ARRAY_BUFFER : GL_ELEMENT_ARRAY_BUFFER;
+		if (buf->gltype != gltype)
+			return 0;
+		info->glid = buf->glid;
+		info->size = buf->size;
+		info->create_frame = buf->create_frame;
+		info->last_frame = buf->last_frame;
+		break;
+	}
+	case EJ_VERTEXLAYOUT: {
+		struct attrib * a = (struct attrib *)p;
+		info->create_frame = a->create_frame;
+		info->last_frame = a->last_frame;
+		break;
+	}
+	case EJ_TEXTURE: {
+		struct texture * tex = (struct texture *)p;
+		info->glid = tex->glid;
+		info->size = tex->evicted ? 0 : tex->memsize;
+		info->width = tex->width;
+		info->height = tex->height;
+		info->depth = tex->depth;
+		info->format = tex->format;
+		info->texture_type = tex->type;
+		info->mipmap_levels = tex->mipmap_levels;
+		info->streaming = tex->streaming;
+		info->create_frame = tex->create_frame;
+		info->last_frame = tex->last_frame;
+		break;
+	}
+	case EJ_TARGET: {
+		struct target * tar = (struct target *)p;
+		info->glid = tar->glid;
+		info->create_frame = tar->create_frame;
+		info->last_frame = tar->last_frame;
+		break;
+	}
+	case EJ_SHADER: {
+		struct shader * s = (struct shader *)p;
+		info->glid = s->glid;
+		info->create_frame = s->create_frame;
+		info->last_frame = s->last_frame;
+		break;
+	}
+	default:
+		return 0;
+	}
+	return 1;
+}
+
+static struct array *
+object_pool(struct render *R, enum EJ_RENDER_OBJ what) {
+	switch (what) {
+	case EJ_VERTEXBUFFER:
+	case EJ_INDEXBUFFER:
+		return &R->buffer;
+	case EJ_VERTEXLAYOUT:
+		return &R->attrib;
+	case EJ_TEXTURE:
+		return &R->texture;
+	case EJ_TARGET:
+		return &R->target;
+	case EJ_SHADER:
+		return &R->shader;
+	default:
+		return NULL;
+	}
+}
+
+int
+render_query(struct render *R, enum EJ_RENDER_OBJ what, RID id, struct render_object_info *info) {
+	struct array * pool = object_pool(R, what);
+	void * p = pool ? array_ref(pool, id) : NULL;
+	if (p == NULL)
+		return 0;
+	return query_object(R, what, id, p, info);
+}
+
+struct foreach_ud {
+	struct render * R;
+	enum EJ_RENDER_OBJ what;
+	render_object_visitor visit;
+	void * ud;
+};
+
+static void
+foreach_object(void *p, int id, void *ud) {
+	struct foreach_ud * fud = (struct foreach_ud *)ud;
+	struct render_object_info info;
+	if (query_object(fud->R, fud->what, id, p, &info)) {
+		fud->visit(fud->ud, &info);
+	}
+}
+
+void
+render_foreach(struct render *R, enum EJ_RENDER_OBJ what, render_object_visitor visit, void *ud) {
+	struct array * pool = object_pool(R, what);
+	if (pool == NULL)
+		return;
+	struct foreach_ud fud = { R, what, visit, ud };
+	array_foreach(pool, foreach_object, &fud);
+}
+
+int
+render_texture_memsize(struct render *R, RID id) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	return tex ? tex->memsize : 0;
 }
 
 void
@@ -706,6 +969,7 @@ apply_va(struct render *R) {
 					if (buf == NULL) {
 						continue;
 					}
+					buf->last_frame = R->frame;
 					glBindBuffer(GL_ARRAY_BUFFER, buf->glid);
 					last_vb = vb;
 				}
@@ -717,6 +981,7 @@ apply_va(struct render *R) {
 		if (change_ib(R,s)) {
 			struct buffer * b = (struct buffer *)array_ref(&R->buffer, R->indexbuffer);
 			if (b) {
+				b->last_frame = R->frame;
 				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b->glid);
 			}
 		}
@@ -770,6 +1035,42 @@ calc_texture_size(enum EJ_TEXTURE_FORMAT format, int width, int height) {
 	}
 }
 
+static void
+texture_level_range(struct texture *tex, int *base, int *max) {
+	if (tex->streaming) {
+		*base = tex->base_level;
+		*max = tex->max_level;
+	} else {
+		*base = 0;
+		*max = tex->mipmap_levels > 1 ? tex->mipmap_levels - 1 : 0;
+	}
+}
+
+static int
+texture_memsize(struct texture *tex) {
+	int base, max;
+	texture_level_range(tex, &base, &max);
+	int w = tex->width >> base;
+	int h = tex->height >> base;
+	int size = calc_texture_size(tex->format, w > 0 ? w : 1, h > 0 ? h : 1);
+	if (max > base) {
+		size += size / 3;
+	}
+    switch (tex->type)
+    {
+    case EJ_TEXTURE_3D:
+    case EJ_TEXTURE_2D_ARRAY:
+        size *= tex->depth;
+        break;
+    case EJ_TEXTURE_CUBE:
+        size *= 6;
+        break;
+    default:
+        break;
+    }
+	return size;
+}
+
 RID
 render_texture_create(struct render *R, int width, int height, int depth, enum EJ_TEXTURE_FORMAT format, enum EJ_TEXTURE_TYPE type, int mipmap_levels) {
 	struct texture * tex = (struct texture *)array_alloc(&R->texture);
@@ -781,22 +1082,12 @@ render_texture_create(struct render *R, int width, int height, int depth, enum E
 	tex->depth = depth;
 	tex->format = format;
 	tex->type = type;
-	assert(type == EJ_TEXTURE_2D || type == EJ_TEXTURE_3D || type == EJ_TEXTURE_CUBE);
+	assert(type == EJ_TEXTURE_2D || type == EJ_TEXTURE_3D || type == EJ_TEXTURE_CUBE || type == EJ_TEXTURE_2D_ARRAY);
 	tex->mipmap_levels = mipmap_levels;
-	int size = calc_texture_size(format, width, height);
-	if (mipmap_levels > 1) {
-		size += size / 3;
-	}
-    switch (type)
-    {
-    case EJ_TEXTURE_3D:
-        size *= depth;
-        break;
-    case EJ_TEXTURE_CUBE:
-        size *= 6;
-        break;
-    }
+	int size = texture_memsize(tex);
 	tex->memsize = size;
+	tex->create_frame = tex->last_frame = R->frame;
+	R->memory[EJ_MEMORY_TEXTURE] += size;
 
 	CHECK_GL_ERROR
 	return array_id(&R->texture, tex);
@@ -810,6 +1101,9 @@ bind_texture(struct render *R, struct texture * tex, int slice, GLenum *type, in
 	} else if (tex->type == EJ_TEXTURE_3D) {
 		*type = GL_TEXTURE_3D;
 		*target = GL_TEXTURE_3D;
+	} else if (tex->type == EJ_TEXTURE_2D_ARRAY) {
+		*type = GL_TEXTURE_2D_ARRAY;
+		*target = GL_TEXTURE_2D_ARRAY;
 	} else {
 		assert(tex->type == EJ_TEXTURE_CUBE);
 		*type = GL_TEXTURE_CUBE_MAP;
@@ -937,17 +1231,8 @@ texture_format(struct texture* tex, GLint* internal_format, GLenum* pixel_format
 	return compressed;
 }
 
-void
-render_texture_update(struct render *R, RID id, int width, int height, int depth, const void *pixels,
-                      int slice, int miplevel, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter) {
-	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
-	if (tex == NULL)
-		return;
-
-	GLenum type;
-	int target;
-	bind_texture(R, tex, slice, &type, &target);
-
+static void
+texture_parameter(struct texture *tex, GLenum type, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter) {
 	if (tex->mipmap_levels > 1) {
         switch (filter) {
         case EJ_TEXTURE_NEAREST:
@@ -957,8 +1242,10 @@ render_texture_update(struct render *R, RID id, int width, int height, int depth
             glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
             break;
         }
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tex->mipmap_levels - 1);
+		int base, max;
+		texture_level_range(tex, &base, &max);
+		glTexParameteri(type, GL_TEXTURE_BASE_LEVEL, base);
+		glTexParameteri(type, GL_TEXTURE_MAX_LEVEL, max);
 	} else {
         switch (filter) {
         case EJ_TEXTURE_NEAREST:
@@ -994,7 +1281,7 @@ render_texture_update(struct render *R, RID id, int width, int height, int depth
         {
             // todo: pass in
             float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-            glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+            glTexParameterfv(type, GL_TEXTURE_BORDER_COLOR, borderColor);
         }
         break;
     }
@@ -1003,15 +1290,327 @@ render_texture_update(struct render *R, RID id, int width, int height, int depth
     if (type == GL_TEXTURE_3D) {
         glTexParameteri(type, GL_TEXTURE_WRAP_R, gl_wrap);
     }
+}
+
+#ifdef SAMPLER_OBJECT_ENABLE
+
+static GLuint
+sampler_object(struct render *R, struct texture *tex, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter) {
+	// the state packed is its own hash
+	uint32_t key = 1 | ((uint32_t)wrap << 1) | ((uint32_t)filter << 4) | ((tex->mipmap_levels > 1 ? 1 : 0) << 5);
+	int i;
+	for (i = 0; i < R->sampler_n; ++i) {
+		if (R->samplers[i].key == key) {
+			return R->samplers[i].glid;
+		}
+	}
+	if (R->sampler_n >= MAX_SAMPLER) {
+		return 0;
+	}
+
+	GLuint s = 0;
+	glGenSamplers(1, &s);
+	GLint min_filter, mag_filter;
+	if (filter == EJ_TEXTURE_NEAREST) {
+		min_filter = tex->mipmap_levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST;
+		mag_filter = GL_NEAREST;
+	} else {
+		min_filter = tex->mipmap_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+		mag_filter = GL_LINEAR;
+	}
+	glSamplerParameteri(s, GL_TEXTURE_MIN_FILTER, min_filter);
+	glSamplerParameteri(s, GL_TEXTURE_MAG_FILTER, mag_filter);
+
+	GLint gl_wrap = GL_REPEAT;
+	switch (wrap) {
+	case EJ_TEXTURE_REPEAT:
+		gl_wrap = GL_REPEAT;
+		break;
+	case EJ_TEXTURE_MIRRORED_REPEAT:
+		gl_wrap = GL_MIRRORED_REPEAT;
+		break;
+	case EJ_TEXTURE_CLAMP_TO_EDGE:
+		gl_wrap = GL_CLAMP_TO_EDGE;
+		break;
+	case EJ_TEXTURE_CLAMP_TO_BORDER:
+		gl_wrap = GL_CLAMP_TO_BORDER;
+		{
+			float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+			glSamplerParameterfv(s, GL_TEXTURE_BORDER_COLOR, borderColor);
+		}
+		break;
+	}
+	glSamplerParameteri(s, GL_TEXTURE_WRAP_S, gl_wrap);
+	glSamplerParameteri(s, GL_TEXTURE_WRAP_T, gl_wrap);
+	glSamplerParameteri(s, GL_TEXTURE_WRAP_R, gl_wrap);
+
+	R->samplers[R->sampler_n].key = key;
+	R->samplers[R->sampler_n].glid = s;
+	++R->sampler_n;
+
+	CHECK_GL_ERROR
+	return s;
+}
+
+static void
+bind_samplers(struct render *R) {
+	int i;
+	for (i = 0; i < MAX_TEXTURE; ++i) {
+		struct texture * tex = (struct texture *)array_ref(&R->texture, R->current.texture[i]);
+		GLuint s = tex ? tex->sampler : 0;
+		if (s != R->last_sampler[i]) {
+			glBindSampler(i, s);
+			R->last_sampler[i] = s;
+		}
+	}
+}
+
+#endif // SAMPLER_OBJECT_ENABLE
+
+static void
+texture_sampler(struct render *R, struct texture *tex, GLenum type, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter) {
+#ifdef SAMPLER_OBJECT_ENABLE
+	if (R->features & EJ_FEATURE_SAMPLER_OBJECT) {
+		GLuint s = sampler_object(R, tex, wrap, filter);
+		if (s != 0) {
+			if (tex->sampler != s) {
+				// once per change, for units without a sampler bound and
+				// for users of the raw gl id
+				tex->sampler = s;
+				tex->wrap = wrap;
+				tex->filter = filter;
+				texture_parameter(tex, type, wrap, filter);
+				R->changeflag |= CHANGE_TEXTURE;
+			} else if (tex->mipmap_levels > 1 && !tex->immutable) {
+				int base, max;
+				texture_level_range(tex, &base, &max);
+				glTexParameteri(type, GL_TEXTURE_BASE_LEVEL, base);
+				glTexParameteri(type, GL_TEXTURE_MAX_LEVEL, max);
+			}
+			return;
+		}
+	}
+#endif // SAMPLER_OBJECT_ENABLE
+	tex->sampler = 0;
+	tex->wrap = wrap;
+	tex->filter = filter;
+	texture_parameter(tex, type, wrap, filter);
+}
+
+// a new gl object without storage, for immutable textures that have to
+// be resized or allocated level by level
+static void
+texture_recreate(struct render *R, RID id, struct texture *tex, GLenum type) {
+	int i;
+	for (i = 0; i < MAX_TEXTURE; ++i) {
+		if (R->last.texture[i] == id) {
+			R->last.texture[i] = 0;
+		}
+	}
+	R->changeflag |= CHANGE_TEXTURE;
+	glDeleteTextures(1, &tex->glid);
+	glGenTextures(1, &tex->glid);
+	glBindTexture(type, tex->glid);
+	tex->immutable = 0;
+	texture_parameter(tex, type, tex->wrap, tex->filter);
+}
+
+#ifdef TEXTURE_STORAGE_ENABLE
+
+static GLenum
+sized_format(enum EJ_TEXTURE_FORMAT format) {
+	switch (format) {
+	case EJ_TEXTURE_RGBA8:
+		return GL_RGBA8;
+	case EJ_TEXTURE_RGB:
+		return GL_RGB8;
+	case EJ_TEXTURE_RGBA4:
+		return GL_RGBA4;
+	case EJ_TEXTURE_RGB565:
+		return GL_RGB565;
+#if OPENGLES == 0
+	case EJ_TEXTURE_BGRA_EXT:
+		return GL_RGBA8;
+	case EJ_TEXTURE_BGR_EXT:
+		return GL_RGB8;
+	case EJ_TEXTURE_R16:
+		return GL_R16_SNORM;
+	case EJ_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	case EJ_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+	case EJ_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+#endif // OPENGLES
+	case EJ_TEXTURE_RGBA16F:
+		return GL_RGBA16F;
+	case EJ_TEXTURE_RGB16F:
+		return GL_RGB16F;
+	case EJ_TEXTURE_RGB32F:
+		return GL_RGB32F;
+	case EJ_TEXTURE_RG16F:
+		return GL_RG16F;
+	case EJ_TEXTURE_RED:
+		return GL_R8;
+	case EJ_TEXTURE_ETC2:
+		return GL_COMPRESSED_RGBA8_ETC2_EAC;
+	default:
+		// no sized equivalent, keep glTexImage
+		return 0;
+	}
+}
+
+// return 1 if the texture has immutable storage
+static int
+texture_storage(struct render *R, RID id, struct texture *tex, GLenum type, int width, int height, int depth, int miplevel) {
+	if (!(R->features & EJ_FEATURE_TEXTURE_STORAGE))
+		return 0;
+	if (type != GL_TEXTURE_2D && type != GL_TEXTURE_CUBE_MAP && type != GL_TEXTURE_2D_ARRAY && type != GL_TEXTURE_3D)
+		return 0;
+	// streamed levels are allocated one by one
+	if (tex->streaming)
+		return 0;
+	GLenum sized = sized_format(tex->format);
+	if (sized == 0)
+		return 0;
+	// level 0 defines the storage
+	if (!tex->immutable && miplevel != 0)
+		return 0;
+
+	if (tex->immutable) {
+		if (miplevel != 0 || (width == tex->width && height == tex->height && depth == tex->depth))
+			return 1;
+		// resized, immutable storage has to be recreated
+		texture_recreate(R, id, tex, type);
+	}
+
+	if (width != tex->width || height != tex->height || depth != tex->depth) {
+		R->memory[EJ_MEMORY_TEXTURE] -= tex->memsize;
+		tex->width = width;
+		tex->height = height;
+		tex->depth = depth;
+		tex->memsize = texture_memsize(tex);
+		R->memory[EJ_MEMORY_TEXTURE] += tex->memsize;
+	}
+
+	// glTexStorage rejects more levels than the chain has,
+	// glTexImage tolerated them
+	int levels = tex->mipmap_levels > 1 ? tex->mipmap_levels : 1;
+	int full = 1;
+	int dim = width > height ? width : height;
+	if (type == GL_TEXTURE_3D && depth > dim) {
+		dim = depth;
+	}
+	while (dim > 1) {
+		dim >>= 1;
+		++full;
+	}
+	if (levels > full) {
+		levels = full;
+	}
+	if (type == GL_TEXTURE_2D_ARRAY || type == GL_TEXTURE_3D) {
+		glTexStorage3D(type, levels, sized, width, height, depth);
+	} else {
+		glTexStorage2D(type, levels, sized, width, height);
+	}
+	tex->immutable = 1;
+
+	return 1;
+}
+
+#endif // TEXTURE_STORAGE_ENABLE
+
+void
+render_texture_update(struct render *R, RID id, int width, int height, int depth, const void *pixels,
+                      int slice, int miplevel, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	if (tex == NULL)
+		return;
+
+	if (tex->evicted) {
+		tex->evicted = 0;
+		R->memory[EJ_MEMORY_TEXTURE] += tex->memsize;
+	}
+
+	GLenum type;
+	int target;
+	bind_texture(R, tex, slice, &type, &target);
+
+	texture_sampler(R, tex, type, wrap, filter);
+
+	if (miplevel > 0) {
+		tex->explicit_mips = 1;
+	}
+
+	// layers of an array, 0 keeps the count it was created with
+	if (type == GL_TEXTURE_2D_ARRAY && depth <= 0) {
+		depth = tex->depth;
+	}
 
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    if (type == GL_TEXTURE_3D) {
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA, width, height, depth, 0,
-            GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    } else if (type == GL_TEXTURE_CUBE_MAP) {
-        for (unsigned int i = 0; i < 6; ++i) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
-        }
+#ifdef TEXTURE_STORAGE_ENABLE
+	int layered = type == GL_TEXTURE_2D_ARRAY || type == GL_TEXTURE_3D;
+	if (texture_storage(R, id, tex, type, width, height, layered ? depth : tex->depth, miplevel)) {
+		// only data from here, the storage is fixed
+		if (layered && pixels) {
+			GLint internal_format = 0;
+			GLenum pixel_format = 0;
+			GLenum itype = 0;
+			int compressed = texture_format(tex, &internal_format, &pixel_format, &itype);
+			if (compressed) {
+				glCompressedTexSubImage3D(target, miplevel, 0, 0, 0, width, height, depth, pixel_format,
+					calc_texture_size(tex->format, width, height) * depth, pixels);
+			} else {
+				glTexSubImage3D(target, miplevel, 0, 0, 0, width, height, depth, pixel_format, itype, pixels);
+			}
+		} else if ((type == GL_TEXTURE_2D || type == GL_TEXTURE_CUBE_MAP) && pixels) {
+			// target is the face of a cube
+			GLint internal_format = 0;
+			GLenum pixel_format = 0;
+			GLenum itype = 0;
+			int compressed = texture_format(tex, &internal_format, &pixel_format, &itype);
+			if (compressed) {
+				glCompressedTexSubImage2D(target, miplevel, 0, 0, width, height, pixel_format,
+					calc_texture_size(tex->format, width, height), pixels);
+			} else {
+				glTexSubImage2D(target, miplevel, 0, 0, width, height, pixel_format, itype, pixels);
+			}
+		}
+	} else
+#endif // TEXTURE_STORAGE_ENABLE
+    if (type == GL_TEXTURE_2D_ARRAY || type == GL_TEXTURE_3D) {
+	    if (depth != tex->depth) {
+		    R->memory[EJ_MEMORY_TEXTURE] -= tex->memsize;
+		    tex->depth = depth;
+		    tex->memsize = texture_memsize(tex);
+		    R->memory[EJ_MEMORY_TEXTURE] += tex->memsize;
+	    }
+	    GLint internal_format = 0;
+	    GLenum pixel_format = 0;
+	    GLenum itype = 0;
+	    int compressed = texture_format(tex, &internal_format, &pixel_format, &itype);
+	    if (compressed) {
+		    glCompressedTexImage3D(target, miplevel, pixel_format, width, height, depth, 0,
+			    calc_texture_size(tex->format, width, height) * depth, pixels);
+	    } else {
+		    glTexImage3D(target, miplevel, internal_format, width, height, depth, 0, pixel_format, itype, pixels);
+	    }
+    } else if (type == GL_TEXTURE_CUBE_MAP && pixels == NULL) {
+	    // no data allocates the level of all six faces, data goes to the slice face
+	    GLint internal_format = 0;
+	    GLenum pixel_format = 0;
+	    GLenum itype = 0;
+	    int compressed = texture_format(tex, &internal_format, &pixel_format, &itype);
+	    int i;
+	    for (i = 0; i < 6; ++i) {
+		    if (compressed) {
+			    glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, miplevel, pixel_format,
+				    width, height, 0, calc_texture_size(tex->format, width, height), NULL);
+		    } else {
+			    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, miplevel, internal_format,
+				    width, height, 0, pixel_format, itype, NULL);
+		    }
+	    }
     } else {
 	    GLint internal_format = 0;
 	    GLenum pixel_format = 0;
@@ -1019,20 +1618,99 @@ render_texture_update(struct render *R, RID id, int width, int height, int depth
 	    int compressed = texture_format(tex, &internal_format, &pixel_format, &itype);
 	    if (compressed) {
  		    glCompressedTexImage2D(target, miplevel, pixel_format,
- 			    (GLsizei)tex->width, (GLsizei)tex->height, 0,
+ 			    (GLsizei)width, (GLsizei)height, 0,
  			    calc_texture_size(tex->format, width, height), pixels);
 	    } else {
 		    glTexImage2D(target, miplevel, internal_format, (GLsizei)width, (GLsizei)height, 0, pixel_format, itype, pixels);
 	    }
     }
 
-    if (tex->mipmap_levels > 1) {
+    // streamed levels come from the source, cube faces are uploaded in
+    // order and the chain is built once the last one is in
+    if (tex->mipmap_levels > 1 && !tex->streaming && !tex->explicit_mips &&
+        (type != GL_TEXTURE_CUBE_MAP || pixels == NULL || slice == 5)) {
         glGenerateMipmap(type);
     }
 
 	CHECK_GL_ERROR
 }
 
+#ifdef MIPMAP_BLIT_ENABLE
+
+static void
+attach_texture_level(GLenum fb, struct texture *tex, int target, int slice, int level) {
+	if (tex->type == EJ_TEXTURE_2D_ARRAY) {
+		glFramebufferTextureLayer(fb, GL_COLOR_ATTACHMENT0, tex->glid, level, slice);
+	} else {
+		glFramebufferTexture2D(fb, GL_COLOR_ATTACHMENT0, target, tex->glid, level);
+	}
+}
+
+#endif // MIPMAP_BLIT_ENABLE
+
+// downsample the footprint of a level 0 region into the other levels,
+// return 0 if it can't be done so
+static int
+texture_mipmap_region(struct render *R, struct texture *tex, int target, int slice, int x, int y, int w, int h) {
+#ifdef MIPMAP_BLIT_ENABLE
+	if (R->blit_fbo[0] == 0) {
+		glGenFramebuffers(2, R->blit_fbo);
+	}
+
+	GLint prev_read = 0, prev_draw = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw);
+	GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+	if (scissor) {
+		glDisable(GL_SCISSOR_TEST);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, R->blit_fbo[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, R->blit_fbo[1]);
+
+	int x0 = x, y0 = y, x1 = x + w, y1 = y + h;
+	int sw = tex->width, sh = tex->height;
+	int ok = 1;
+	int level;
+	for (level = 1; level < tex->mipmap_levels && (sw > 1 || sh > 1); ++level) {
+		int dw = sw > 1 ? sw / 2 : 1;
+		int dh = sh > 1 ? sh / 2 : 1;
+
+		// whole 2x2 footprints, a linear blit at half size is a box filter
+		int dx0 = x0 / 2, dy0 = y0 / 2;
+		int dx1 = (x1 + 1) / 2, dy1 = (y1 + 1) / 2;
+		if (dx1 > dw) dx1 = dw;
+		if (dy1 > dh) dy1 = dh;
+		int sx0 = sw > 1 ? dx0 * 2 : 0, sx1 = sw > 1 ? dx1 * 2 : 1;
+		int sy0 = sh > 1 ? dy0 * 2 : 0, sy1 = sh > 1 ? dy1 * 2 : 1;
+
+		attach_texture_level(GL_READ_FRAMEBUFFER, tex, target, slice, level - 1);
+		attach_texture_level(GL_DRAW_FRAMEBUFFER, tex, target, slice, level);
+		if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE ||
+			glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			ok = 0;
+			break;
+		}
+		glBlitFramebuffer(sx0, sy0, sx1, sy1, dx0, dy0, dx1, dy1, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+		x0 = dx0; y0 = dy0; x1 = dx1; y1 = dy1;
+		sw = dw; sh = dh;
+	}
+
+	glFramebufferRenderbuffer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw);
+	if (scissor) {
+		glEnable(GL_SCISSOR_TEST);
+	}
+
+	CHECK_GL_ERROR
+	return ok;
+#else
+	return 0;
+#endif // MIPMAP_BLIT_ENABLE
+}
+
 void
 render_texture_subupdate(struct render *R, RID id, const void *pixels, int x, int y, int w, int h, int slice, int miplevel) {
 	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
@@ -1048,15 +1726,236 @@ render_texture_subupdate(struct render *R, RID id, const void *pixels, int x, in
 	GLenum pixel_format = 0;
 	GLenum itype = 0;
 	int compressed = texture_format(tex, &internal_format, &pixel_format, &itype);
-	if (compressed) {
-		glCompressedTexSubImage2D(GL_TEXTURE_2D, miplevel,
+	if (type == GL_TEXTURE_2D_ARRAY || type == GL_TEXTURE_3D) {
+		// slice is the layer or the z of a volume
+		if (compressed) {
+			glCompressedTexSubImage3D(type, miplevel, x, y, slice, w, h, 1, pixel_format,
+				calc_texture_size(tex->format, w, h), pixels);
+		} else {
+			glTexSubImage3D(type, miplevel, x, y, slice, w, h, 1, pixel_format, itype, pixels);
+		}
+	} else if (compressed) {
+		glCompressedTexSubImage2D(target, miplevel,
 			x, y, w, h, pixel_format,
 			calc_texture_size(tex->format, w, h), pixels);
 	} else {
-		glTexSubImage2D(GL_TEXTURE_2D, miplevel, x, y, w, h, pixel_format, itype, pixels);
+		glTexSubImage2D(target, miplevel, x, y, w, h, pixel_format, itype, pixels);
+	}
+
+	if (miplevel > 0) {
+		tex->explicit_mips = 1;
+	} else if (tex->mipmap_levels > 1 && !tex->streaming && !tex->explicit_mips && !compressed
+	        && tex->format != EJ_TEXTURE_DEPTH && type != GL_TEXTURE_3D) {
+		// a large region costs about the same as the whole chain
+		if (w * h * 2 >= tex->width * tex->height || !texture_mipmap_region(R, tex, target, slice, x, y, w, h)) {
+			bind_texture(R, tex, slice, &type, &target);
+			glGenerateMipmap(type);
+		}
+	}
+
+	CHECK_GL_ERROR
+}
+
+void
+render_texture_subupdate3d(struct render *R, RID id, const void *pixels, int x, int y, int z, int w, int h, int d, int miplevel) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	if (tex == NULL || (tex->type != EJ_TEXTURE_3D && tex->type != EJ_TEXTURE_2D_ARRAY))
+		return;
+
+	GLenum type;
+	int target;
+	bind_texture(R, tex, 0, &type, &target);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+	GLint internal_format = 0;
+	GLenum pixel_format = 0;
+	GLenum itype = 0;
+	if (texture_format(tex, &internal_format, &pixel_format, &itype)) {
+		glCompressedTexSubImage3D(type, miplevel, x, y, z, w, h, d, pixel_format,
+			calc_texture_size(tex->format, w, h) * d, pixels);
+	} else {
+		glTexSubImage3D(type, miplevel, x, y, z, w, h, d, pixel_format, itype, pixels);
+	}
+
+	if (miplevel > 0) {
+		tex->explicit_mips = 1;
+	}
+
+	CHECK_GL_ERROR
+}
+
+void
+render_texture_generate_mipmap(struct render *R, RID id) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	if (tex == NULL || tex->mipmap_levels <= 1 || tex->streaming)
+		return;
+
+	GLenum type;
+	int target;
+	bind_texture(R, tex, 0, &type, &target);
+	glGenerateMipmap(type);
+
+	CHECK_GL_ERROR
+}
+
+void
+render_texture_set_param(struct render *R, RID id, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	if (tex == NULL)
+		return;
+
+	GLenum type;
+	int target;
+	bind_texture(R, tex, 0, &type, &target);
+	texture_sampler(R, tex, type, wrap, filter);
+
+	CHECK_GL_ERROR
+}
+
+void
+render_texture_set_lod_range(struct render *R, RID id, int base, int max) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	if (tex == NULL || tex->type == EJ_TEXTURE_3D)
+		return;
+
+	int last = tex->mipmap_levels > 1 ? tex->mipmap_levels - 1 : 0;
+	if (base < 0)
+		base = 0;
+	if (max < base || max > last)
+		max = last;
+	if (base > max)
+		base = max;
+
+	GLenum type;
+	int target;
+	bind_texture(R, tex, 0, &type, &target);
+
+	// e.g. recycled from a pool, the levels are allocated one by one from
+	// here and the old contents are gone
+	if (tex->immutable) {
+		texture_recreate(R, id, tex, type);
+	}
+
+	if (tex->streaming && !tex->evicted) {
+		// a zero sized image frees the level
+		GLint internal_format = 0;
+		GLenum pixel_format = 0;
+		GLenum itype = 0;
+		if (texture_format(tex, &internal_format, &pixel_format, &itype) == 0 && type == GL_TEXTURE_2D) {
+			int i;
+			for (i = tex->base_level; i < base; ++i) {
+				glTexImage2D(GL_TEXTURE_2D, i, internal_format, 0, 0, 0, pixel_format, itype, NULL);
+			}
+		}
+	}
+
+	if (!tex->evicted) {
+		R->memory[EJ_MEMORY_TEXTURE] -= tex->memsize;
+	}
+	tex->streaming = 1;
+	tex->base_level = base;
+	tex->max_level = max;
+	tex->memsize = texture_memsize(tex);
+	if (!tex->evicted) {
+		R->memory[EJ_MEMORY_TEXTURE] += tex->memsize;
+	}
+
+	glTexParameteri(type, GL_TEXTURE_BASE_LEVEL, base);
+	glTexParameteri(type, GL_TEXTURE_MAX_LEVEL, max);
+
+	CHECK_GL_ERROR
+}
+
+static int
+clear_texture_fbo(struct render *R, struct texture *tex) {
+	if (tex->type == EJ_TEXTURE_CUBE || tex->format == EJ_TEXTURE_DEPTH)
+		return 0;
+	int layers = tex->type == EJ_TEXTURE_2D ? 1 : tex->depth;
+
+	if (R->clear_fbo == 0) {
+		glGenFramebuffers(1, &R->clear_fbo);
+	}
+
+	GLint prev_fbo = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, R->clear_fbo);
+	if (tex->type != EJ_TEXTURE_2D) {
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex->glid, 0, 0);
+	} else {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex->glid, 0);
+	}
+
+	int ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (ok) {
+		int i;
+		GLfloat color[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, color);
+		GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+		if (scissor) {
+			glDisable(GL_SCISSOR_TEST);
+		}
+		GLint vp[4];
+		glGetIntegerv(GL_VIEWPORT, vp);
+		glViewport(0, 0, tex->width, tex->height);
+
+		glClearColor(0, 0, 0, 0);
+		for (i = 0; i < layers; ++i) {
+			if (i > 0) {
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex->glid, 0, i);
+			}
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+
+		glViewport(vp[0], vp[1], vp[2], vp[3]);
+		if (scissor) {
+			glEnable(GL_SCISSOR_TEST);
+		}
+		glClearColor(color[0], color[1], color[2], color[3]);
+	}
+
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+
+	if (ok && tex->mipmap_levels > 1) {
+		GLenum type;
+		int target;
+		bind_texture(R, tex, 0, &type, &target);
+		glGenerateMipmap(type);
+	}
+
+	return ok;
+}
+
+int
+render_texture_clear(struct render *R, RID id) {
+	struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+	if (tex == NULL)
+		return 0;
+
+	GLint internal_format = 0;
+	GLenum pixel_format = 0;
+	GLenum itype = 0;
+	if (texture_format(tex, &internal_format, &pixel_format, &itype) != 0)
+		return 0;
+
+	int ok = 0;
+#ifdef GL_VERSION_4_4
+	if (R->features & EJ_FEATURE_CLEAR_TEXTURE) {
+		int base, max;
+		texture_level_range(tex, &base, &max);
+		int i;
+		for (i = base; i <= max; ++i) {
+			glClearTexImage(tex->glid, i, pixel_format, itype, NULL);
+		}
+		ok = 1;
+	}
+#endif // GL_VERSION_4_4
+	if (!ok) {
+		ok = clear_texture_fbo(R, tex);
 	}
 
 	CHECK_GL_ERROR
+	return ok;
 }
 
 // blend func
@@ -1129,6 +2028,7 @@ create_rt(struct render *R, RID texid) {
 	if (tex == NULL)
 		return 0;
 	glGenFramebuffers(1, &tar->glid);
+	tar->create_frame = tar->last_frame = R->frame;
 	glBindFramebuffer(GL_FRAMEBUFFER, tar->glid);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex->glid, 0);
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -1170,18 +2070,76 @@ render_target_texture(struct render *R, RID rt) {
 
 // render state
 
+// stamp the objects that stay bound across frames
+static void
+touch_objects(struct render *R) {
+	int i;
+	for (i=0;i<MAX_TEXTURE;i++) {
+		struct texture * tex = (struct texture *)array_ref(&R->texture, R->current.texture[i]);
+		if (tex) {
+			tex->last_frame = R->frame;
+		}
+	}
+	for (i=0;i<MAX_VB_SLOT;i++) {
+		struct buffer * buf = (struct buffer *)array_ref(&R->buffer, R->vbslot[i]);
+		if (buf) {
+			buf->last_frame = R->frame;
+		}
+	}
+	struct buffer * ib = (struct buffer *)array_ref(&R->buffer, R->indexbuffer);
+	if (ib) {
+		ib->last_frame = R->frame;
+	}
+	struct attrib * a = (struct attrib *)array_ref(&R->attrib, R->attrib_layout);
+	if (a) {
+		a->last_frame = R->frame;
+	}
+	struct shader * s = (struct shader *)array_ref(&R->shader, R->program);
+	if (s) {
+		s->last_frame = R->frame;
+	}
+	struct target * tar = (struct target *)array_ref(&R->target, R->current.target);
+	if (tar) {
+		tar->last_frame = R->frame;
+	}
+	R->touch_frame = R->frame;
+}
+
+static void
+restore_textures(struct render *R) {
+	if (R->reload == NULL)
+		return;
+	int i;
+	for (i=0;i<MAX_TEXTURE;i++) {
+		RID id = R->current.texture[i];
+		if (id == R->last.texture[i])
+			continue;
+		struct texture * tex = (struct texture *)array_ref(&R->texture, id);
+		if (tex && tex->evicted) {
+			R->reload(R->reload_ud, id);
+		}
+	}
+}
+
 static void
 render_state_commit(struct render *R) {
 	if (R->changeflag & CHANGE_VERTEXARRAY) {
 		apply_va(R);
 	}
 
+	if (R->touch_frame != R->frame) {
+		touch_objects(R);
+	}
+
 	if (R->changeflag & CHANGE_TEXTURE) {
 		static GLenum mode[] = {
 			GL_TEXTURE_2D,
 			GL_TEXTURE_3D,
 			GL_TEXTURE_CUBE_MAP,
+			GL_TEXTURE_2D_ARRAY,
 		};
+		// before binding, reload uses the last slot
+		restore_textures(R);
 		int i;
 		for (i=0;i<MAX_TEXTURE;i++) {
 			RID id = R->current.texture[i];
@@ -1195,11 +2153,17 @@ render_state_commit(struct render *R) {
                     glBindTexture(mode[last_tex->type], 0);
                 }
 				if (tex) {
+					tex->last_frame = R->frame;
 					glActiveTexture(GL_TEXTURE0 + i);
 					glBindTexture(mode[tex->type], tex->glid);
 				}
 			}
 		}
+#ifdef SAMPLER_OBJECT_ENABLE
+		if (R->features & EJ_FEATURE_SAMPLER_OBJECT) {
+			bind_samplers(R);
+		}
+#endif // SAMPLER_OBJECT_ENABLE
 		CHECK_GL_ERROR
 	}
 
@@ -1210,6 +2174,7 @@ render_state_commit(struct render *R) {
 			if (crt != 0) {
 				struct target * tar = (struct target *)array_ref(&R->target, crt);
 				if (tar) {
+					tar->last_frame = R->frame;
 					rt = tar->glid;
 				} else {
 					crt = 0;
@@ -1412,6 +2377,13 @@ render_clear(struct render *R, enum EJ_CLEAR_MASK mask, unsigned long c) {
 	CHECK_GL_ERROR
 }
 
+void
+render_commit(struct render *R) {
+	render_state_commit(R);
+
+	CHECK_GL_ERROR
+}
+
 // draw
 void
 render_draw_elements(struct render *R, enum EJ_DRAW_MODE mode, int fromidx, int ni, int type_short) {
@@ -52,6 +52,7 @@ enum EJ_TEXTURE_TYPE {
 	EJ_TEXTURE_2D = 0,
 	EJ_TEXTURE_3D,
 	EJ_TEXTURE_CUBE,
+	EJ_TEXTURE_2D_ARRAY,
 };
 
 enum EJ_TEXTURE_FORMAT {
@@ -177,6 +178,22 @@ enum EJ_TEXTURE_FILTER
     EJ_TEXTURE_LINEAR,
 };
 
+// optional gl features, detected by the caller
+enum EJ_FEATURE
+{
+    EJ_FEATURE_CLEAR_TEXTURE   = 0x1,
+    EJ_FEATURE_TEXTURE_STORAGE = 0x2,
+    EJ_FEATURE_SAMPLER_OBJECT  = 0x4,
+};
+
+enum EJ_MEMORY_TYPE
+{
+    EJ_MEMORY_TEXTURE,
+    EJ_MEMORY_BUFFER,
+
+    EJ_MEMORY_COUNT
+};
+
 int render_version(struct render *R);
 int render_size(struct render_init_args *args);
 struct render * render_init(struct render_init_args *args, void * buffer, int sz);
@@ -186,6 +203,48 @@ void render_set(struct render *R, enum EJ_RENDER_OBJ what, RID id, int slot);
 RID render_get(struct render *R, enum EJ_RENDER_OBJ what, int slot);
 void render_release(struct render *R, enum EJ_RENDER_OBJ what, RID id);
 
+// bytes held by the live objects of the pools
+int64_t render_memory_usage(struct render *R, enum EJ_MEMORY_TYPE type);
+
+void render_set_features(struct render *R, uint32_t features);
+
+// apply the pending state, for gl calls made outside the render layer,
+// e.g. compute dispatches reading the bound textures
+void render_commit(struct render *R);
+
+// frame stamped on the textures bound by render_state_commit
+void render_set_frame(struct render *R, int frame);
+
+// evicted textures keep their id, reload is called before they are bound again
+typedef void (*render_texture_reload)(void *ud, RID id);
+void render_set_texture_reload(struct render *R, render_texture_reload reload, void *ud);
+void render_texture_evict(struct render *R, RID id);
+int render_texture_resident(struct render *R, RID id);
+int render_texture_last_frame(struct render *R, RID id);
+int render_texture_memsize(struct render *R, RID id);
+
+struct render_object_info {
+	enum EJ_RENDER_OBJ type;
+	RID id;
+	unsigned int glid;
+	int size;
+	int width;
+	int height;
+	int depth;
+	int format;
+	int texture_type;
+	int mipmap_levels;
+	// levels set by render_texture_set_lod_range
+	int streaming;
+	int create_frame;
+	int last_frame;
+};
+
+// return 0 if id is not a live object of that type
+int render_query(struct render *R, enum EJ_RENDER_OBJ what, RID id, struct render_object_info *info);
+typedef void (*render_object_visitor)(void *ud, const struct render_object_info *info);
+void render_foreach(struct render *R, enum EJ_RENDER_OBJ what, render_object_visitor visit, void *ud);
+
 RID render_register_vertexlayout(struct render *R, int n, struct vertex_attrib * attrib);
 void render_update_vertexlayout(struct render *R, int n, struct vertex_attrib * attrib);
 RID render_get_binded_vertexlayout(struct render *R);
@@ -195,9 +254,22 @@ RID render_buffer_create(struct render *R, enum EJ_RENDER_OBJ what, const void*
 void render_buffer_update(struct render *R, RID id, const void* data, int size);
 
 RID render_texture_create(struct render *R, int width, int height, int depth, enum EJ_TEXTURE_FORMAT format, enum EJ_TEXTURE_TYPE type, int mipmap_levels);
+// slice is the face of a cube, null pixels allocate the level of all faces
 void render_texture_update(struct render *R, RID id, int width, int height, int depth, const void *pixels, int slice, int miplevel, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter);
-// subupdate only support slice 0, miplevel 0
+// updating level 0 of a mipmapped texture regenerates the region's
+// footprint in the other levels, unless levels were uploaded explicitly
 void render_texture_subupdate(struct render *R, RID id, const void *pixels, int x, int y, int w, int h, int slice, int miplevel);
+// a box of a 3d texture or of layers [z, z + d) of an array
+void render_texture_subupdate3d(struct render *R, RID id, const void *pixels, int x, int y, int z, int w, int h, int d, int miplevel);
+// rebuild the other levels from level 0, e.g. after rendering into it
+void render_texture_generate_mipmap(struct render *R, RID id);
+// sampler state only, storage untouched
+void render_texture_set_param(struct render *R, RID id, enum EJ_TEXTURE_WRAP wrap, enum EJ_TEXTURE_FILTER filter);
+// zero all levels on the gpu, return 0 if the format can't be cleared so
+int render_texture_clear(struct render *R, RID id);
+// sample only levels [base, max] and stream the rest: the levels are then
+// allocated by their own updates and the ones dropped below base are freed
+void render_texture_set_lod_range(struct render *R, RID id, int base, int max);
 
 RID render_target_create(struct render *R, int width, int height, enum EJ_TEXTURE_FORMAT format);
 // render_release EJ_TARGET would not release the texture attachment
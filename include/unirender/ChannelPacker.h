@@ -0,0 +1,78 @@
+#pragma once
+
+#include "unirender/typedef.h"
+#include "unirender/Texture.h"
+
+#include <cu/uncopyable.h>
+
+#include <vector>
+#include <unordered_map>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// Combines single channel textures (roughness, metalness, ao, masks) of
+// the same size into the channels of shared rgba8 textures, so a material
+// binds one texture instead of up to four. Sources are staged by Add() and
+// packed by Flush(), shaders read them through the slot's channel.
+class ChannelPacker : private cu::Uncopyable
+{
+public:
+	struct Slot
+	{
+		TexturePtr tex = nullptr;
+
+		// 0 to 3 for r, g, b, a
+		int channel = -1;
+
+		// component to sample in the shader
+		char Swizzle() const { return channel >= 0 ? "rgba"[channel] : 'r'; }
+	};
+
+public:
+	ChannelPacker(RenderContext* rc, TEXTURE_WRAP wrap = TEXTURE_REPEAT,
+		TEXTURE_FILTER filter = TEXTURE_LINEAR);
+
+	// pixels are width * height bytes, TEXTURE_RED or TEXTURE_A8 data, and
+	// copied; sources of a group are sampled together and packed together
+	void Add(uint64_t key, const uint8_t* pixels, int width, int height, uint64_t group = 0);
+	// false until the source is packed by Flush()
+	bool Query(uint64_t key, Slot& slot) const;
+	// a packed texture is freed with the last of its sources
+	void Remove(uint64_t key);
+
+	// pack and upload the added sources, once loading is done
+	void Flush();
+
+	// planes[i] goes to channel i of count rgba pixels, nullptr planes are fill
+	static void Interleave(const uint8_t* const planes[4], size_t count,
+		uint8_t* rgba, uint8_t fill = 0);
+
+private:
+	struct Pending
+	{
+		uint64_t key;
+		uint64_t group;
+
+		int w, h;
+		std::vector<uint8_t> pixels;
+	};
+
+private:
+	RenderContext* m_rc;
+
+	TEXTURE_WRAP   m_wrap;
+	TEXTURE_FILTER m_filter;
+
+	std::vector<Pending> m_pending;
+
+	std::unordered_map<uint64_t, Slot> m_slots;
+
+}; // ChannelPacker
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include <stddef.h>
+
+namespace ur
+{
+
+// Merges overlapping and adjacent rects while the bounding box wastes
+// less than the threshold of its area, so a frame's many small updates
+// become a few larger ones.
+class DirtyRects
+{
+public:
+	struct Rect
+	{
+		int x, y, w, h;
+	};
+
+public:
+	DirtyRects(float waste = 0.25f, size_t max_rects = 16);
+
+	void Add(int x, int y, int w, int h);
+	void Clear() { m_rects.clear(); }
+
+	bool Empty() const { return m_rects.empty(); }
+	const std::vector<Rect>& GetRects() const { return m_rects; }
+
+private:
+	// pixels in the bounding box not covered by a or b
+	static int CalcWaste(const Rect& a, const Rect& b, Rect& bound);
+
+private:
+	float  m_waste;
+	size_t m_max_rects;
+
+	std::vector<Rect> m_rects;
+
+}; // DirtyRects
+
+}
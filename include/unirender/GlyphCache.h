@@ -0,0 +1,80 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include <stdint.h>
+
+namespace ur
+{
+
+class RenderContext;
+class Texture;
+class TextureAtlas;
+
+// Signed distance field glyphs, one atlas per font. Glyphs are rasterized
+// once at the base size by the caller and scale to any size in the shader:
+// the red channel is 0.5 on the outline, higher inside.
+class GlyphCache : private cu::Uncopyable
+{
+public:
+	struct Glyph
+	{
+		int page = -1;
+
+		// sdf size, the bitmap plus spread on each side
+		int w = 0, h = 0;
+		int spread = 0;
+
+		// xmin, ymin, xmax, ymax
+		float uv[4] = { 0, 0, 0, 0 };
+	};
+
+public:
+	GlyphCache(RenderContext* rc, int page_size = 1024, int spread = 4, int max_pages = 2);
+	~GlyphCache();
+
+	bool Query(uint32_t font, uint32_t codepoint, Glyph& glyph);
+
+	// coverage is w * h, 8 bits per pixel, built into the atlas on Flush()
+	void Add(uint32_t font, uint32_t codepoint, const uint8_t* coverage, int w, int h);
+
+	// generate the pending sdfs and upload them, once per frame
+	void Flush();
+
+	const Texture* GetPage(uint32_t font, int page) const;
+
+	int GetSpread() const { return m_spread; }
+
+private:
+	struct Pending
+	{
+		uint32_t font;
+		uint32_t codepoint;
+
+		int w, h;
+		std::vector<uint8_t> coverage;
+		std::vector<uint8_t> sdf;
+	};
+
+	TextureAtlas* FetchAtlas(uint32_t font);
+
+private:
+	RenderContext* m_rc;
+
+	int m_page_size;
+	int m_spread;
+	int m_max_pages;
+
+	std::unordered_map<uint32_t, std::unique_ptr<TextureAtlas>> m_atlases;
+
+	std::vector<Pending> m_pending;
+
+}; // GlyphCache
+
+}
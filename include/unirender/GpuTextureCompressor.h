@@ -0,0 +1,53 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// Compute shader DXT1/DXT5 encoder. Render targets and other textures
+// produced on the gpu are compressed into a buffer and copied into the
+// compressed texture from there, without a round trip through the cpu.
+class GpuTextureCompressor : private cu::Uncopyable
+{
+public:
+	GpuTextureCompressor(RenderContext* rc);
+	~GpuTextureCompressor();
+
+	// compute shaders and sampling fmt, DXT1 or DXT5
+	static bool IsSupported(const RenderContext& rc, TEXTURE_FORMAT fmt);
+
+	// the width * height corner of level 0 of src, into a new texture of fmt; 0 on
+	// failure, release the result with RenderContext::ReleaseTexture
+	int Compress(int src, int width, int height, TEXTURE_FORMAT fmt,
+		TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR);
+
+	// into dst, created with the same size and fmt
+	bool Compress(int src, int width, int height, TEXTURE_FORMAT fmt, int dst);
+
+private:
+	int  FetchShader(TEXTURE_FORMAT fmt);
+	bool PrepareBuffer(size_t size);
+
+	void Encode(int shader, int src, int width, int height);
+
+private:
+	RenderContext* m_rc;
+
+	// dxt1, dxt5
+	int m_shaders[2];
+
+	// output blocks, grown on demand
+	uint32_t m_buf = 0;
+	size_t   m_buf_size = 0;
+
+}; // GpuTextureCompressor
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cu/uncopyable.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <stdint.h>
+
+namespace ur
+{
+
+class RenderContext;
+class Shader;
+
+// Image based lighting maps from an environment cube, rendered on the gpu:
+// a cosine convolved irradiance cube and a GGX specular cube whose level l
+// holds roughness l / (levels - 1). Both sample a mipmapped copy of the
+// source at a level matched to each sample's solid angle, so a few hundred
+// samples per texel are enough. The results are read back without waiting
+// and cached on disk by Update, keyed by the source, the next load only
+// uploads them.
+class IBLPrefilter : private cu::Uncopyable
+{
+public:
+	// cache_dir: directory for prefiltered results, empty to disable
+	IBLPrefilter(RenderContext* rc, const std::string& cache_dir = "");
+	~IBLPrefilter();
+
+	void SetCacheDir(const std::string& dir) { m_cache_dir = dir; }
+
+	// src is a cube of src_size, key identifies its contents, e.g.
+	// Utility::HashBytes of the file it was loaded from. irradiance and
+	// specular are new RGBA16F cubes, release them with
+	// RenderContext::ReleaseTexture
+	bool Prefilter(int src, int src_size, uint64_t key, int& irradiance, int& specular,
+		int irradiance_size = 32, int specular_size = 128, int specular_levels = 5);
+
+	// store the results whose readbacks have finished into the cache,
+	// call once per frame; wait for all of them, e.g. before exit
+	void Update(bool wait = false);
+
+private:
+	enum Pass
+	{
+		PASS_COPY = 0,
+		PASS_IRRADIANCE,
+		PASS_SPECULAR,
+
+		PASS_COUNT
+	};
+
+	bool FetchShaders();
+
+	// the six faces of level of dst, with readbacks queued into tickets
+	// if not null
+	void RenderFaces(Pass pass, int src, int src_size, int dst, int size, int level,
+		float param, std::vector<int>* tickets);
+
+	// sizes: irradiance size, specular size and levels
+	bool Upload(const std::vector<float>& data, const uint32_t sizes[3],
+		int& irradiance, int& specular) const;
+
+	std::string CachePath(uint64_t key) const;
+	bool LoadCache(uint64_t key, const uint32_t sizes[3], std::vector<float>& data) const;
+	void StoreCache(uint64_t key, const uint32_t sizes[3], const std::vector<float>& data) const;
+
+	struct PendingStore
+	{
+		uint64_t key;
+		uint32_t sizes[3];
+
+		// six faces of irradiance, then of each specular level
+		std::vector<int> tickets;
+	};
+
+	// false if not ready and not waiting, the tickets are released otherwise
+	bool TryStore(PendingStore& store, bool wait);
+
+private:
+	RenderContext* m_rc;
+
+	std::string m_cache_dir;
+
+	std::unique_ptr<Shader> m_shaders[PASS_COUNT];
+	bool m_shaders_failed = false;
+
+	std::vector<PendingStore> m_pending;
+
+}; // IBLPrefilter
+
+}
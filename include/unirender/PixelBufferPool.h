@@ -0,0 +1,52 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <vector>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// One pixel unpack buffer split into slots used as a ring. A slot is mapped
+// unsynchronized and guarded by a fence after its upload, so streaming every
+// frame does not wait for the gpu to finish reading the previous data.
+class PixelBufferPool : private cu::Uncopyable
+{
+public:
+	PixelBufferPool(RenderContext* rc, size_t width, size_t height,
+		TEXTURE_FORMAT format, int count = 3);
+	~PixelBufferPool();
+
+	// room for width * height pixels, nullptr if every slot is still in
+	// flight and wait is false
+	uint8_t* Acquire(bool wait = true);
+
+	// data is tightly packed by the region width
+	void Upload(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t tex_id);
+
+	size_t GetSlotSize() const { return m_slot_size; }
+
+private:
+	RenderContext* m_rc;
+
+	uint32_t m_buf_id = 0;
+
+	size_t m_slot_size = 0;
+
+	std::vector<uint64_t> m_fences;
+	// fenced or never used
+	std::vector<bool>     m_unsync;
+
+	int m_curr = 0;
+	bool m_mapped = false;
+
+}; // PixelBufferPool
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ur
+{
+
+// Converts pixels between the client layouts the upload path reads for
+// the uncompressed TEXTURE_FORMATs. The 16F formats are uploaded as
+// GL_FLOAT, so their pixels are 32-bit floats here too; the half kernels
+// are for callers packing their own half data.
+class PixelConvert
+{
+public:
+	enum Op
+	{
+		OP_NONE           = 0,
+		OP_SRGB_TO_LINEAR = 0x1,	// rgb only, before premultiplying
+		OP_PREMULTIPLY    = 0x2,
+	};
+
+	struct BenchResult
+	{
+		const char* kernel;
+		float mpix_per_sec;
+	};
+
+public:
+	// bytes per pixel as uploaded, 0 if the format can't be converted
+	static int PixelSize(TEXTURE_FORMAT fmt);
+	static bool IsSupported(TEXTURE_FORMAT src, TEXTURE_FORMAT dst);
+
+	// src and dst must not overlap, unless they are the same pointer and
+	// both formats have the same pixel size
+	static bool Convert(const void* src, TEXTURE_FORMAT src_fmt, void* dst,
+		TEXTURE_FORMAT dst_fmt, size_t count, uint32_t ops = OP_NONE);
+
+	// Upload time transform, returns src itself if there is nothing to do,
+	// otherwise the converted pixels, valid until the next call.
+	const void* Prepare(const void* src, TEXTURE_FORMAT src_fmt, TEXTURE_FORMAT dst_fmt,
+		int width, int height, uint32_t ops = OP_NONE);
+
+	// kernels, counts are in pixels unless noted
+	static void SwizzleRB(const uint8_t* src, uint8_t* dst, size_t count);
+	static void PadRGB(const uint8_t* src, uint8_t* dst, size_t count, bool swap_rb);
+	static void PackRGBA4(const uint8_t* src, uint16_t* dst, size_t count);
+	static void PackRGB565(const uint8_t* src, uint16_t* dst, size_t count);
+	static void Premultiply(const uint8_t* src, uint8_t* dst, size_t count);
+	static void SrgbToLinear(const uint8_t* src, uint8_t* dst, size_t count);
+	// counts in components
+	static void UnormToFloat(const uint8_t* src, float* dst, size_t count);
+	static void FloatToHalf(const float* src, uint16_t* dst, size_t count);
+	static void HalfToFloat(const uint16_t* src, float* dst, size_t count);
+
+	// "avx2", "sse2", "neon" or "scalar"
+	static const char* Target();
+
+	// throughput of each kernel over count pixels, best of rounds
+	static std::vector<BenchResult> Benchmark(size_t count = 1 << 20, int rounds = 8);
+
+private:
+	std::vector<uint8_t> m_scratch;
+
+}; // PixelConvert
+
+}
@@ -7,6 +7,9 @@
 #include <cu/cu_stl.h>
 
 #include <vector>
+#include <string>
+#include <functional>
+#include <map>
 
 namespace ur
 {
@@ -29,6 +32,23 @@ public:
 		std::vector<VertexAttrib> va_list;
 	};
 
+	struct ResourceInfo
+	{
+		RENDER_OBJ type = INVALID;
+		int        id = 0;
+		size_t     size = 0;
+
+		// textures only
+		int width = 0, height = 0, depth = 0;
+		int format = TEXTURE_INVALID;
+
+		int create_frame = -1;
+		int last_frame = -1;	// -1 if not tracked
+
+		std::string label;
+		std::string owner;
+	};
+
     enum VertLayout
     {
         VL_POS = 0,
@@ -44,6 +64,15 @@ public:
 
 	virtual int RenderVersion() const = 0;
 
+	/************************************************************************/
+	/* Capability                                                           */
+	/************************************************************************/
+
+	virtual int  GetCapability(CAPABILITY cap) const = 0;
+	virtual bool IsSupportTextureFormat(TEXTURE_FORMAT format) const = 0;
+	virtual bool IsSupportExtension(const char* name) const = 0;
+	virtual const std::string& GetDriverInfo() const = 0;
+
 	/************************************************************************/
 	/* Texture                                                              */
 	/************************************************************************/
@@ -51,7 +80,13 @@ public:
 	virtual int  CreateTexture(const void* pixels, int width, int height, int format,
         int mipmap_levels = 0, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR) = 0;
 	virtual int  CreateTexture3D(const void* pixels, int width, int height, int depth, int format) = 0;
-    virtual int  CreateTextureCube(int width, int height, int mipmap_levels = 0) = 0;
+    // faces are allocated empty, upload each face and level with
+    // UpdateTexture(slice = face); levels are generated after face 5 unless
+    // levels above 0 were uploaded first
+    virtual int  CreateTextureCube(int width, int height, int mipmap_levels = 0, int format = TEXTURE_RGB16F) = 0;
+	// pixels hold all layers, update one with UpdateSubTexture(slice = layer)
+	virtual int  CreateTexture2DArray(const void* pixels, int width, int height, int layers, int format,
+		int mipmap_levels = 0, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR) = 0;
 	virtual int  CreateTextureID(int width, int height, int format, int mipmap_levels = 0) = 0;
 	virtual void ReleaseTexture(int id) = 0;
 
@@ -59,6 +94,24 @@ public:
         int miplevel = 0, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR) = 0;
 	virtual void UpdateTexture3d(int tex_id, const void* pixels, int width, int height, int depth) = 0;
 	virtual void UpdateSubTexture(const void* pixels, int x, int y, int w, int h, unsigned int id, int slice = 0, int miplevel = 0) = 0;
+	// a box of a 3d texture, or layers [z, z + d) of an array
+	virtual void UpdateSubTexture3D(const void* pixels, int x, int y, int z, int w, int h, int d, unsigned int id, int miplevel = 0) = 0;
+	// zero the texture on the gpu
+	virtual void ClearTexture(int id) = 0;
+	// sample only levels [base, max], levels below base are freed; the
+	// levels are then uploaded one by one with UpdateTexture
+	virtual void SetTextureLodRange(int id, int base, int max) = 0;
+	// rebuild the other levels from level 0, e.g. after rendering into it
+	virtual void GenerateTextureMipmap(int id) = 0;
+	// image is caller owned, the texture's size and alive until flushed;
+	// marked regions are merged and uploaded before the texture is next
+	// bound or drawn with; false for compressed and depth textures, which
+	// are not updated by rows
+	virtual bool MarkTextureDirty(int id, const void* image, int x, int y, int w, int h) = 0;
+	virtual void FlushDirtyTextures() = 0;
+	// ETC and DXT data the device can't sample is transcoded on upload, the
+	// results are kept in dir to skip the work next time, empty to disable
+	virtual void SetTranscodeCacheDir(const std::string& dir) = 0;
 
 	virtual void BindTexture(int id, int channel) = 0;
     virtual const std::vector<int>& GetBindedTextures() const = 0;
@@ -83,6 +136,8 @@ public:
     // attach texture
     virtual void BindRenderTargetTex(int tex, ATTACHMENT_TYPE attachment = ATTACHMENT_COLOR0,
         TEXTURE_TARGET textarget = TEXTURE2D, int level = 0) = 0;
+    virtual void BindRenderTargetTexLayer(int tex, int layer, ATTACHMENT_TYPE attachment = ATTACHMENT_COLOR0,
+        int level = 0) = 0;
     virtual void SetColorBufferList(const std::vector<ATTACHMENT_TYPE>& list) = 0;
 
     // attach framebuffer
@@ -107,8 +162,30 @@ public:
 	virtual void UnbindPixelBuffer() = 0;
 
 	virtual void* MapPixelBuffer(ACCESS_MODE mode) = 0;
+	// write only, the range is invalidated; unsynchronized skips the wait
+	// for the gpu, reuse of the range must then be guarded by a fence
+	virtual void* MapPixelBufferRange(size_t offset, size_t size, bool unsynchronized) = 0;
 	virtual void  UnmapPixelBuffer() = 0;
 
+	// copy a region of the read framebuffer into a pack buffer without
+	// waiting for the gpu, return a ticket or 0 if the format is not
+	// supported; RGBA8, RED, R16 and DEPTH, float formats read as float
+	virtual int  ReadPixelsAsync(int x, int y, int w, int h, TEXTURE_FORMAT format) = 0;
+	virtual bool IsReadbackReady(int ticket) const = 0;
+	// nullptr if not ready and not waiting, valid until released
+	virtual const void* MapReadback(int ticket, bool wait = true) = 0;
+	virtual void ReleaseReadback(int ticket) = 0;
+
+	/************************************************************************/
+	/* Fence                                                                */
+	/************************************************************************/
+
+	// 0 if not supported
+	virtual uint64_t CreateFence() = 0;
+	virtual void ReleaseFence(uint64_t fence) = 0;
+	virtual bool IsFenceSignaled(uint64_t fence) const = 0;
+	virtual void WaitFence(uint64_t fence) = 0;
+
 	/************************************************************************/
 	/* Shader                                                               */
 	/************************************************************************/
@@ -220,15 +297,63 @@ public:
     virtual uint32_t CreateComputeBuffer(const std::vector<int>& buf, size_t index) const = 0;
     virtual uint32_t CreateComputeBuffer(const std::vector<float>& buf, size_t index) const = 0;
     virtual void     ReleaseComputeBuffer(uint32_t id) const = 0;
+    // rebind a buffer created above to another or the same index
+    virtual void     BindComputeBuffer(uint32_t id, size_t index) const = 0;
+    // the results are visible to shaders and pixel buffer transfers
     virtual void DispatchCompute(int thread_group_count) const =  0;
     virtual void GetComputeBufferData(uint32_t id, std::vector<int>& result) const = 0;
 
+	/************************************************************************/
+	/* Memory                                                               */
+	/************************************************************************/
+
+	// bytes allocated through this context, MEMORY_COUNT for the sum
+	virtual size_t GetMemoryUsage(MEMORY_TYPE type = MEMORY_COUNT) const = 0;
+	// in bytes, false if the driver exposes no memory info
+	virtual bool QueryDeviceMemory(size_t& total, size_t& available) const = 0;
+
+	virtual bool CheckAvailableMemory(int need_texture_area) const = 0;
+
+	// Over budget, the least recently bound textures that have a reloader are
+	// evicted. Their ids stay valid and they are reloaded on the next bind.
+	// 0 for no budget.
+	virtual void   SetTextureBudget(size_t bytes) = 0;
+	virtual size_t GetTextureBudget() const = 0;
+	// reload should upload the pixels again through UpdateTexture. Each
+	// owner of a shared id keeps its own reloader. A null reload removes
+	// owner's one, reloading the texture first if it was evicted.
+	virtual void SetTextureReloader(int id, std::function<void(int id)> reload, const void* owner = nullptr) = 0;
+	// remove owner's reloader without reloading, before releasing the id
+	virtual void RemoveTextureReloader(int id, const void* owner = nullptr) = 0;
+	virtual bool IsTextureResident(int id) const = 0;
+
+	// CreateTexture calls with identical pixels and settings return one
+	// refcounted texture, each ReleaseTexture drops a reference. Updating
+	// a shared texture changes it for all of its owners.
+	// Released 2D textures are kept up to bytes, and reused by CreateTexture
+	// with the same size, format and mipmap levels. 0 disables the pool.
+	virtual void SetTexturePoolSize(size_t bytes) = 0;
+
+	// the pixels of each shared texture are kept to confirm hash matches
+	virtual void   EnableTextureDedup(bool enable) = 0;
+	virtual size_t GetTextureDedupSaved() const = 0;
+	// true if more than one CreateTexture got this id
+	virtual bool   IsTextureShared(int id) const = 0;
+
 	/************************************************************************/
 	/* Debug                                                                */
 	/************************************************************************/
 
 	virtual int  GetRealTexID(int id) = 0;
 
+	// label is also passed to glObjectLabel when the driver supports it
+	virtual void SetResourceLabel(RENDER_OBJ what, int id, const std::string& label,
+		const std::string& owner = "") = 0;
+	// all live objects created through this context
+	virtual void QueryResources(std::vector<ResourceInfo>& resources) const = 0;
+	// bytes per owner, unowned objects under ""
+	virtual void QueryOwnerMemory(std::map<std::string, size_t>& owners) const = 0;
+
 	/************************************************************************/
 	/* Other                                                                */
 	/************************************************************************/
@@ -237,11 +362,12 @@ public:
 	virtual void ReadPixels(const unsigned char* pixels, int channels, int x, int y, int w, int h) = 0;
     virtual void ReadPixels(const short* pixels, int channels, int x, int y, int w, int h) = 0;
 
-	virtual bool CheckAvailableMemory(int need_texture_area) const = 0;
-
 	virtual void EnableFlushCB(bool enable) = 0;
 	virtual void CallFlushCB() = 0;
 
+	virtual void EndFrame() = 0;
+	virtual int  GetCurrFrame() const = 0;
+
 	static bool IsSupportETC2() { return m_etc2; }
 	static void SetSupportETC2(bool support) { m_etc2 = support; }
 
@@ -2,10 +2,14 @@
 #define _UNIRENDER_TEXTURE_H_
 
 #include "unirender/typedef.h"
+#include "unirender/TextureCompressor.h"
 
 #include <cu/uncopyable.h>
 
 #include <memory>
+#include <vector>
+
+#include <stdint.h>
 
 namespace ur
 {
@@ -22,6 +26,18 @@ public:
 
 	void Upload(RenderContext* rc, int width, int height, TEXTURE_FORMAT format = TEXTURE_RGBA8,
 		const void* filling = nullptr, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR);
+	// filling is in src_format, converted to format with PixelConvert ops
+	void Upload(RenderContext* rc, int width, int height, TEXTURE_FORMAT format, const void* filling,
+		TEXTURE_FORMAT src_format, uint32_t ops = 0, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR);
+	// Block compresses rgba8 to the best format the context supports, or
+	// uploads it as is when none is, or the size isn't in whole blocks.
+	void UploadCompressed(RenderContext* rc, int width, int height, const void* rgba, bool alpha = true,
+		TextureCompressor::Preset preset = TextureCompressor::PRESET_FAST, TEXTURE_WRAP wrap = TEXTURE_REPEAT,
+		TEXTURE_FILTER filter = TEXTURE_LINEAR);
+
+	// Keep a cpu copy of the next uploads, so the texture can be evicted
+	// under the context's texture budget and reloaded transparently.
+	void RetainSource(bool retain);
 
 	int Width() const { return m_width; }
 	int Height() const { return m_height; }
@@ -38,6 +54,11 @@ protected:
 
 	unsigned int m_texid = 0;
 
+	bool m_retain_source = false;
+	std::vector<uint8_t> m_source;
+	TEXTURE_WRAP   m_wrap   = TEXTURE_REPEAT;
+	TEXTURE_FILTER m_filter = TEXTURE_LINEAR;
+
 }; // Texture
 
 using TexturePtr = std::shared_ptr<Texture>;
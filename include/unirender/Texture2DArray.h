@@ -0,0 +1,51 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <memory>
+
+namespace ur
+{
+
+class RenderContext;
+
+class Texture2DArray : private cu::Uncopyable
+{
+public:
+	Texture2DArray();
+	Texture2DArray(RenderContext* rc, int width, int height, int layers,
+		TEXTURE_FORMAT format, unsigned int texid);
+	~Texture2DArray();
+
+	// filling holds all layers, one after another
+	void Upload(RenderContext* rc, int width, int height, int layers, TEXTURE_FORMAT format = TEXTURE_RGBA8,
+		const void* filling = nullptr, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR);
+
+	void UploadLayer(int layer, const void* pixels);
+	void UpdateLayer(int layer, const void* pixels, int x, int y, int w, int h);
+
+	int Width() const { return m_width; }
+	int Height() const { return m_height; }
+	int Layers() const { return m_layers; }
+
+	auto Format() const { return m_format; }
+
+	unsigned int TexID() const { return m_texid; }
+
+protected:
+	RenderContext* m_rc = nullptr;
+
+	int m_width = 0;
+	int m_height = 0;
+	int m_layers = 0;
+	TEXTURE_FORMAT m_format = TEXTURE_INVALID;
+
+	unsigned int m_texid = 0;
+
+}; // Texture2DArray
+
+using Texture2DArrayPtr = std::shared_ptr<Texture2DArray>;
+
+}
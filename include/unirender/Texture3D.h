@@ -4,6 +4,11 @@
 
 #include <cu/uncopyable.h>
 
+#include <functional>
+#include <string>
+
+#include <stddef.h>
+
 namespace ur
 {
 
@@ -17,9 +22,22 @@ public:
 		TEXTURE_FORMAT format, unsigned int texid);
 	~Texture3D();
 
+	// without filling the volume is cleared on the gpu, then it can be
+	// streamed in with UploadSlices() or Stream()
 	void Upload(RenderContext* rc, int width, int height, int depth, TEXTURE_FORMAT format = TEXTURE_RGBA8,
 		const unsigned char* filling = nullptr, bool filter_linear = true);
 
+	// Slices are tightly packed in the layout the upload reads, the 16F
+	// formats as floats like 2D textures. pixels hold count slices from z.
+	void UploadSlices(int z, int count, const void* pixels);
+	// fetch returns the count slices from z, e.g. from a callback's buffer
+	// or a mapped file, nullptr to stop; at most batch slices per call
+	bool Stream(const std::function<const void*(int z, int count)>& fetch, int batch = 16);
+	// the volume stored at offset, read batch slices at a time
+	bool StreamFile(const std::string& filepath, size_t offset = 0, int batch = 16);
+
+	size_t SliceSize() const;
+
 	int Width() const { return m_width; }
 	int Height() const { return m_height; }
 	int Depth() const { return m_depth; }
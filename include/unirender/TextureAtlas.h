@@ -0,0 +1,124 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ur
+{
+
+class RenderContext;
+class Texture;
+class PixelBuffer;
+
+// Packs small images into shared pages with a skyline packer. Insertions
+// are staged in a cpu copy of the page and uploaded together by Flush().
+// When the pages are full, pages with removed regions are repacked and the
+// least recently used regions are evicted.
+class TextureAtlas : private cu::Uncopyable
+{
+public:
+	struct Region
+	{
+		int page = -1;
+		int x = 0, y = 0, w = 0, h = 0;
+
+		// xmin, ymin, xmax, ymax
+		float uv[4] = { 0, 0, 0, 0 };
+	};
+
+public:
+	TextureAtlas(RenderContext* rc, int page_width, int page_height,
+		TEXTURE_FORMAT format = TEXTURE_RGBA8, int max_pages = 4, int padding = 1);
+	~TextureAtlas();
+
+	// pixels are w * h, tightly packed
+	bool Insert(uint64_t key, int w, int h, const void* pixels, Region* region = nullptr);
+	bool Query(uint64_t key, Region& region);
+	void Remove(uint64_t key);
+	void Clear();
+
+	// upload the staged regions, call once per frame before drawing
+	void Flush();
+
+	// repack the pages with removed regions, regions move
+	void Defragment();
+
+	size_t GetPageCount() const { return m_pages.size(); }
+	const Texture& GetPage(size_t idx) const;
+
+	// changed each time regions move or are evicted, cached uvs need a Query
+	uint32_t GetVersion() const { return m_version; }
+
+private:
+	struct Rect
+	{
+		int x, y, w, h;
+	};
+
+	struct SkylineNode
+	{
+		int x, y, w;
+	};
+
+	struct Entry
+	{
+		int page;
+		int x, y, w, h;
+		int last_frame;
+
+		std::list<uint64_t>::iterator lru;
+	};
+
+	struct Page
+	{
+		std::unique_ptr<Texture>     tex;
+		std::unique_ptr<PixelBuffer> pbuf;
+
+		std::vector<uint8_t> shadow;
+
+		std::vector<SkylineNode> skyline;
+		std::vector<Rect> dirty;
+
+		// area of removed regions, reclaimed by repacking
+		int freed = 0;
+	};
+
+	int  AddPage();
+	bool Pack(Page& page, int w, int h, int& x, int& y) const;
+	bool Allocate(int w, int h, int& page, int& x, int& y);
+	void Repack(int page);
+	bool EvictLRU(int& page);
+	void Touch(Entry& e);
+
+	void FillRegion(const Entry& e, Region& region) const;
+
+private:
+	RenderContext* m_rc;
+
+	int m_page_width, m_page_height;
+	TEXTURE_FORMAT m_format;
+	int m_max_pages;
+	int m_padding;
+
+	int m_bpp;
+
+	std::vector<std::unique_ptr<Page>> m_pages;
+
+	std::unordered_map<uint64_t, Entry> m_entries;
+	// keys from the least to the most recently used
+	std::list<uint64_t> m_lru;
+
+	uint32_t m_version = 0;
+
+}; // TextureAtlas
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// Block encoder for textures generated at runtime, rgba8 in, 4x4 blocks
+// out. Sides that are not multiples of 4 are padded by clamping to the
+// edge. Block rows are spread over worker threads.
+class TextureCompressor
+{
+public:
+	enum Preset
+	{
+		PRESET_FAST = 0,
+		// refined endpoints and wider searches, several times slower
+		PRESET_QUALITY,
+	};
+
+public:
+	// ETC1, ETC2 (rgba8 with eac alpha), DXT1, DXT3 and DXT5
+	static bool IsSupported(TEXTURE_FORMAT fmt);
+
+	// the smallest encodable format the context can sample, TEXTURE_INVALID if none
+	static TEXTURE_FORMAT ChooseFormat(const RenderContext& rc, bool alpha);
+
+	static size_t CompressedSize(TEXTURE_FORMAT fmt, int width, int height);
+
+	// threads 0 uses every core
+	static bool Compress(const uint8_t* rgba, int width, int height, TEXTURE_FORMAT fmt,
+		std::vector<uint8_t>& dst, Preset preset = PRESET_FAST, int threads = 0);
+
+}; // TextureCompressor
+
+}
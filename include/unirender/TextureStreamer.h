@@ -0,0 +1,80 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// Textures created with only their smallest levels resident. Larger levels
+// are loaded from the source and uploaded over the next frames in order of
+// the screen size the caller reports, and dropped again when not needed.
+class TextureStreamer : private cu::Uncopyable
+{
+public:
+	// fill pixels with the level, false if it can't be loaded now
+	using Loader = std::function<bool(int level, std::vector<uint8_t>& pixels)>;
+
+public:
+	TextureStreamer(RenderContext* rc, size_t frame_bytes = 4 * 1024 * 1024);
+	~TextureStreamer();
+
+	int  CreateTexture(int width, int height, TEXTURE_FORMAT format, int mipmap_levels,
+		int resident_levels, const Loader& loader, TEXTURE_WRAP wrap = TEXTURE_REPEAT,
+		TEXTURE_FILTER filter = TEXTURE_LINEAR);
+	void ReleaseTexture(int id);
+
+	// the largest side on screen in pixels, 0 if not visible
+	void SetScreenSize(int id, float pixels);
+
+	// stream under the byte budget, call once per frame
+	void Update();
+
+	void SetFrameBudget(size_t bytes) { m_frame_bytes = bytes; }
+
+	// the largest resident level, -1 if unknown
+	int GetBaseLevel(int id) const;
+
+private:
+	struct Entry
+	{
+		int width, height;
+		TEXTURE_FORMAT format;
+		int levels;
+		int min_resident;
+
+		TEXTURE_WRAP   wrap;
+		TEXTURE_FILTER filter;
+
+		Loader loader;
+
+		int   base;
+		float screen_size = 0;
+	};
+
+	int CalcWantedBase(const Entry& e) const;
+
+	bool LoadLevel(int id, Entry& e, int level, size_t& bytes);
+
+private:
+	RenderContext* m_rc;
+
+	size_t m_frame_bytes;
+
+	std::unordered_map<int, Entry> m_textures;
+
+	std::vector<uint8_t> m_buf;
+
+}; // TextureStreamer
+
+}
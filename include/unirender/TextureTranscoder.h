@@ -0,0 +1,59 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// Decodes compressed data the device can't sample and re-encodes it to a
+// format it can with TextureCompressor, or leaves it as rgba8. Results are
+// cached on disk keyed by the content and the driver, so each device pays
+// for a texture once.
+class TextureTranscoder : private cu::Uncopyable
+{
+public:
+	// cache_dir: directory for transcoded results, empty to disable
+	TextureTranscoder(const std::string& driver, const std::string& cache_dir = "");
+
+	void SetCacheDir(const std::string& dir) { m_cache_dir = dir; }
+
+	// ETC1, ETC2 (including the T, H and planar modes) and DXT1/3/5
+	static bool IsDecodable(TEXTURE_FORMAT fmt);
+
+	// what src is transcoded to on this context, rgba8 if nothing else fits
+	static TEXTURE_FORMAT ChooseTarget(const RenderContext& rc, TEXTURE_FORMAT src);
+
+	// width * height rgba8 out, threads 0 uses every core
+	static bool Decode(const uint8_t* blocks, int width, int height, TEXTURE_FORMAT fmt,
+		std::vector<uint8_t>& rgba, int threads = 0);
+
+	// dst is rgba8 or a format TextureCompressor encodes
+	bool Transcode(const void* data, int width, int height, TEXTURE_FORMAT src,
+		TEXTURE_FORMAT dst, std::vector<uint8_t>& out);
+
+private:
+	std::string CachePath(uint64_t key) const;
+
+	bool LoadCache(uint64_t key, int width, int height, TEXTURE_FORMAT src,
+		TEXTURE_FORMAT dst, std::vector<uint8_t>& out) const;
+	void StoreCache(uint64_t key, int width, int height, TEXTURE_FORMAT src,
+		TEXTURE_FORMAT dst, const std::vector<uint8_t>& data) const;
+
+private:
+	uint64_t m_driver_hash;
+
+	std::string m_cache_dir;
+
+}; // TextureTranscoder
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <vector>
+#include <unordered_map>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// Spreads texture and buffer uploads over frames. Queued data is copied and
+// uploaded by Update() in priority order under a per-frame byte and time
+// budget, large levels and buffers in bands of rows or bytes.
+class UploadScheduler : private cu::Uncopyable
+{
+public:
+	struct Stats
+	{
+		size_t queued_jobs  = 0;
+		size_t queued_bytes = 0;
+
+		// by the last Update()
+		size_t uploaded_bytes = 0;
+		float  upload_ms      = 0;
+
+		// frames from queue to the last band, of finished jobs
+		float  avg_latency = 0;
+		int    max_latency = 0;
+	};
+
+public:
+	UploadScheduler(RenderContext* rc, size_t frame_bytes = 4 * 1024 * 1024, float frame_ms = 0);
+
+	// ms 0 for no time limit, cpu time spent submitting
+	void SetFrameBudget(size_t bytes, float ms = 0);
+
+	// the storage of every level is allocated now, data arrives later from
+	// the smallest level up; the texture is ready once its last
+	// required_levels levels are in, -1 for all
+	void QueueTexture(int tex_id, int width, int height, TEXTURE_FORMAT format,
+		const std::vector<const void*>& levels, int priority = 0, int required_levels = -1,
+		TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR);
+	// id is a gl buffer with its storage, as for UpdateBufferRaw()
+	void QueueBuffer(BUFFER_TYPE type, int id, const void* data, int size, int priority = 0);
+
+	// drop the pending uploads, before releasing the object
+	void CancelTexture(int tex_id);
+	void CancelBuffer(BUFFER_TYPE type, int id);
+
+	// call once per frame
+	void Update();
+
+	// false while its required levels are pending
+	bool IsTextureReady(int tex_id) const;
+
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	enum JobType
+	{
+		JOB_TEXTURE = 0,
+		JOB_VERTEX_BUFFER,
+		JOB_INDEX_BUFFER,
+	};
+
+	struct Job
+	{
+		JobType  type;
+		int      id;
+		int      priority;
+		uint64_t seq;
+
+		// texture level
+		int level = 0;
+		int width = 0, height = 0;
+		TEXTURE_FORMAT format = TEXTURE_INVALID;
+		bool required = false;
+
+		std::vector<uint8_t> data;
+
+		// rows for textures, bytes for buffers
+		int done = 0;
+
+		int queue_frame = 0;
+	};
+
+	void Push(Job&& job);
+
+	// upload at most bytes, return the bytes uploaded, the job is
+	// finished when its done reaches the end
+	size_t Step(Job& job, size_t bytes);
+	bool   IsFinished(const Job& job) const;
+
+	void Finish(const Job& job);
+
+private:
+	RenderContext* m_rc;
+
+	size_t m_frame_bytes;
+	float  m_frame_ms;
+
+	// sorted by priority, then queue order
+	std::vector<Job> m_jobs;
+	uint64_t m_next_seq = 0;
+
+	// pending required levels
+	std::unordered_map<int, int> m_tex_pending;
+
+	Stats m_stats;
+	size_t m_finished = 0;
+
+}; // UploadScheduler
+
+}
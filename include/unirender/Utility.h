@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 namespace ur
 {
 
@@ -7,6 +10,12 @@ class Utility
 {
 public:
 	static int CalcTextureSize(int format, int width, int height, int depth = 0);
+	// bytes read from client memory by an upload, the 16F formats are
+	// uploaded as floats
+	static size_t CalcClientSize(int format, int width, int height);
+
+	// xxHash64
+	static uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
 
 }; // Utility
 
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <stdint.h>
+
+namespace ur
+{
+
+class RenderContext;
+
+// Software virtual texturing for images larger than video memory or
+// GL_MAX_TEXTURE_SIZE. The image is cut into square pages at each mip
+// level. Only the pages in view are kept in a physical cache texture, and
+// an indirection texture maps each virtual page to its cache slot or to
+// its nearest resident parent. A low resolution feedback pass reports the
+// pages wanted, worker threads load them and Update() uploads them.
+//
+// The image lies in the top left of a square, power of two pages wide,
+// virtual space, the coarsest level is one page and always resident.
+class VirtualTexture : private cu::Uncopyable
+{
+public:
+	// Fill rgba with page x, y of level, (page_size + 2 * border) pixels
+	// square of rgba8, the border taken from the neighbours, clamped at the
+	// image edge. Pages may reach past the image. Called on worker threads.
+	using Loader = std::function<bool(int level, int x, int y, uint8_t* rgba)>;
+
+public:
+	// cache_side: cache texture side in pages, clamped to the max texture size
+	VirtualTexture(RenderContext* rc, int width, int height, const Loader& loader,
+		int page_size = 128, int border = 4, int cache_side = 16, int threads = 2);
+	~VirtualTexture();
+
+	// Read back w * h pixels of the bound feedback target, written with
+	// GetFeedbackGLSL(), without stalling; a later Update() consumes them.
+	void RequestFeedback(int x, int y, int w, int h);
+
+	// Take the ready feedback, queue the missing pages and upload up to
+	// max_uploads loaded ones, then the indirection if it changed. Once
+	// per frame.
+	void Update(int max_uploads = 8);
+
+	int GetCacheTexID() const { return m_cache_tex; }
+	int GetIndirectionTexID() const { return m_indirection_tex; }
+
+	int GetLevels() const { return m_levels; }
+	int GetResidentPages() const { return static_cast<int>(m_resident.size()); }
+
+	// u_vt_params and u_vt_cache for the glsl below
+	void GetShaderParams(float params[4], float cache[4]) const;
+
+	// vec4 vt_feedback(vec2 uv), the page to request for uv; u_vt_bias is
+	// log2 of how much smaller the feedback target is than the screen
+	static const char* GetFeedbackGLSL();
+	// vec4 vt_sample(vec2 uv), needs glsl 1.30 or es 3.0
+	static const char* GetSampleGLSL();
+
+private:
+	struct Slot
+	{
+		uint64_t key = 0;
+		uint32_t last_used = 0;
+		bool used = false;
+		bool locked = false;
+	};
+
+	struct Loaded
+	{
+		uint64_t key;
+		bool ok;
+		std::vector<uint8_t> pixels;
+	};
+
+	struct Feedback
+	{
+		int ticket;
+		int w, h;
+	};
+
+	void WorkerLoop();
+
+	bool LoadPage(uint64_t key, std::vector<uint8_t>& pixels) const;
+	bool StorePage(const Loaded& page);
+
+	void ParseFeedback(const uint8_t* pixels, int count, std::unordered_set<uint64_t>& wanted) const;
+	void QueueRequests(const std::unordered_set<uint64_t>& wanted);
+
+	void MarkIndirectionDirty(uint64_t key);
+	void UpdateIndirection();
+
+private:
+	RenderContext* m_rc;
+
+	int m_width, m_height;
+	Loader m_loader;
+
+	int m_page_size, m_border, m_slot_size;
+
+	// virtual space is 1 << (m_levels - 1) pages wide at level 0
+	int m_levels;
+
+	int m_cache_side;
+	int m_cache_tex = 0;
+	int m_indirection_tex = 0;
+
+	std::vector<Slot> m_slots;
+	// page key to slot
+	std::unordered_map<uint64_t, int> m_resident;
+
+	std::vector<std::vector<uint32_t>> m_indirection;
+	bool m_indirection_uploaded = false;
+	// changed region in level 0 pages, x0, y0, x1, y1
+	int m_dirty[4];
+
+	std::deque<Feedback> m_feedbacks;
+
+	uint32_t m_frame = 0;
+	// pages used since then are in view
+	uint32_t m_feedback_frame = 0;
+
+	// shared with the workers
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_stop = false;
+	std::deque<uint64_t> m_requests;
+	std::unordered_set<uint64_t> m_in_flight;
+	std::deque<Loaded> m_loaded;
+
+}; // VirtualTexture
+
+}
@@ -0,0 +1,73 @@
+#ifndef _UNIRENDER_GL_CAPABILITIES_H_
+#define _UNIRENDER_GL_CAPABILITIES_H_
+
+#include "unirender/typedef.h"
+
+#include <cu/uncopyable.h>
+
+#include <string>
+#include <set>
+
+#include <stdint.h>
+
+namespace ur
+{
+namespace gl
+{
+
+// Every query is probed on first use only. Results are persisted to a cache
+// file keyed by the driver string, so a known driver costs no gl probing.
+class Capabilities : private cu::Uncopyable
+{
+public:
+	Capabilities(const std::string& cache_filepath);
+	~Capabilities();
+
+	const std::string& GetDriverInfo() const { return m_driver; }
+
+	int  GetValue(CAPABILITY cap) const;
+	bool IsSupportFormat(TEXTURE_FORMAT format) const;
+	bool IsSupportExtension(const char* name) const;
+
+	// major * 10 + minor
+	int  GetVersion() const;
+
+	void Flush() const;
+
+private:
+	void LoadCache();
+	void StoreCache() const;
+
+	void LoadExtensions() const;
+
+	bool ProbeFormat(TEXTURE_FORMAT format) const;
+	bool ProbeETC2() const;
+	bool IsInCompressedFormats(int gl_format) const;
+
+	static bool CheckETC2SupportSlow();
+
+private:
+	static const int FORMAT_COUNT = TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT + 1;
+
+private:
+	std::string m_filepath;
+	std::string m_driver;
+
+	mutable int    m_version = -1;
+	mutable int    m_values[CAP_COUNT];
+	mutable int8_t m_formats[FORMAT_COUNT];
+
+	mutable bool m_ext_loaded = false;
+	mutable std::set<std::string> m_extensions;
+
+	mutable bool m_compressed_loaded = false;
+	mutable std::set<int> m_compressed_formats;
+
+	mutable bool m_dirty = false;
+
+}; // Capabilities
+
+}
+}
+
+#endif // _UNIRENDER_GL_CAPABILITIES_H_
@@ -2,8 +2,13 @@
 #define _UNIRENDER_GL_RENDER_CONTEXT_H_
 
 #include "unirender/RenderContext.h"
+#include "unirender/gl/Capabilities.h"
+#include "unirender/DirtyRects.h"
+#include "unirender/TextureTranscoder.h"
 
 #include <functional>
+#include <unordered_map>
+#include <list>
 
 struct render;
 
@@ -15,11 +20,22 @@ namespace gl
 class RenderContext : public ur::RenderContext
 {
 public:
-	RenderContext(int max_texture, std::function<void(ur::RenderContext&)> flush_shader);
+	// caps_cache: file to persist the probed capabilities, empty to disable
+	RenderContext(int max_texture, std::function<void(ur::RenderContext&)> flush_shader,
+		const std::string& caps_cache = "");
 	virtual ~RenderContext();
 
 	virtual int RenderVersion() const override final;
 
+	/************************************************************************/
+	/* Capability                                                           */
+	/************************************************************************/
+
+	virtual int  GetCapability(CAPABILITY cap) const override final;
+	virtual bool IsSupportTextureFormat(TEXTURE_FORMAT format) const override final;
+	virtual bool IsSupportExtension(const char* name) const override final;
+	virtual const std::string& GetDriverInfo() const override final;
+
 	/************************************************************************/
 	/* Texture                                                              */
 	/************************************************************************/
@@ -27,7 +43,9 @@ public:
 	virtual int  CreateTexture(const void* pixels, int width, int height, int format,
         int mipmap_levels = 0, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR) override final;
 	virtual int  CreateTexture3D(const void* pixels, int width, int height, int depth, int format) override final;
-    virtual int  CreateTextureCube(int width, int height, int mipmap_levels = 0) override final;
+    virtual int  CreateTextureCube(int width, int height, int mipmap_levels = 0, int format = TEXTURE_RGB16F) override final;
+	virtual int  CreateTexture2DArray(const void* pixels, int width, int height, int layers, int format,
+		int mipmap_levels = 0, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR) override final;
 	virtual int  CreateTextureID(int width, int height, int format, int mipmap_levels = 0) override final;
 	virtual void ReleaseTexture(int id) override final;
 
@@ -35,6 +53,13 @@ public:
         int miplevel = 0, TEXTURE_WRAP wrap = TEXTURE_REPEAT, TEXTURE_FILTER filter = TEXTURE_LINEAR) override final;
 	virtual void UpdateTexture3d(int tex_id, const void* pixels, int width, int height, int depth) override final;
 	virtual void UpdateSubTexture(const void* pixels, int x, int y, int w, int h, unsigned int id, int slice = 0, int miplevel = 0) override final;
+	virtual void UpdateSubTexture3D(const void* pixels, int x, int y, int z, int w, int h, int d, unsigned int id, int miplevel = 0) override final;
+	virtual void ClearTexture(int id) override final;
+	virtual void SetTextureLodRange(int id, int base, int max) override final;
+	virtual void GenerateTextureMipmap(int id) override final;
+	virtual bool MarkTextureDirty(int id, const void* image, int x, int y, int w, int h) override final;
+	virtual void FlushDirtyTextures() override final;
+	virtual void SetTranscodeCacheDir(const std::string& dir) override final;
 
 	virtual void BindTexture(int id, int channel) override final;
     virtual const std::vector<int>& GetBindedTextures() const override final { return m_textures; }
@@ -60,6 +85,8 @@ public:
     // attach texture
     virtual void BindRenderTargetTex(int tex, ATTACHMENT_TYPE attachment = ATTACHMENT_COLOR0,
         TEXTURE_TARGET textarget = TEXTURE2D, int level = 0) override final;
+    virtual void BindRenderTargetTexLayer(int tex, int layer, ATTACHMENT_TYPE attachment = ATTACHMENT_COLOR0,
+        int level = 0) override final;
     virtual void SetColorBufferList(const std::vector<ATTACHMENT_TYPE>& list) override final;
 
     // attach framebuffer
@@ -77,7 +104,6 @@ public:
 	/* PixelBuffer                                                          */
 	/************************************************************************/
 
-	// todo: GL_PIXEL_PACK_BUFFER
 
 	virtual int  CreatePixelBuffer(uint32_t id, int width, int height, int format) override final;
 	virtual void ReleasePixelBuffer(uint32_t id) override final;
@@ -86,8 +112,23 @@ public:
 	virtual void UnbindPixelBuffer() override final;
 
 	virtual void* MapPixelBuffer(ACCESS_MODE mode) override final;
+	virtual void* MapPixelBufferRange(size_t offset, size_t size, bool unsynchronized) override final;
 	virtual void  UnmapPixelBuffer() override final;
 
+	virtual int  ReadPixelsAsync(int x, int y, int w, int h, TEXTURE_FORMAT format) override final;
+	virtual bool IsReadbackReady(int ticket) const override final;
+	virtual const void* MapReadback(int ticket, bool wait = true) override final;
+	virtual void ReleaseReadback(int ticket) override final;
+
+	/************************************************************************/
+	/* Fence                                                                */
+	/************************************************************************/
+
+	virtual uint64_t CreateFence() override final;
+	virtual void ReleaseFence(uint64_t fence) override final;
+	virtual bool IsFenceSignaled(uint64_t fence) const override final;
+	virtual void WaitFence(uint64_t fence) override final;
+
 	/************************************************************************/
 	/* Shader                                                               */
 	/************************************************************************/
@@ -201,15 +242,42 @@ public:
     virtual uint32_t CreateComputeBuffer(const std::vector<int>& buf, size_t index) const override final;
     virtual uint32_t CreateComputeBuffer(const std::vector<float>& buf, size_t index) const override final;
     virtual void     ReleaseComputeBuffer(uint32_t id) const override final;
+    virtual void     BindComputeBuffer(uint32_t id, size_t index) const override final;
     virtual void DispatchCompute(int thread_group_count) const override final;
     virtual void GetComputeBufferData(uint32_t id, std::vector<int>& result) const override final;
 
+	/************************************************************************/
+	/* Memory                                                               */
+	/************************************************************************/
+
+	virtual size_t GetMemoryUsage(MEMORY_TYPE type = MEMORY_COUNT) const override final;
+	virtual bool QueryDeviceMemory(size_t& total, size_t& available) const override final;
+
+	virtual bool CheckAvailableMemory(int need_texture_area) const override final;
+
+	virtual void   SetTextureBudget(size_t bytes) override final;
+	virtual size_t GetTextureBudget() const override final { return m_tex_budget; }
+	virtual void SetTextureReloader(int id, std::function<void(int id)> reload, const void* owner = nullptr) override final;
+	virtual void RemoveTextureReloader(int id, const void* owner = nullptr) override final;
+	virtual bool IsTextureResident(int id) const override final;
+
+	virtual void SetTexturePoolSize(size_t bytes) override final;
+
+	virtual void   EnableTextureDedup(bool enable) override final { m_tex_dedup = enable; }
+	virtual size_t GetTextureDedupSaved() const override final { return m_tex_dedup_saved; }
+	virtual bool   IsTextureShared(int id) const override final;
+
 	/************************************************************************/
 	/* Debug                                                                */
 	/************************************************************************/
 
 	virtual int  GetRealTexID(int id) override final;
 
+	virtual void SetResourceLabel(RENDER_OBJ what, int id, const std::string& label,
+		const std::string& owner = "") override final;
+	virtual void QueryResources(std::vector<ResourceInfo>& resources) const override final;
+	virtual void QueryOwnerMemory(std::map<std::string, size_t>& owners) const override final;
+
 	/************************************************************************/
 	/* Other                                                                */
 	/************************************************************************/
@@ -218,27 +286,86 @@ public:
 	virtual void ReadPixels(const unsigned char* pixels, int channels, int x, int y, int w, int h) override final;
     virtual void ReadPixels(const short* pixels, int channels, int x, int y, int w, int h) override final;
 
-	virtual bool CheckAvailableMemory(int need_texture_area) const override final;
-
 	virtual void EnableFlushCB(bool enable) override final;
 	virtual void CallFlushCB() override final;
 
-private:
-	static bool CheckETC2Support();
-	static bool CheckETC2SupportFast();
-	static bool CheckETC2SupportSlow();
+	virtual void EndFrame() override final;
+	virtual int  GetCurrFrame() const override final { return m_frame; }
 
+private:
     template <typename T>
     void ReadPixelsImpl(const T* pixels, int channels, int x, int y, int w, int h, int type);
 
     template <typename T>
     uint32_t CreateComputeBufferImpl(const std::vector<T>& buf, size_t index) const;
 
+	void TrackBuffer(uint32_t id, MEMORY_TYPE type, size_t size) const;
+	void UntrackBuffer(uint32_t id) const;
+
+	void FillResourceLabel(ResourceInfo& info) const;
+	void EraseResourceLabel(RENDER_OBJ what, uint32_t id) const;
+
+	bool PoolTexture(int id);
+	int  AcquirePooledTexture(int width, int height, int format, int mipmap_levels);
+	void TrimTexturePool(size_t cap);
+	bool IsPooledTexture(int id) const;
+
+	// return false if id is still shared
+	bool ReleaseDedupTexture(int id);
+	void DetachDedupTexture(int id);
+
+	void FlushDirtyTexture(int id);
+	void FlushBoundDirtyTextures();
+
+	bool NeedTranscode(int format) const;
+	// pixels in src_format converted to dst_format, nullptr if they can't be.
+	// With an unpack buffer bound pixels is an offset into it, that range is
+	// read and the buffer unbound, the caller rebinds it after the upload
+	const void* TranscodePixels(const void* pixels, int width, int height, int src_format, int dst_format);
+
+	void EnforceTextureBudget();
+	void ReloadTexture(int id);
+	static void ReloadTextureCB(void* ud, unsigned int id);
+
 private:
 	static const int MAX_TEXTURE_CHANNEL = 8;
 	static const int MAX_RENDER_TARGET_LAYER = 8;
+	static const size_t MAX_FREE_READBACK = 4;
 
 private:
+	struct RawObject
+	{
+		MEMORY_TYPE mem = MEMORY_COUNT;
+		size_t      size = 0;
+		int         create_frame = -1;
+		int         last_frame = -1;
+	};
+
+	struct PooledTexture
+	{
+		int    id = 0;
+		int    width = 0, height = 0;
+		int    format = 0;
+		int    mipmap_levels = 0;
+		size_t size = 0;
+	};
+
+	struct DedupTexture
+	{
+		uint64_t key = 0;
+		int      refs = 0;
+		size_t   size = 0;
+		bool     attached = true;
+		// compared on a key hit, dropped once detached
+		std::vector<uint8_t> pixels;
+	};
+
+	struct ResourceLabel
+	{
+		std::string label;
+		std::string owner;
+	};
+
     struct VertBuf
     {
         ~VertBuf();
@@ -252,7 +379,10 @@ private:
 private:
 	render* m_render;
 
+	Capabilities m_caps;
+
 	int m_cb_enable = 0;
+	int m_frame = 0;
 	std::function<void(ur::RenderContext&)> m_flush_shader = nullptr;
 
 	/************************************************************************/
@@ -261,6 +391,18 @@ private:
 
 	std::vector<int> m_textures;
 
+	struct DirtyTexture
+	{
+		const uint8_t* image = nullptr;
+		DirtyRects     rects;
+	};
+	std::unordered_map<int, DirtyTexture> m_dirty_textures;
+
+	TextureTranscoder m_transcoder;
+	// id to the format the caller uploads in
+	std::unordered_map<int, TEXTURE_FORMAT> m_transcoded;
+	std::vector<uint8_t> m_transcode_buf;
+
 	/************************************************************************/
 	/* RenderTarget                                                         */
 	/************************************************************************/
@@ -276,6 +418,48 @@ private:
 
 	uint32_t m_pbo = 0;
 
+	struct Readback
+	{
+		uint32_t pbo = 0;
+		size_t   size = 0;
+		uint64_t fence = 0;
+		void*    mapped = nullptr;
+	};
+	std::unordered_map<int, Readback> m_readbacks;
+	int m_next_readback = 1;
+	// released pack buffers kept for the next readbacks
+	std::vector<std::pair<uint32_t, size_t>> m_readback_free;
+
+	bool m_fence_support = false;
+
+	/************************************************************************/
+	/* Memory                                                               */
+	/************************************************************************/
+
+	// gl objects created outside the render.c pools
+	mutable std::unordered_map<uint32_t, RawObject> m_raw_buffers;
+	std::unordered_map<uint32_t, RawObject> m_raw_rbos;
+	std::unordered_map<uint32_t, RawObject> m_raw_targets;
+	mutable size_t m_raw_memory[MEMORY_COUNT];
+
+	// key is RENDER_OBJ << 32 | id
+	mutable std::unordered_map<uint64_t, ResourceLabel> m_labels;
+
+	// most recently released first
+	std::list<PooledTexture> m_tex_pool;
+	size_t m_tex_pool_cap = 0;
+	size_t m_tex_pool_size = 0;
+
+	bool   m_tex_dedup = false;
+	size_t m_tex_dedup_saved = 0;
+	// content key to id, and id to entry
+	std::unordered_map<uint64_t, int> m_dedup_keys;
+	std::unordered_map<int, DedupTexture> m_dedup_textures;
+
+	size_t m_tex_budget = 0;
+	// owner and reloader, any of them restores the texture
+	std::unordered_map<int, std::vector<std::pair<const void*, std::function<void(int)>>>> m_tex_reloaders;
+
 	/************************************************************************/
 	/* State                                                                */
 	/************************************************************************/
@@ -39,7 +39,8 @@ uint32_t RenderContext::CreateComputeBufferImpl(const std::vector<T>& buf, size_
     GLuint data_buf;
     glGenBuffers(1, &data_buf);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, data_buf);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(buf), &buf.front(), GL_STREAM_COPY);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(T) * buf.size(), &buf.front(), GL_STREAM_COPY);
+    TrackBuffer(data_buf, MEMORY_BUFFER, sizeof(T) * buf.size());
     return data_buf;
 }
 
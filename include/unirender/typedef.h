@@ -23,12 +23,16 @@ enum RENDER_OBJ {
 	TEXTURE = 4,
 	TARGET = 5,
 	SHADER = 6,
+	// raw gl objects, outside render.c
+	RENDERBUFFER = 7,
+	PIXELBUFFER = 8,
 };
 
 enum TEXTURE_TYPE {
 	TEXTURE_2D = 0,
     TEXTURE_3D,
 	TEXTURE_CUBE,
+	TEXTURE_2D_ARRAY,
 };
 
 enum TEXTURE_FORMAT {
@@ -250,6 +254,34 @@ enum INTERNAL_FORMAT
     FMT_SRGB8_ALPHA8
 };
 
+enum CAPABILITY
+{
+    CAP_MAX_TEXTURE_SIZE = 0,
+    CAP_MAX_3D_TEXTURE_SIZE,
+    CAP_MAX_CUBE_MAP_TEXTURE_SIZE,
+    CAP_MAX_ARRAY_TEXTURE_LAYERS,
+    CAP_MAX_TEXTURE_IMAGE_UNITS,
+    CAP_MAX_COMBINED_TEXTURE_IMAGE_UNITS,
+    CAP_MAX_UNIFORM_BLOCK_SIZE,
+    CAP_MAX_UNIFORM_BUFFER_BINDINGS,
+    CAP_MAX_SHADER_STORAGE_BLOCK_SIZE,
+    CAP_MAX_SHADER_STORAGE_BUFFER_BINDINGS,
+    CAP_MAX_COLOR_ATTACHMENTS,
+
+    CAP_COUNT
+};
+
+enum MEMORY_TYPE
+{
+    MEMORY_TEXTURE = 0,
+    MEMORY_BUFFER,          // vertex, index and compute buffers
+    MEMORY_RENDERBUFFER,
+    MEMORY_PIXELBUFFER,
+    MEMORY_TEXTURE_POOL,    // released textures kept for reuse
+
+    MEMORY_COUNT
+};
+
 }
 
 #endif // _UNIRENDER_TYPEDEF_H_
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "unirender/ChannelPacker.h"
+#include "unirender/RenderContext.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CHANNEL_PACKER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CHANNEL_PACKER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace ur
+{
+
+ChannelPacker::ChannelPacker(RenderContext* rc, TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
+	: m_rc(rc)
+	, m_wrap(wrap)
+	, m_filter(filter)
+{
+}
+
+void ChannelPacker::Add(uint64_t key, const uint8_t* pixels, int width, int height, uint64_t group)
+{
+	if (!pixels || width <= 0 || height <= 0) {
+		return;
+	}
+
+	Remove(key);
+
+	Pending p;
+	p.key   = key;
+	p.group = group;
+	p.w     = width;
+	p.h     = height;
+	p.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height);
+	m_pending.push_back(std::move(p));
+}
+
+bool ChannelPacker::Query(uint64_t key, Slot& slot) const
+{
+	auto itr = m_slots.find(key);
+	if (itr == m_slots.end()) {
+		return false;
+	}
+	slot = itr->second;
+	return true;
+}
+
+void ChannelPacker::Remove(uint64_t key)
+{
+	m_slots.erase(key);
+
+	auto itr = std::find_if(m_pending.begin(), m_pending.end(),
+		[key](const Pending& p) { return p.key == key; });
+	if (itr != m_pending.end()) {
+		m_pending.erase(itr);
+	}
+}
+
+void ChannelPacker::Flush()
+{
+	if (m_pending.empty()) {
+		return;
+	}
+
+	// compatible sources next to each other, in the order they were added
+	std::stable_sort(m_pending.begin(), m_pending.end(), [](const Pending& a, const Pending& b) {
+		if (a.group != b.group) {
+			return a.group < b.group;
+		}
+		if (a.w != b.w) {
+			return a.w < b.w;
+		}
+		return a.h < b.h;
+	});
+
+	std::vector<uint8_t> rgba;
+	for (size_t i = 0; i < m_pending.size(); )
+	{
+		const auto& first = m_pending[i];
+		size_t n = 1;
+		while (n < 4 && i + n < m_pending.size() && m_pending[i + n].group == first.group
+			&& m_pending[i + n].w == first.w && m_pending[i + n].h == first.h) {
+			++n;
+		}
+
+		auto tex = std::make_shared<Texture>();
+		if (n == 1)
+		{
+			// nothing to share with, rgba8 would be four times the size
+			tex->Upload(m_rc, first.w, first.h, TEXTURE_RED, first.pixels.data(), m_wrap, m_filter);
+		}
+		else
+		{
+			const uint8_t* planes[4] = { nullptr, nullptr, nullptr, nullptr };
+			for (size_t c = 0; c < n; ++c) {
+				planes[c] = m_pending[i + c].pixels.data();
+			}
+			const size_t count = static_cast<size_t>(first.w) * first.h;
+			rgba.resize(count * 4);
+			Interleave(planes, count, rgba.data());
+			tex->Upload(m_rc, first.w, first.h, TEXTURE_RGBA8, rgba.data(), m_wrap, m_filter);
+		}
+
+		for (size_t c = 0; c < n; ++c)
+		{
+			Slot slot;
+			slot.tex     = tex;
+			slot.channel = static_cast<int>(c);
+			m_slots[m_pending[i + c].key] = slot;
+		}
+
+		i += n;
+	}
+
+	m_pending.clear();
+}
+
+void ChannelPacker::Interleave(const uint8_t* const planes[4], size_t count, uint8_t* rgba, uint8_t fill)
+{
+	size_t i = 0;
+#if defined(CHANNEL_PACKER_SSE2)
+	const __m128i f = _mm_set1_epi8(static_cast<char>(fill));
+	auto load = [&](int c) {
+		return planes[c] ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[c] + i)) : f;
+	};
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i r = load(0), g = load(1), b = load(2), a = load(3);
+		const __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+		const __m128i ba_lo = _mm_unpacklo_epi8(b, a), ba_hi = _mm_unpackhi_epi8(b, a);
+		__m128i* dst = reinterpret_cast<__m128i*>(rgba + i * 4);
+		_mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+		_mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+		_mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+		_mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+	}
+#elif defined(CHANNEL_PACKER_NEON)
+	const uint8x16_t f = vdupq_n_u8(fill);
+	for (; i + 16 <= count; i += 16)
+	{
+		uint8x16x4_t v;
+		for (int c = 0; c < 4; ++c) {
+			v.val[c] = planes[c] ? vld1q_u8(planes[c] + i) : f;
+		}
+		vst4q_u8(rgba + i * 4, v);
+	}
+#endif
+	for (; i < count; ++i) {
+		for (int c = 0; c < 4; ++c) {
+			rgba[i * 4 + c] = planes[c] ? planes[c][i] : fill;
+		}
+	}
+}
+
+}
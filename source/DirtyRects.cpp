@@ -0,0 +1,83 @@
+#include "unirender/DirtyRects.h"
+
+#include <algorithm>
+
+#include <limits.h>
+
+namespace ur
+{
+
+DirtyRects::DirtyRects(float waste, size_t max_rects)
+	: m_waste(waste)
+	, m_max_rects(std::max<size_t>(max_rects, 1))
+{
+}
+
+void DirtyRects::Add(int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0) {
+		return;
+	}
+
+	Rect r = { x, y, w, h };
+
+	// merging may make the rect reach others
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (size_t i = 0; i < m_rects.size(); ++i)
+		{
+			Rect bound;
+			int waste = CalcWaste(m_rects[i], r, bound);
+			if (waste <= m_waste * bound.w * bound.h)
+			{
+				r = bound;
+				m_rects.erase(m_rects.begin() + i);
+				merged = true;
+				break;
+			}
+		}
+	}
+	m_rects.push_back(r);
+
+	// over the limit, merge the cheapest pair
+	while (m_rects.size() > m_max_rects)
+	{
+		int best = INT_MAX;
+		size_t bi = 0, bj = 1;
+		Rect best_bound = m_rects[0];
+		for (size_t i = 0; i < m_rects.size(); ++i) {
+			for (size_t j = i + 1; j < m_rects.size(); ++j) {
+				Rect bound;
+				int waste = CalcWaste(m_rects[i], m_rects[j], bound);
+				if (waste < best) {
+					best = waste;
+					bi = i;
+					bj = j;
+					best_bound = bound;
+				}
+			}
+		}
+		m_rects.erase(m_rects.begin() + bj);
+		m_rects[bi] = best_bound;
+	}
+}
+
+int DirtyRects::CalcWaste(const Rect& a, const Rect& b, Rect& bound)
+{
+	int x0 = std::min(a.x, b.x), y0 = std::min(a.y, b.y);
+	int x1 = std::max(a.x + a.w, b.x + b.w), y1 = std::max(a.y + a.h, b.y + b.h);
+	bound.x = x0;
+	bound.y = y0;
+	bound.w = x1 - x0;
+	bound.h = y1 - y0;
+
+	int ow = std::min(a.x + a.w, b.x + b.w) - std::max(a.x, b.x),
+		oh = std::min(a.y + a.h, b.y + b.h) - std::max(a.y, b.y);
+	int overlap = ow > 0 && oh > 0 ? ow * oh : 0;
+
+	return bound.w * bound.h - (a.w * a.h + b.w * b.h - overlap);
+}
+
+}
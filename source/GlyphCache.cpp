@@ -0,0 +1,252 @@
+#include "unirender/GlyphCache.h"
+#include "unirender/TextureAtlas.h"
+#include "unirender/RenderContext.h"
+
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLYPH_SDF_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+const float EDT_INF = 1e20f;
+
+// glyphs per worker below which spawning threads is not worth it
+const size_t GLYPHS_PER_THREAD = 4;
+
+// Felzenszwalb & Huttenlocher, squared distance transform of a sampled
+// function along one line
+void edt_1d(float* f, int n, int stride, float* line, float* d, int* v, float* z)
+{
+	for (int i = 0; i < n; ++i) {
+		line[i] = f[i * stride];
+	}
+
+	int k = 0;
+	v[0] = 0;
+	z[0] = -EDT_INF;
+	z[1] = EDT_INF;
+	for (int q = 1; q < n; ++q)
+	{
+		float s = ((line[q] + q * q) - (line[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+		while (s <= z[k]) {
+			--k;
+			s = ((line[q] + q * q) - (line[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+		}
+		++k;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = EDT_INF;
+	}
+
+	k = 0;
+	for (int q = 0; q < n; ++q)
+	{
+		while (z[k + 1] < q) {
+			++k;
+		}
+		d[q] = static_cast<float>((q - v[k]) * (q - v[k])) + line[v[k]];
+	}
+
+	for (int i = 0; i < n; ++i) {
+		f[i * stride] = d[i];
+	}
+}
+
+void edt_2d(float* grid, int w, int h, std::vector<float>& buf, std::vector<int>& v)
+{
+	const int n = std::max(w, h);
+	buf.resize(n * 3 + 1);
+	v.resize(n);
+	float* line = buf.data();
+	float* d = line + n;
+	float* z = d + n;
+	for (int x = 0; x < w; ++x) {
+		edt_1d(grid + x, h, w, line, d, v.data(), z);
+	}
+	for (int y = 0; y < h; ++y) {
+		edt_1d(grid + y * w, w, 1, line, d, v.data(), z);
+	}
+}
+
+// 0.5 on the edge, 1 at spread pixels inside
+void encode_sdf(const float* outside, const float* inside, int n, float spread, uint8_t* dst)
+{
+	const float scale = -255.0f / (2 * spread);
+	int i = 0;
+#ifdef GLYPH_SDF_SSE2
+	const __m128 v_scale = _mm_set1_ps(scale);
+	const __m128 v_bias  = _mm_set1_ps(127.5f);
+	const __m128 v_zero  = _mm_setzero_ps();
+	const __m128 v_max   = _mm_set1_ps(255.0f);
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128 d0 = _mm_sub_ps(_mm_sqrt_ps(_mm_loadu_ps(outside + i)), _mm_sqrt_ps(_mm_loadu_ps(inside + i)));
+		__m128 d1 = _mm_sub_ps(_mm_sqrt_ps(_mm_loadu_ps(outside + i + 4)), _mm_sqrt_ps(_mm_loadu_ps(inside + i + 4)));
+		d0 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(d0, v_scale), v_bias), v_zero), v_max);
+		d1 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(d1, v_scale), v_bias), v_zero), v_max);
+		__m128i i16 = _mm_packs_epi32(_mm_cvtps_epi32(d0), _mm_cvtps_epi32(d1));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(i16, i16));
+	}
+#endif // GLYPH_SDF_SSE2
+	for (; i < n; ++i)
+	{
+		float d = sqrtf(outside[i]) - sqrtf(inside[i]);
+		float c = d * scale + 127.5f;
+		dst[i] = static_cast<uint8_t>(std::min(std::max(c, 0.0f), 255.0f) + 0.5f);
+	}
+}
+
+void gen_sdf(const uint8_t* coverage, int w, int h, int spread, std::vector<uint8_t>& sdf)
+{
+	const int sw = w + spread * 2,
+		      sh = h + spread * 2;
+	const int n = sw * sh;
+
+	std::vector<float> outside(n, EDT_INF), inside(n, 0.0f);
+	for (int y = 0; y < h; ++y) {
+		for (int x = 0; x < w; ++x) {
+			if (coverage[y * w + x] >= 128) {
+				int i = (y + spread) * sw + x + spread;
+				outside[i] = 0;
+				inside[i] = EDT_INF;
+			}
+		}
+	}
+
+	std::vector<float> buf;
+	std::vector<int> v;
+	edt_2d(outside.data(), sw, sh, buf, v);
+	edt_2d(inside.data(), sw, sh, buf, v);
+
+	sdf.resize(n);
+	encode_sdf(outside.data(), inside.data(), n, static_cast<float>(spread), sdf.data());
+}
+
+uint64_t glyph_key(uint32_t font, uint32_t codepoint)
+{
+	return (static_cast<uint64_t>(font) << 32) | codepoint;
+}
+
+}
+
+namespace ur
+{
+
+GlyphCache::GlyphCache(RenderContext* rc, int page_size, int spread, int max_pages)
+	: m_rc(rc)
+	, m_page_size(page_size)
+	, m_spread(spread)
+	, m_max_pages(max_pages)
+{
+}
+
+GlyphCache::~GlyphCache()
+{
+}
+
+bool GlyphCache::Query(uint32_t font, uint32_t codepoint, Glyph& glyph)
+{
+	auto itr = m_atlases.find(font);
+	if (itr == m_atlases.end()) {
+		return false;
+	}
+
+	TextureAtlas::Region r;
+	if (!itr->second->Query(glyph_key(font, codepoint), r)) {
+		return false;
+	}
+
+	glyph.page = r.page;
+	glyph.w = r.w;
+	glyph.h = r.h;
+	glyph.spread = m_spread;
+	memcpy(glyph.uv, r.uv, sizeof(r.uv));
+
+	return true;
+}
+
+void GlyphCache::Add(uint32_t font, uint32_t codepoint, const uint8_t* coverage, int w, int h)
+{
+	for (auto& p : m_pending) {
+		if (p.font == font && p.codepoint == codepoint) {
+			return;
+		}
+	}
+
+	Pending p;
+	p.font = font;
+	p.codepoint = codepoint;
+	p.w = w;
+	p.h = h;
+	p.coverage.assign(coverage, coverage + w * h);
+	m_pending.push_back(std::move(p));
+}
+
+void GlyphCache::Flush()
+{
+	if (!m_pending.empty())
+	{
+		std::atomic<size_t> next(0);
+		auto work = [&]()
+		{
+			for (size_t i = next++; i < m_pending.size(); i = next++) {
+				auto& p = m_pending[i];
+				gen_sdf(p.coverage.data(), p.w, p.h, m_spread, p.sdf);
+			}
+		};
+
+		size_t n = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u),
+			(m_pending.size() + GLYPHS_PER_THREAD - 1) / GLYPHS_PER_THREAD);
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < n; ++i) {
+			threads.emplace_back(work);
+		}
+		work();
+		for (auto& t : threads) {
+			t.join();
+		}
+
+		for (auto& p : m_pending) {
+			FetchAtlas(p.font)->Insert(glyph_key(p.font, p.codepoint),
+				p.w + m_spread * 2, p.h + m_spread * 2, p.sdf.data());
+		}
+		m_pending.clear();
+	}
+
+	for (auto& itr : m_atlases) {
+		itr.second->Flush();
+	}
+}
+
+const Texture* GlyphCache::GetPage(uint32_t font, int page) const
+{
+	auto itr = m_atlases.find(font);
+	if (itr == m_atlases.end() || page < 0 || page >= static_cast<int>(itr->second->GetPageCount())) {
+		return nullptr;
+	}
+	return &itr->second->GetPage(page);
+}
+
+TextureAtlas* GlyphCache::FetchAtlas(uint32_t font)
+{
+	auto itr = m_atlases.find(font);
+	if (itr != m_atlases.end()) {
+		return itr->second.get();
+	}
+
+	auto atlas = std::make_unique<TextureAtlas>(m_rc, m_page_size, m_page_size, TEXTURE_RED, m_max_pages);
+	auto ret = atlas.get();
+	m_atlases.insert({ font, std::move(atlas) });
+	return ret;
+}
+
+}
@@ -0,0 +1,337 @@
+#include "unirender/GpuTextureCompressor.h"
+#include "unirender/TextureCompressor.h"
+#include "unirender/RenderContext.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// desktop first, then es 3.1
+const char* CS_HEADERS[] = {
+	"#version 430\n",
+	"#version 310 es\nprecision highp float;\nprecision highp int;\n",
+};
+
+// One invocation per 4x4 block. Colors are fit along the principal axis
+// and inset a little, BC3 alpha spans the block's range.
+const char* CS_BODY = R"(
+layout(local_size_x = 64) in;
+
+layout(binding = 0) uniform sampler2D u_src;
+// the region encoded from the corner of u_src, the blocks are laid out by it
+uniform vec2 u_size;
+
+layout(std430, binding = 0) writeonly buffer Blocks
+{
+	uint blocks[];
+};
+
+uint pack565(vec3 c)
+{
+	vec3 q = clamp(round(c * vec3(31.0, 63.0, 31.0) / 255.0), vec3(0.0), vec3(31.0, 63.0, 31.0));
+	return (uint(q.r) << 11) | (uint(q.g) << 5) | uint(q.b);
+}
+
+vec3 unpack565(uint c)
+{
+	vec3 q = vec3(float(c >> 11), float((c >> 5) & 63u), float(c & 31u));
+	return floor(q * vec3(255.0 / 31.0, 255.0 / 63.0, 255.0 / 31.0) + 0.5);
+}
+
+uvec2 encode_color(vec3 px[16])
+{
+	vec3 mn = px[0], mx = px[0], mean = vec3(0.0);
+	for (int i = 0; i < 16; ++i) {
+		mn = min(mn, px[i]);
+		mx = max(mx, px[i]);
+		mean += px[i];
+	}
+	mean /= 16.0;
+
+	mat3 cov = mat3(0.0);
+	for (int i = 0; i < 16; ++i) {
+		vec3 d = px[i] - mean;
+		cov += outerProduct(d, d);
+	}
+
+	// power iteration from the bounding box diagonal
+	vec3 axis = mx - mn;
+	for (int k = 0; k < 4; ++k) {
+		vec3 v = cov * axis;
+		float len = max(abs(v.x), max(abs(v.y), abs(v.z)));
+		if (len > 1e-6) {
+			axis = v / len;
+		}
+	}
+
+	float tmin = 0.0, tmax = 0.0;
+	float l2 = dot(axis, axis);
+	if (l2 > 1e-6) {
+		for (int i = 0; i < 16; ++i) {
+			float t = dot(px[i] - mean, axis) / l2;
+			tmin = min(tmin, t);
+			tmax = max(tmax, t);
+		}
+	}
+
+	vec3 e0 = clamp(mean + axis * tmax, 0.0, 255.0);
+	vec3 e1 = clamp(mean + axis * tmin, 0.0, 255.0);
+	vec3 inset = (e0 - e1) / 32.0;
+	uint c0 = pack565(e0 - inset);
+	uint c1 = pack565(e1 + inset);
+	if (c0 < c1) {
+		uint t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+	if (c0 == c1) {
+		return uvec2(c0 | (c1 << 16), 0u);
+	}
+
+	// c0 > c1 selects the four color mode
+	vec3 pal[4];
+	pal[0] = unpack565(c0);
+	pal[1] = unpack565(c1);
+	pal[2] = (2.0 * pal[0] + pal[1]) / 3.0;
+	pal[3] = (pal[0] + 2.0 * pal[1]) / 3.0;
+
+	uint indices = 0u;
+	for (int i = 0; i < 16; ++i)
+	{
+		uint best = 0u;
+		float best_d = 1e30;
+		for (uint k = 0u; k < 4u; ++k) {
+			vec3 d = px[i] - pal[k];
+			float dist = dot(d, d);
+			if (dist < best_d) {
+				best_d = dist;
+				best = k;
+			}
+		}
+		indices |= best << (2 * i);
+	}
+	return uvec2(c0 | (c1 << 16), indices);
+}
+
+uvec2 encode_alpha(float a[16])
+{
+	float amin = a[0], amax = a[0];
+	for (int i = 1; i < 16; ++i) {
+		amin = min(amin, a[i]);
+		amax = max(amax, a[i]);
+	}
+
+	uint a0 = uint(round(amax));
+	uint a1 = uint(round(amin));
+	if (a0 == a1) {
+		return uvec2(a0 | (a1 << 8), 0u);
+	}
+
+	// a0 > a1, eight values from a0 to a1; 48 index bits in lo and hi
+	uint lo = 0u, hi = 0u;
+	float scale = 7.0 / float(a0 - a1);
+	for (int i = 0; i < 16; ++i)
+	{
+		uint s = uint(clamp(round((float(a0) - a[i]) * scale), 0.0, 7.0));
+		uint k = s == 0u ? 0u : (s == 7u ? 1u : s + 1u);
+		uint bit = 3u * uint(i);
+		if (bit < 32u) {
+			lo |= k << bit;
+			if (bit > 29u) {
+				hi |= k >> (32u - bit);
+			}
+		} else {
+			hi |= k << (bit - 32u);
+		}
+	}
+	return uvec2(a0 | (a1 << 8) | (lo << 16), (lo >> 16) | (hi << 16));
+}
+
+void main()
+{
+	ivec2 size = ivec2(u_size);
+	int bw = (size.x + 3) / 4;
+	int id = int(gl_GlobalInvocationID.x);
+	if (id >= bw * ((size.y + 3) / 4)) {
+		return;
+	}
+
+	ivec2 origin = ivec2(id % bw, id / bw) * 4;
+	ivec2 last = min(size, textureSize(u_src, 0)) - 1;
+	vec3  px[16];
+	float a[16];
+	for (int i = 0; i < 16; ++i) {
+		// edge blocks repeat the last row and column
+		vec4 c = texelFetch(u_src, min(origin + ivec2(i & 3, i >> 2), last), 0) * 255.0;
+		px[i] = c.rgb;
+		a[i] = c.a;
+	}
+
+	uvec2 color = encode_color(px);
+#ifdef BC3
+	uvec2 alpha = encode_alpha(a);
+	blocks[id * 4 + 0] = alpha.x;
+	blocks[id * 4 + 1] = alpha.y;
+	blocks[id * 4 + 2] = color.x;
+	blocks[id * 4 + 3] = color.y;
+#else
+	blocks[id * 2 + 0] = color.x;
+	blocks[id * 2 + 1] = color.y;
+#endif
+}
+)";
+
+int shader_slot(ur::TEXTURE_FORMAT fmt)
+{
+	switch (fmt)
+	{
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return 0;
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return 1;
+	default:
+		return -1;
+	}
+}
+
+}
+
+namespace ur
+{
+
+GpuTextureCompressor::GpuTextureCompressor(RenderContext* rc)
+	: m_rc(rc)
+{
+	m_shaders[0] = m_shaders[1] = 0;
+}
+
+GpuTextureCompressor::~GpuTextureCompressor()
+{
+	for (auto& s : m_shaders) {
+		if (s > 0) {
+			m_rc->ReleaseShader(s);
+		}
+	}
+	if (m_buf != 0) {
+		m_rc->ReleaseComputeBuffer(m_buf);
+	}
+}
+
+bool GpuTextureCompressor::IsSupported(const RenderContext& rc, TEXTURE_FORMAT fmt)
+{
+	// storage buffers come with compute shaders, gl 4.3 and es 3.1
+	return shader_slot(fmt) >= 0
+		&& rc.GetCapability(CAP_MAX_SHADER_STORAGE_BUFFER_BINDINGS) > 0
+		&& rc.IsSupportTextureFormat(fmt);
+}
+
+int GpuTextureCompressor::Compress(int src, int width, int height, TEXTURE_FORMAT fmt,
+	                               TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
+{
+	if (!IsSupported(*m_rc, fmt)) {
+		return 0;
+	}
+
+	int dst = m_rc->CreateTextureID(width, height, fmt);
+	if (dst == 0) {
+		return 0;
+	}
+
+	// allocate the storage, not read from a bound pixel buffer
+	m_rc->UnbindPixelBuffer();
+	m_rc->UpdateTexture(dst, nullptr, width, height, 0, 0, wrap, filter);
+
+	if (!Compress(src, width, height, fmt, dst)) {
+		m_rc->ReleaseTexture(dst);
+		return 0;
+	}
+	return dst;
+}
+
+bool GpuTextureCompressor::Compress(int src, int width, int height, TEXTURE_FORMAT fmt, int dst)
+{
+	if (!IsSupported(*m_rc, fmt) || width <= 0 || height <= 0) {
+		return false;
+	}
+
+	int shader = FetchShader(fmt);
+	if (shader <= 0 || !PrepareBuffer(TextureCompressor::CompressedSize(fmt, width, height))) {
+		return false;
+	}
+
+	Encode(shader, src, width, height);
+
+	// the blocks go from the storage buffer into the texture on the gpu
+	m_rc->BindPixelBuffer(m_buf);
+	m_rc->UpdateSubTexture(nullptr, 0, 0, width, height, dst);
+	m_rc->UnbindPixelBuffer();
+
+	return true;
+}
+
+int GpuTextureCompressor::FetchShader(TEXTURE_FORMAT fmt)
+{
+	int& shader = m_shaders[shader_slot(fmt)];
+	if (shader == 0)
+	{
+		for (auto header : CS_HEADERS)
+		{
+			std::string cs = header;
+			if (fmt == TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				cs += "#define BC3\n";
+			}
+			cs += CS_BODY;
+			shader = m_rc->CreateShader(cs.c_str());
+			if (shader != 0) {
+				break;
+			}
+		}
+		// don't retry a shader the driver rejected
+		if (shader == 0) {
+			shader = -1;
+		}
+	}
+	return shader;
+}
+
+bool GpuTextureCompressor::PrepareBuffer(size_t size)
+{
+	if (size <= m_buf_size) {
+		return m_buf != 0;
+	}
+
+	if (m_buf != 0) {
+		m_rc->ReleaseComputeBuffer(m_buf);
+	}
+
+	std::vector<int> zero((size + sizeof(int) - 1) / sizeof(int), 0);
+	m_buf = m_rc->CreateComputeBuffer(zero, 0);
+	m_buf_size = m_buf != 0 ? zero.size() * sizeof(int) : 0;
+	return m_buf != 0;
+}
+
+void GpuTextureCompressor::Encode(int shader, int src, int width, int height)
+{
+	const int prev_shader = m_rc->GetBindedShader();
+	const int prev_tex = m_rc->GetBindedTextures()[0];
+
+	m_rc->BindShader(shader);
+	const float size[2] = { static_cast<float>(width), static_cast<float>(height) };
+	m_rc->SetShaderUniform(m_rc->GetShaderUniform("u_size"), UNIFORM_FLOAT2, size);
+	m_rc->BindTexture(src, 0);
+	m_rc->BindComputeBuffer(m_buf, 0);
+
+	const int blocks = ((width + 3) / 4) * ((height + 3) / 4);
+	int group = m_rc->GetComputeWorkGroupSize(shader);
+	if (group <= 0) {
+		group = 64;
+	}
+	m_rc->DispatchCompute((blocks + group - 1) / group);
+
+	m_rc->BindTexture(prev_tex, 0);
+	m_rc->BindShader(prev_shader);
+}
+
+}
@@ -0,0 +1,472 @@
+#include "unirender/IBLPrefilter.h"
+#include "unirender/RenderContext.h"
+#include "unirender/Shader.h"
+#include "unirender/VertexAttrib.h"
+#include "unirender/Utility.h"
+
+#include <logger.h>
+
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+
+const uint32_t CACHE_MAGIC   = 0x4c424955;	// "UIBL"
+const uint32_t CACHE_VERSION = 1;
+
+// desktop first, es if the driver rejects it
+const char* HEADERS[] = {
+	"#version 330 core\n",
+	"#version 300 es\nprecision highp float;\nprecision highp int;\n",
+};
+
+const char* PASS_DEFINES[] = {
+	"#define PASS_COPY\n",
+	"#define PASS_IRRADIANCE\n",
+	"#define PASS_SPECULAR\n",
+};
+
+const char* VS = R"(
+in vec3 position;
+in vec2 texcoord;
+
+out vec2 v_uv;
+
+void main()
+{
+	v_uv = texcoord;
+	gl_Position = vec4(position, 1.0);
+}
+)";
+
+const char* FS = R"(
+uniform samplerCube u_src;
+uniform int   u_face;
+// copy: the level of u_src, specular: roughness
+uniform float u_param;
+// texels per face of level 0 of u_src
+uniform float u_src_size;
+
+in  vec2 v_uv;
+out vec4 frag_color;
+
+const float PI = 3.14159265359;
+const uint  SAMPLES = 256u;
+
+vec3 face_dir(vec2 uv)
+{
+	vec2 st = uv * 2.0 - 1.0;
+	vec3 d;
+	if (u_face == 0) {
+		d = vec3(1.0, -st.y, -st.x);
+	} else if (u_face == 1) {
+		d = vec3(-1.0, -st.y, st.x);
+	} else if (u_face == 2) {
+		d = vec3(st.x, 1.0, st.y);
+	} else if (u_face == 3) {
+		d = vec3(st.x, -1.0, -st.y);
+	} else if (u_face == 4) {
+		d = vec3(st.x, -st.y, 1.0);
+	} else {
+		d = vec3(-st.x, -st.y, -1.0);
+	}
+	return normalize(d);
+}
+
+vec2 hammersley(uint i)
+{
+	uint bits = (i << 16u) | (i >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return vec2(float(i) / float(SAMPLES), float(bits) * 2.3283064365386963e-10);
+}
+
+// the level whose texels cover the solid angle of a sample of pdf
+float sample_lod(float pdf)
+{
+	float sa_texel  = 4.0 * PI / (6.0 * u_src_size * u_src_size);
+	float sa_sample = 1.0 / (float(SAMPLES) * pdf + 1e-4);
+	return max(0.5 * log2(sa_sample / sa_texel) + 1.0, 0.0);
+}
+
+void main()
+{
+	vec3 n = face_dir(v_uv);
+#ifdef PASS_COPY
+	frag_color = vec4(textureLod(u_src, n, u_param).rgb, 1.0);
+#else
+	vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+	vec3 t = normalize(cross(up, n));
+	vec3 b = cross(n, t);
+
+	vec3  sum = vec3(0.0);
+	float weight = 0.0;
+	for (uint i = 0u; i < SAMPLES; ++i)
+	{
+		vec2 xi = hammersley(i);
+		float phi = 2.0 * PI * xi.x;
+#ifdef PASS_IRRADIANCE
+		// cosine weighted, the pdf cancels the cosine and the 1 / pi
+		float cos_t = sqrt(1.0 - xi.y);
+		vec3 l = (t * cos(phi) + b * sin(phi)) * sqrt(xi.y) + n * cos_t;
+		sum += textureLod(u_src, l, sample_lod(cos_t / PI)).rgb;
+		weight += 1.0;
+#else
+		// ggx half vectors, seen along n
+		float a2 = u_param * u_param * u_param * u_param;
+		float cos_h = sqrt((1.0 - xi.y) / (1.0 + (a2 - 1.0) * xi.y));
+		vec3 h = (t * cos(phi) + b * sin(phi)) * sqrt(1.0 - cos_h * cos_h) + n * cos_h;
+		vec3 l = 2.0 * cos_h * h - n;
+		float ndl = dot(n, l);
+		if (ndl > 0.0) {
+			float d = cos_h * cos_h * (a2 - 1.0) + 1.0;
+			sum += textureLod(u_src, l, sample_lod(a2 / (4.0 * PI * d * d))).rgb * ndl;
+			weight += ndl;
+		}
+#endif
+	}
+	frag_color = vec4(sum / max(weight, 1e-4), 1.0);
+#endif
+}
+)";
+
+// rgba floats of a face
+inline size_t face_floats(int size)
+{
+	return static_cast<size_t>(size) * size * 4;
+}
+
+size_t total_floats(const uint32_t sizes[3])
+{
+	size_t n = face_floats(sizes[0]) * 6;
+	for (uint32_t i = 0; i < sizes[2]; ++i) {
+		n += face_floats(std::max(static_cast<int>(sizes[1] >> i), 1)) * 6;
+	}
+	return n;
+}
+
+}
+
+namespace ur
+{
+
+IBLPrefilter::IBLPrefilter(RenderContext* rc, const std::string& cache_dir)
+	: m_rc(rc)
+	, m_cache_dir(cache_dir)
+{
+}
+
+IBLPrefilter::~IBLPrefilter()
+{
+	for (auto& store : m_pending) {
+		for (auto ticket : store.tickets) {
+			if (ticket != 0) {
+				m_rc->ReleaseReadback(ticket);
+			}
+		}
+	}
+}
+
+bool IBLPrefilter::Prefilter(int src, int src_size, uint64_t key, int& irradiance, int& specular,
+	                         int irradiance_size, int specular_size, int specular_levels)
+{
+	irradiance = specular = 0;
+	if (src == 0 || src_size <= 0 || irradiance_size <= 0 || specular_size <= 0) {
+		return false;
+	}
+
+	int full_levels = 1;
+	while ((specular_size >> full_levels) > 0) {
+		++full_levels;
+	}
+	specular_levels = std::min(std::max(specular_levels, 1), full_levels);
+
+	const uint32_t sizes[3] = {
+		static_cast<uint32_t>(irradiance_size), static_cast<uint32_t>(specular_size),
+		static_cast<uint32_t>(specular_levels),
+	};
+	const uint64_t cache_key = Utility::HashBytes(sizes, sizeof(sizes), key);
+
+	std::vector<float> data;
+	if (!m_cache_dir.empty() && LoadCache(cache_key, sizes, data)) {
+		return Upload(data, sizes, irradiance, specular);
+	}
+
+	if (!FetchShaders()) {
+		return false;
+	}
+
+	int vp_x, vp_y, vp_w, vp_h;
+	m_rc->GetViewport(vp_x, vp_y, vp_w, vp_h);
+	const int prev_shader = m_rc->GetBindedShader();
+	const int prev_layout = m_rc->GetVertexLayout();
+	const int prev_tex = m_rc->GetBindedTextures()[0];
+	const auto prev_ztest = m_rc->GetZTest();
+	const auto prev_cull = m_rc->GetCullMode();
+	int prev_blend_src, prev_blend_dst;
+	m_rc->GetBlendFunc(prev_blend_src, prev_blend_dst);
+
+	m_rc->SetZTest(DEPTH_DISABLE);
+	m_rc->SetCullMode(CULL_DISABLE);
+	m_rc->SetBlend(BLEND_ONE, BLEND_ZERO);
+
+	// a mipmapped copy of the source, each sample reads the level matching
+	// its footprint instead of many texels of level 0
+	const int radiance = m_rc->CreateTextureCube(specular_size, specular_size, full_levels, TEXTURE_RGBA16F);
+	irradiance = m_rc->CreateTextureCube(irradiance_size, irradiance_size, 0, TEXTURE_RGBA16F);
+	specular = m_rc->CreateTextureCube(specular_size, specular_size, specular_levels, TEXTURE_RGBA16F);
+
+	const int fbo = m_rc->CreateRenderTarget(0);
+	m_rc->BindRenderTarget(fbo);
+
+	std::vector<int> tickets;
+	auto readback = m_cache_dir.empty() ? nullptr : &tickets;
+
+	const float src_lod = std::max(std::log2(static_cast<float>(src_size) / specular_size), 0.0f);
+	RenderFaces(PASS_COPY, src, src_size, radiance, specular_size, 0, src_lod, nullptr);
+	m_rc->GenerateTextureMipmap(radiance);
+
+	RenderFaces(PASS_IRRADIANCE, radiance, specular_size, irradiance, irradiance_size, 0, 0, readback);
+	// roughness 0 is the mirror image
+	RenderFaces(PASS_COPY, radiance, specular_size, specular, specular_size, 0, 0, readback);
+	for (int level = 1; level < specular_levels; ++level) {
+		const float roughness = static_cast<float>(level) / (specular_levels - 1);
+		RenderFaces(PASS_SPECULAR, radiance, specular_size, specular, std::max(specular_size >> level, 1),
+			level, roughness, readback);
+	}
+
+	m_rc->BindRenderTargetTex(0);
+	m_rc->UnbindRenderTarget();
+	m_rc->ReleaseRenderTarget(fbo);
+	m_rc->ReleaseTexture(radiance);
+
+	m_rc->SetViewport(vp_x, vp_y, vp_w, vp_h);
+	m_rc->BindTexture(prev_tex, 0);
+	m_rc->BindShader(prev_shader);
+	m_rc->BindVertexLayout(prev_layout);
+	m_rc->SetZTest(prev_ztest);
+	m_rc->SetCullMode(prev_cull);
+	m_rc->SetBlend(prev_blend_src, prev_blend_dst);
+
+	// mapped by a later Update, when the gpu has finished the passes
+	if (readback)
+	{
+		PendingStore store;
+		store.key = cache_key;
+		memcpy(store.sizes, sizes, sizeof(sizes));
+		store.tickets.swap(tickets);
+		m_pending.push_back(std::move(store));
+	}
+
+	return irradiance != 0 && specular != 0;
+}
+
+void IBLPrefilter::Update(bool wait)
+{
+	for (auto itr = m_pending.begin(); itr != m_pending.end(); )
+	{
+		if (TryStore(*itr, wait)) {
+			itr = m_pending.erase(itr);
+		} else {
+			++itr;
+		}
+	}
+}
+
+bool IBLPrefilter::TryStore(PendingStore& store, bool wait)
+{
+	if (!wait) {
+		for (auto ticket : store.tickets) {
+			if (ticket != 0 && !m_rc->IsReadbackReady(ticket)) {
+				return false;
+			}
+		}
+	}
+
+	// same order as the passes, irradiance then specular by level
+	const int irradiance_size = store.sizes[0], specular_size = store.sizes[1];
+	std::vector<float> data(total_floats(store.sizes));
+	size_t offset = 0;
+	bool ok = true;
+	for (int i = 0, n = static_cast<int>(store.tickets.size()); i < n; ++i)
+	{
+		const int ticket = store.tickets[i];
+		const int level = i / 6 - 1;
+		const int size = level < 0 ? irradiance_size : std::max(specular_size >> level, 1);
+		const size_t count = face_floats(size);
+		auto pixels = ticket != 0 ? m_rc->MapReadback(ticket) : nullptr;
+		if (pixels && ok) {
+			memcpy(&data[offset], pixels, count * sizeof(float));
+		} else {
+			ok = false;
+		}
+		offset += count;
+		if (ticket != 0) {
+			m_rc->ReleaseReadback(ticket);
+		}
+	}
+	if (ok) {
+		StoreCache(store.key, store.sizes, data);
+	}
+
+	return true;
+}
+
+bool IBLPrefilter::FetchShaders()
+{
+	if (m_shaders[0]) {
+		return true;
+	}
+	// don't retry shaders the driver rejected
+	if (m_shaders_failed) {
+		return false;
+	}
+
+	CU_VEC<VertexAttrib> layout;
+	layout.push_back(VertexAttrib("position", 3, 4, 20, 0));
+	layout.push_back(VertexAttrib("texcoord", 2, 4, 20, 12));
+	const std::vector<std::string> textures = { "u_src" };
+
+	for (auto header : HEADERS)
+	{
+		bool ok = true;
+		for (int i = 0; i < PASS_COUNT && ok; ++i)
+		{
+			const std::string vs = std::string(header) + VS;
+			const std::string fs = std::string(header) + PASS_DEFINES[i] + FS;
+			m_shaders[i] = std::make_unique<Shader>(m_rc, vs.c_str(), fs.c_str(), textures, layout, true);
+			ok = m_shaders[i]->IsValid();
+		}
+		if (ok) {
+			return true;
+		}
+		for (auto& s : m_shaders) {
+			s.reset();
+		}
+	}
+
+	LOGW("Can't create the ibl prefilter shaders\n");
+	m_shaders_failed = true;
+	return false;
+}
+
+void IBLPrefilter::RenderFaces(Pass pass, int src, int src_size, int dst, int size, int level,
+	                           float param, std::vector<int>* tickets)
+{
+	auto& shader = m_shaders[pass];
+	shader->Use();
+	shader->SetFloat("u_param", param);
+	shader->SetFloat("u_src_size", static_cast<float>(src_size));
+	m_rc->BindTexture(src, 0);
+	m_rc->SetViewport(0, 0, size, size);
+
+	for (int face = 0; face < 6; ++face)
+	{
+		m_rc->BindRenderTargetTex(dst, ATTACHMENT_COLOR0, static_cast<TEXTURE_TARGET>(TEXTURE_CUBE0 + face), level);
+		shader->SetInt("u_face", face);
+		m_rc->RenderQuad(RenderContext::VL_POS_TEX);
+		if (tickets) {
+			tickets->push_back(m_rc->ReadPixelsAsync(0, 0, size, size, TEXTURE_RGBA16F));
+		}
+	}
+}
+
+bool IBLPrefilter::Upload(const std::vector<float>& data, const uint32_t sizes[3],
+	                      int& irradiance, int& specular) const
+{
+	const int irradiance_size = sizes[0], specular_size = sizes[1], specular_levels = sizes[2];
+	irradiance = m_rc->CreateTextureCube(irradiance_size, irradiance_size, 0, TEXTURE_RGBA16F);
+	specular = m_rc->CreateTextureCube(specular_size, specular_size, specular_levels, TEXTURE_RGBA16F);
+	if (irradiance == 0 || specular == 0)
+	{
+		if (irradiance != 0) {
+			m_rc->ReleaseTexture(irradiance);
+		}
+		if (specular != 0) {
+			m_rc->ReleaseTexture(specular);
+		}
+		irradiance = specular = 0;
+		return false;
+	}
+
+	const float* ptr = data.data();
+	for (int face = 0; face < 6; ++face) {
+		m_rc->UpdateTexture(irradiance, ptr, irradiance_size, irradiance_size, face);
+		ptr += face_floats(irradiance_size);
+	}
+
+	std::vector<const float*> levels(specular_levels);
+	for (int level = 0; level < specular_levels; ++level) {
+		levels[level] = ptr;
+		ptr += face_floats(std::max(specular_size >> level, 1)) * 6;
+	}
+	// coarse to fine, uploaded levels keep the driver from generating mips
+	for (int level = specular_levels - 1; level >= 0; --level)
+	{
+		const int size = std::max(specular_size >> level, 1);
+		for (int face = 0; face < 6; ++face) {
+			m_rc->UpdateTexture(specular, levels[level] + face_floats(size) * face, size, size, face, level);
+		}
+	}
+
+	return true;
+}
+
+std::string IBLPrefilter::CachePath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.uribl", static_cast<unsigned long long>(key));
+
+	std::string path = m_cache_dir;
+	if (path.back() != '/' && path.back() != '\\') {
+		path += '/';
+	}
+	return path + name;
+}
+
+bool IBLPrefilter::LoadCache(uint64_t key, const uint32_t sizes[3], std::vector<float>& data) const
+{
+	std::ifstream fin(CachePath(key), std::ios::binary);
+	if (fin.fail()) {
+		return false;
+	}
+
+	uint32_t header[5];
+	uint64_t size = 0;
+	fin.read(reinterpret_cast<char*>(header), sizeof(header));
+	fin.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if (fin.fail() || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION ||
+		memcmp(header + 2, sizes, sizeof(uint32_t) * 3) != 0 ||
+		size != total_floats(sizes) * sizeof(float)) {
+		return false;
+	}
+
+	data.resize(total_floats(sizes));
+	fin.read(reinterpret_cast<char*>(data.data()), size);
+	return !fin.fail();
+}
+
+void IBLPrefilter::StoreCache(uint64_t key, const uint32_t sizes[3], const std::vector<float>& data) const
+{
+	const std::string path = CachePath(key);
+	std::ofstream fout(path, std::ios::binary);
+	if (fout.fail()) {
+		LOGW("Can't write ibl cache %s\n", path.c_str());
+		return;
+	}
+
+	const uint32_t header[5] = { CACHE_MAGIC, CACHE_VERSION, sizes[0], sizes[1], sizes[2] };
+	const uint64_t size = data.size() * sizeof(float);
+	fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+	fout.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	fout.write(reinterpret_cast<const char*>(data.data()), size);
+}
+
+}
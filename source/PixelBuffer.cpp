@@ -42,7 +42,7 @@ public:
 		m_rc->UpdateSubTexture(&m_buf[offset], x, y, width, height, tex_id);
 	}
 
-	void PixelBuffer::Clear()
+	virtual void Clear() override
 	{
 		memset(m_buf.get(), 0, CalcSize());
 	}
@@ -0,0 +1,84 @@
+#include "unirender/PixelBufferPool.h"
+#include "unirender/RenderContext.h"
+#include "unirender/Utility.h"
+
+#include <assert.h>
+
+namespace ur
+{
+
+PixelBufferPool::PixelBufferPool(RenderContext* rc, size_t width, size_t height,
+	                             TEXTURE_FORMAT format, int count)
+	: m_rc(rc)
+{
+	assert(count > 0);
+	m_slot_size = Utility::CalcClientSize(format, width, height);
+	m_buf_id = m_rc->CreatePixelBuffer(0, width, height * count, format);
+
+	m_fences.resize(count, 0);
+	m_unsync.resize(count, true);
+}
+
+PixelBufferPool::~PixelBufferPool()
+{
+	if (m_mapped) {
+		m_rc->BindPixelBuffer(m_buf_id);
+		m_rc->UnmapPixelBuffer();
+		m_rc->UnbindPixelBuffer();
+	}
+	for (auto& fence : m_fences) {
+		m_rc->ReleaseFence(fence);
+	}
+	m_rc->ReleasePixelBuffer(m_buf_id);
+}
+
+uint8_t* PixelBufferPool::Acquire(bool wait)
+{
+	assert(!m_mapped);
+
+	uint64_t& fence = m_fences[m_curr];
+	if (fence != 0)
+	{
+		if (!m_rc->IsFenceSignaled(fence))
+		{
+			if (!wait) {
+				return nullptr;
+			}
+			m_rc->WaitFence(fence);
+		}
+		m_rc->ReleaseFence(fence);
+		fence = 0;
+	}
+
+	// without fences the driver has to synchronize a reused slot
+	bool unsync = m_unsync[m_curr];
+
+	m_rc->BindPixelBuffer(m_buf_id);
+	auto ptr = static_cast<uint8_t*>(m_rc->MapPixelBufferRange(m_slot_size * m_curr, m_slot_size, unsync));
+	m_mapped = ptr != nullptr;
+	if (!ptr) {
+		m_rc->UnbindPixelBuffer();
+	}
+
+	return ptr;
+}
+
+void PixelBufferPool::Upload(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t tex_id)
+{
+	assert(m_mapped);
+
+	m_rc->BindPixelBuffer(m_buf_id);
+	m_rc->UnmapPixelBuffer();
+	m_mapped = false;
+
+	size_t offset = m_slot_size * m_curr;
+	m_rc->UpdateSubTexture(reinterpret_cast<void*>(offset), x, y, width, height, tex_id);
+	m_rc->UnbindPixelBuffer();
+
+	m_fences[m_curr] = m_rc->CreateFence();
+	m_unsync[m_curr] = m_fences[m_curr] != 0;
+
+	m_curr = (m_curr + 1) % m_fences.size();
+}
+
+}
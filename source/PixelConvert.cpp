@@ -0,0 +1,978 @@
+#include "unirender/PixelConvert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__) || defined(__AVX2__)
+#define PIXEL_CONVERT_SSSE3
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define PIXEL_CONVERT_AVX2
+#include <immintrin.h>
+#if defined(__F16C__) || defined(_MSC_VER)
+#define PIXEL_CONVERT_F16C
+#endif
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXEL_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+// pixels decoded to float per pass of the generic path
+const size_t GENERIC_CHUNK = 64;
+
+// exact round(v / 255) for v <= 255 * 255
+inline uint32_t div255(uint32_t v)
+{
+	v += 128;
+	return (v + (v >> 8)) >> 8;
+}
+
+inline uint8_t unorm8(float v)
+{
+	v = std::min(std::max(v, 0.0f), 1.0f);
+	return static_cast<uint8_t>(v * 255.0f + 0.5f);
+}
+
+inline uint32_t unorm_bits(float v, float max)
+{
+	v = std::min(std::max(v, 0.0f), 1.0f);
+	return static_cast<uint32_t>(v * max + 0.5f);
+}
+
+inline uint32_t float_bits(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+inline float bits_float(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+// round to nearest even, NaN stays NaN
+uint16_t float_to_half(float f)
+{
+	const uint32_t f16max = (127 + 16) << 23;
+	const uint32_t denorm_magic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+	uint32_t u = float_bits(f);
+	const uint32_t sign = u & 0x80000000u;
+	u ^= sign;
+
+	uint32_t o;
+	if (u >= f16max) {
+		o = u > 0x7f800000u ? 0x7e00 : 0x7c00;
+	} else if (u < (113u << 23)) {
+		// subnormal, let the float add round the mantissa
+		o = float_bits(bits_float(u) + bits_float(denorm_magic)) - denorm_magic;
+	} else {
+		const uint32_t mant_odd = (u >> 13) & 1;
+		u += ((15u - 127u) << 23) + 0xfff + mant_odd;
+		o = u >> 13;
+	}
+	return static_cast<uint16_t>(o | (sign >> 16));
+}
+
+float half_to_float(uint16_t h)
+{
+	const uint32_t shifted_exp = 0x7c00u << 13;
+
+	uint32_t o = (h & 0x7fffu) << 13;
+	const uint32_t exp = shifted_exp & o;
+	o += (127u - 15u) << 23;
+	if (exp == shifted_exp) {
+		o += (128u - 16u) << 23;
+	} else if (exp == 0) {
+		o += 1u << 23;
+		o = float_bits(bits_float(o) - bits_float(113u << 23));
+	}
+	return bits_float(o | ((h & 0x8000u) << 16));
+}
+
+float srgb_to_linear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+struct Tables
+{
+	float   unorm[256];
+	float   srgb[256];
+	uint8_t srgb8[256];
+
+	Tables()
+	{
+		for (int i = 0; i < 256; ++i)
+		{
+			unorm[i] = i * (1.0f / 255.0f);
+			srgb[i] = srgb_to_linear(unorm[i]);
+			srgb8[i] = unorm8(srgb[i]);
+		}
+	}
+};
+
+const Tables& tables()
+{
+	static Tables t;
+	return t;
+}
+
+#ifdef PIXEL_CONVERT_SSE2
+
+// u32 lanes holding at most 0xffff, to u16
+inline __m128i pack_u32_u16(__m128i a, __m128i b)
+{
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+	return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32)), bias16);
+}
+
+inline __m128i div255_epi16(__m128i v)
+{
+	v = _mm_add_epi16(v, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+}
+
+// u8 channel in u32 lanes to round(c * max / 255)
+inline __m128i quantize_epi32(__m128i c, int max)
+{
+	__m128i v = _mm_add_epi32(_mm_mullo_epi16(c, _mm_set1_epi32(max)), _mm_set1_epi32(128));
+	return _mm_srli_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 8)), 8);
+}
+
+inline __m128i premultiply_epi16(__m128i px)
+{
+	const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i a_one = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	a = _mm_or_si128(_mm_and_si128(a, rgb_mask), a_one);
+	return div255_epi16(_mm_mullo_epi16(px, a));
+}
+
+inline __m128i float_to_half_epi32(__m128 f)
+{
+	const __m128i sign_mask = _mm_set1_epi32(0x80000000u);
+	const __m128i f32infty = _mm_set1_epi32(0x7f800000);
+	const __m128i f16max_m1 = _mm_set1_epi32(((127 + 16) << 23) - 1);
+	const __m128i sub_limit = _mm_set1_epi32(113 << 23);
+	const __m128i denorm_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+	const __m128i one = _mm_set1_epi32(1);
+
+	__m128i u = _mm_castps_si128(f);
+	__m128i sign = _mm_and_si128(u, sign_mask);
+	u = _mm_xor_si128(u, sign);
+
+	__m128i is_big = _mm_cmpgt_epi32(u, f16max_m1);
+	__m128i is_sub = _mm_cmpgt_epi32(sub_limit, u);
+	__m128i infnan = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi32(u, f32infty), _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+	__m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), _mm_castsi128_ps(denorm_magic))), denorm_magic);
+
+	__m128i odd = _mm_and_si128(_mm_srli_epi32(u, 13), one);
+	__m128i norm = _mm_add_epi32(u, _mm_set1_epi32(static_cast<int>(((15u - 127u) << 23) + 0xfff)));
+	norm = _mm_srli_epi32(_mm_add_epi32(norm, odd), 13);
+
+	__m128i o = _mm_or_si128(_mm_and_si128(is_sub, sub), _mm_andnot_si128(is_sub, norm));
+	o = _mm_or_si128(_mm_and_si128(is_big, infnan), _mm_andnot_si128(is_big, o));
+	return _mm_or_si128(o, _mm_srli_epi32(sign, 16));
+}
+
+inline __m128 half_to_float_ps(__m128i h)
+{
+	const __m128i shifted_exp = _mm_set1_epi32(0x7c00 << 13);
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(113 << 23));
+
+	__m128i o = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+	__m128i exp = _mm_and_si128(o, shifted_exp);
+	o = _mm_add_epi32(o, _mm_set1_epi32((127 - 15) << 23));
+
+	__m128i is_infnan = _mm_cmpeq_epi32(exp, shifted_exp);
+	__m128i is_denorm = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+	__m128i infnan = _mm_add_epi32(o, _mm_set1_epi32((128 - 16) << 23));
+	__m128i denorm = _mm_castps_si128(_mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(o, _mm_set1_epi32(1 << 23))), magic));
+
+	o = _mm_or_si128(_mm_and_si128(is_infnan, infnan), _mm_andnot_si128(is_infnan, o));
+	o = _mm_or_si128(_mm_and_si128(is_denorm, denorm), _mm_andnot_si128(is_denorm, o));
+	o = _mm_or_si128(o, _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+	return _mm_castsi128_ps(o);
+}
+
+#endif // PIXEL_CONVERT_SSE2
+
+#ifdef PIXEL_CONVERT_NEON
+
+// exact round(v / 255) for v <= 255 * 255
+inline uint8x8_t div255_u16(uint16x8_t v)
+{
+	return vrshrn_n_u16(vaddq_u16(v, vrshrq_n_u16(v, 8)), 8);
+}
+
+#endif // PIXEL_CONVERT_NEON
+
+void decode(const uint8_t* src, ur::TEXTURE_FORMAT fmt, float* rgba, size_t n, bool srgb)
+{
+	const Tables& t = tables();
+	const float* lut = srgb ? t.srgb : t.unorm;
+	const float* fsrc = reinterpret_cast<const float*>(src);
+	for (size_t i = 0; i < n; ++i, rgba += 4)
+	{
+		switch (fmt)
+		{
+		case ur::TEXTURE_RGBA8:
+			rgba[0] = lut[src[i * 4]];
+			rgba[1] = lut[src[i * 4 + 1]];
+			rgba[2] = lut[src[i * 4 + 2]];
+			rgba[3] = t.unorm[src[i * 4 + 3]];
+			break;
+		case ur::TEXTURE_BGRA_EXT:
+			rgba[0] = lut[src[i * 4 + 2]];
+			rgba[1] = lut[src[i * 4 + 1]];
+			rgba[2] = lut[src[i * 4]];
+			rgba[3] = t.unorm[src[i * 4 + 3]];
+			break;
+		case ur::TEXTURE_RGB:
+			rgba[0] = lut[src[i * 3]];
+			rgba[1] = lut[src[i * 3 + 1]];
+			rgba[2] = lut[src[i * 3 + 2]];
+			rgba[3] = 1;
+			break;
+		case ur::TEXTURE_BGR_EXT:
+			rgba[0] = lut[src[i * 3 + 2]];
+			rgba[1] = lut[src[i * 3 + 1]];
+			rgba[2] = lut[src[i * 3]];
+			rgba[3] = 1;
+			break;
+		case ur::TEXTURE_RGBA4:
+		{
+			uint16_t v;
+			memcpy(&v, src + i * 2, 2);
+			rgba[0] = lut[((v >> 12) & 0xf) * 17];
+			rgba[1] = lut[((v >> 8) & 0xf) * 17];
+			rgba[2] = lut[((v >> 4) & 0xf) * 17];
+			rgba[3] = t.unorm[(v & 0xf) * 17];
+		}
+			break;
+		case ur::TEXTURE_RGB565:
+		{
+			uint16_t v;
+			memcpy(&v, src + i * 2, 2);
+			rgba[0] = lut[(((v >> 11) & 0x1f) * 255 + 15) / 31];
+			rgba[1] = lut[(((v >> 5) & 0x3f) * 255 + 31) / 63];
+			rgba[2] = lut[((v & 0x1f) * 255 + 15) / 31];
+			rgba[3] = 1;
+		}
+			break;
+		case ur::TEXTURE_RGBA16F:
+			memcpy(rgba, fsrc + i * 4, sizeof(float) * 4);
+			break;
+		case ur::TEXTURE_RGB16F:
+		case ur::TEXTURE_RGB32F:
+			memcpy(rgba, fsrc + i * 3, sizeof(float) * 3);
+			rgba[3] = 1;
+			break;
+		case ur::TEXTURE_RG16F:
+			rgba[0] = fsrc[i * 2];
+			rgba[1] = fsrc[i * 2 + 1];
+			rgba[2] = 0;
+			rgba[3] = 1;
+			break;
+		case ur::TEXTURE_A8:
+			rgba[0] = rgba[1] = rgba[2] = 0;
+			rgba[3] = t.unorm[src[i]];
+			break;
+		case ur::TEXTURE_RED:
+			rgba[0] = lut[src[i]];
+			rgba[1] = rgba[2] = 0;
+			rgba[3] = 1;
+			break;
+		case ur::TEXTURE_R16:
+		{
+			int16_t v;
+			memcpy(&v, src + i * 2, 2);
+			rgba[0] = std::max(v / 32767.0f, -1.0f);
+			rgba[1] = rgba[2] = 0;
+			rgba[3] = 1;
+		}
+			break;
+		default:
+			assert(0);
+		}
+
+		if (srgb && fmt >= ur::TEXTURE_RGBA16F && fmt <= ur::TEXTURE_RG16F) {
+			for (int c = 0; c < 3; ++c) {
+				rgba[c] = srgb_to_linear(rgba[c]);
+			}
+		}
+	}
+}
+
+void encode(const float* rgba, ur::TEXTURE_FORMAT fmt, uint8_t* dst, size_t n)
+{
+	float* fdst = reinterpret_cast<float*>(dst);
+	for (size_t i = 0; i < n; ++i, rgba += 4)
+	{
+		switch (fmt)
+		{
+		case ur::TEXTURE_RGBA8:
+			for (int c = 0; c < 4; ++c) {
+				dst[i * 4 + c] = unorm8(rgba[c]);
+			}
+			break;
+		case ur::TEXTURE_BGRA_EXT:
+			dst[i * 4]     = unorm8(rgba[2]);
+			dst[i * 4 + 1] = unorm8(rgba[1]);
+			dst[i * 4 + 2] = unorm8(rgba[0]);
+			dst[i * 4 + 3] = unorm8(rgba[3]);
+			break;
+		case ur::TEXTURE_RGB:
+			for (int c = 0; c < 3; ++c) {
+				dst[i * 3 + c] = unorm8(rgba[c]);
+			}
+			break;
+		case ur::TEXTURE_BGR_EXT:
+			dst[i * 3]     = unorm8(rgba[2]);
+			dst[i * 3 + 1] = unorm8(rgba[1]);
+			dst[i * 3 + 2] = unorm8(rgba[0]);
+			break;
+		case ur::TEXTURE_RGBA4:
+		{
+			uint16_t v = static_cast<uint16_t>(unorm_bits(rgba[0], 15) << 12 | unorm_bits(rgba[1], 15) << 8
+				| unorm_bits(rgba[2], 15) << 4 | unorm_bits(rgba[3], 15));
+			memcpy(dst + i * 2, &v, 2);
+		}
+			break;
+		case ur::TEXTURE_RGB565:
+		{
+			uint16_t v = static_cast<uint16_t>(unorm_bits(rgba[0], 31) << 11 | unorm_bits(rgba[1], 63) << 5
+				| unorm_bits(rgba[2], 31));
+			memcpy(dst + i * 2, &v, 2);
+		}
+			break;
+		case ur::TEXTURE_RGBA16F:
+			memcpy(fdst + i * 4, rgba, sizeof(float) * 4);
+			break;
+		case ur::TEXTURE_RGB16F:
+		case ur::TEXTURE_RGB32F:
+			memcpy(fdst + i * 3, rgba, sizeof(float) * 3);
+			break;
+		case ur::TEXTURE_RG16F:
+			fdst[i * 2]     = rgba[0];
+			fdst[i * 2 + 1] = rgba[1];
+			break;
+		case ur::TEXTURE_A8:
+			dst[i] = unorm8(rgba[3]);
+			break;
+		case ur::TEXTURE_RED:
+			dst[i] = unorm8(rgba[0]);
+			break;
+		case ur::TEXTURE_R16:
+		{
+			float r = std::min(std::max(rgba[0], -1.0f), 1.0f) * 32767.0f;
+			int16_t v = static_cast<int16_t>(r >= 0 ? r + 0.5f : r - 0.5f);
+			memcpy(dst + i * 2, &v, 2);
+		}
+			break;
+		default:
+			assert(0);
+		}
+	}
+}
+
+bool is_rgba8(ur::TEXTURE_FORMAT fmt)
+{
+	return fmt == ur::TEXTURE_RGBA8 || fmt == ur::TEXTURE_BGRA_EXT;
+}
+
+bool is_rgb8(ur::TEXTURE_FORMAT fmt)
+{
+	return fmt == ur::TEXTURE_RGB || fmt == ur::TEXTURE_BGR_EXT;
+}
+
+// pairs with a dedicated kernel
+bool convert_fast(const uint8_t* src, ur::TEXTURE_FORMAT src_fmt, uint8_t* dst,
+	              ur::TEXTURE_FORMAT dst_fmt, size_t count, uint32_t ops)
+{
+	using ur::PixelConvert;
+
+	if (is_rgba8(src_fmt) && is_rgba8(dst_fmt))
+	{
+		if (src_fmt != dst_fmt) {
+			PixelConvert::SwizzleRB(src, dst, count);
+		} else if (src != dst) {
+			memcpy(dst, src, count * 4);
+		}
+		if (ops & PixelConvert::OP_SRGB_TO_LINEAR) {
+			PixelConvert::SrgbToLinear(dst, dst, count);
+		}
+		if (ops & PixelConvert::OP_PREMULTIPLY) {
+			PixelConvert::Premultiply(dst, dst, count);
+		}
+		return true;
+	}
+
+	if (ops != PixelConvert::OP_NONE) {
+		return false;
+	}
+
+	if (is_rgb8(src_fmt) && is_rgba8(dst_fmt)) {
+		PixelConvert::PadRGB(src, dst, count, (src_fmt == ur::TEXTURE_RGB) != (dst_fmt == ur::TEXTURE_RGBA8));
+		return true;
+	}
+
+	uint16_t* dst16 = reinterpret_cast<uint16_t*>(dst);
+	if (src_fmt == ur::TEXTURE_RGBA8 && dst_fmt == ur::TEXTURE_RGBA4) {
+		PixelConvert::PackRGBA4(src, dst16, count);
+		return true;
+	}
+	if (src_fmt == ur::TEXTURE_RGBA8 && dst_fmt == ur::TEXTURE_RGB565) {
+		PixelConvert::PackRGB565(src, dst16, count);
+		return true;
+	}
+	if (src_fmt == ur::TEXTURE_RGB && dst_fmt == ur::TEXTURE_RGB565)
+	{
+		uint8_t buf[GENERIC_CHUNK * 4];
+		for (size_t i = 0; i < count; i += GENERIC_CHUNK) {
+			const size_t n = std::min(GENERIC_CHUNK, count - i);
+			PixelConvert::PadRGB(src + i * 3, buf, n, false);
+			PixelConvert::PackRGB565(buf, dst16 + i, n);
+		}
+		return true;
+	}
+
+	float* dstf = reinterpret_cast<float*>(dst);
+	if (src_fmt == ur::TEXTURE_RGBA8 && dst_fmt == ur::TEXTURE_RGBA16F) {
+		PixelConvert::UnormToFloat(src, dstf, count * 4);
+		return true;
+	}
+	if (src_fmt == ur::TEXTURE_RGB && (dst_fmt == ur::TEXTURE_RGB16F || dst_fmt == ur::TEXTURE_RGB32F)) {
+		PixelConvert::UnormToFloat(src, dstf, count * 3);
+		return true;
+	}
+	if ((src_fmt == ur::TEXTURE_RGB16F || src_fmt == ur::TEXTURE_RGB32F) &&
+		(dst_fmt == ur::TEXTURE_RGB16F || dst_fmt == ur::TEXTURE_RGB32F)) {
+		memmove(dst, src, count * 12);
+		return true;
+	}
+
+	return false;
+}
+
+}
+
+namespace ur
+{
+
+int PixelConvert::PixelSize(TEXTURE_FORMAT fmt)
+{
+	switch (fmt)
+	{
+	case TEXTURE_A8:
+	case TEXTURE_RED:
+		return 1;
+	case TEXTURE_RGBA4:
+	case TEXTURE_RGB565:
+	case TEXTURE_R16:
+		return 2;
+	case TEXTURE_RGB:
+	case TEXTURE_BGR_EXT:
+		return 3;
+	case TEXTURE_RGBA8:
+	case TEXTURE_BGRA_EXT:
+		return 4;
+	case TEXTURE_RG16F:
+		return 8;
+	case TEXTURE_RGB16F:
+	case TEXTURE_RGB32F:
+		return 12;
+	case TEXTURE_RGBA16F:
+		return 16;
+	default:
+		// depth and compressed
+		return 0;
+	}
+}
+
+bool PixelConvert::IsSupported(TEXTURE_FORMAT src, TEXTURE_FORMAT dst)
+{
+	return PixelSize(src) != 0 && PixelSize(dst) != 0;
+}
+
+bool PixelConvert::Convert(const void* src, TEXTURE_FORMAT src_fmt, void* dst,
+	                       TEXTURE_FORMAT dst_fmt, size_t count, uint32_t ops)
+{
+	if (!IsSupported(src_fmt, dst_fmt)) {
+		return false;
+	}
+
+	auto s = static_cast<const uint8_t*>(src);
+	auto d = static_cast<uint8_t*>(dst);
+	const size_t src_bpp = PixelSize(src_fmt);
+	const size_t dst_bpp = PixelSize(dst_fmt);
+	assert(s == d ? src_bpp == dst_bpp : (s + count * src_bpp <= d || d + count * dst_bpp <= s));
+
+	if (src_fmt == dst_fmt && ops == OP_NONE)
+	{
+		if (s != d) {
+			memcpy(d, s, count * src_bpp);
+		}
+		return true;
+	}
+
+	if (convert_fast(s, src_fmt, d, dst_fmt, count, ops)) {
+		return true;
+	}
+
+	float rgba[GENERIC_CHUNK * 4];
+	for (size_t i = 0; i < count; i += GENERIC_CHUNK)
+	{
+		const size_t n = std::min(GENERIC_CHUNK, count - i);
+		decode(s + i * src_bpp, src_fmt, rgba, n, (ops & OP_SRGB_TO_LINEAR) != 0);
+		if (ops & OP_PREMULTIPLY) {
+			for (size_t j = 0; j < n; ++j) {
+				float* p = rgba + j * 4;
+				p[0] *= p[3];
+				p[1] *= p[3];
+				p[2] *= p[3];
+			}
+		}
+		encode(rgba, dst_fmt, d + i * dst_bpp, n);
+	}
+
+	return true;
+}
+
+const void* PixelConvert::Prepare(const void* src, TEXTURE_FORMAT src_fmt, TEXTURE_FORMAT dst_fmt,
+	                              int width, int height, uint32_t ops)
+{
+	if (!src || (src_fmt == dst_fmt && ops == OP_NONE)) {
+		return src;
+	}
+
+	if (!IsSupported(src_fmt, dst_fmt)) {
+		assert(0);
+		return nullptr;
+	}
+
+	const size_t count = static_cast<size_t>(width) * height;
+	m_scratch.resize(count * PixelSize(dst_fmt));
+	Convert(src, src_fmt, m_scratch.data(), dst_fmt, count, ops);
+	return m_scratch.data();
+}
+
+void PixelConvert::SwizzleRB(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+#ifdef PIXEL_CONVERT_AVX2
+	{
+		const __m256i ag_mask = _mm256_set1_epi32(0xff00ff00u);
+		const __m256i rb_mask = _mm256_set1_epi32(0x00ff00ffu);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+			__m256i rb = _mm256_and_si256(px, rb_mask);
+			__m256i out = _mm256_or_si256(_mm256_and_si256(px, ag_mask),
+				_mm256_or_si256(_mm256_slli_epi32(rb, 16), _mm256_srli_epi32(rb, 16)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), out);
+		}
+	}
+#endif // PIXEL_CONVERT_AVX2
+#if defined(PIXEL_CONVERT_SSE2)
+	{
+		const __m128i ag_mask = _mm_set1_epi32(0xff00ff00u);
+		const __m128i rb_mask = _mm_set1_epi32(0x00ff00ffu);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			__m128i rb = _mm_and_si128(px, rb_mask);
+			__m128i out = _mm_or_si128(_mm_and_si128(px, ag_mask),
+				_mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), out);
+		}
+	}
+#elif defined(PIXEL_CONVERT_NEON)
+	for (; i + 16 <= count; i += 16)
+	{
+		uint8x16x4_t px = vld4q_u8(src + i * 4);
+		uint8x16_t r = px.val[0];
+		px.val[0] = px.val[2];
+		px.val[2] = r;
+		vst4q_u8(dst + i * 4, px);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const uint8_t* s = src + i * 4;
+		uint8_t* d = dst + i * 4;
+		const uint8_t r = s[0];
+		d[0] = s[2];
+		d[1] = s[1];
+		d[2] = r;
+		d[3] = s[3];
+	}
+}
+
+void PixelConvert::PadRGB(const uint8_t* src, uint8_t* dst, size_t count, bool swap_rb)
+{
+	size_t i = 0;
+#if defined(PIXEL_CONVERT_SSSE3)
+	{
+		const __m128i shuffle = swap_rb
+			? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+			: _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alpha = _mm_set1_epi32(0xff000000u);
+		// 16 byte loads, keep 4 bytes of the source ahead
+		for (; i + 6 <= count; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+			px = _mm_or_si128(_mm_shuffle_epi8(px, shuffle), alpha);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), px);
+		}
+	}
+#elif defined(PIXEL_CONVERT_NEON)
+	for (; i + 16 <= count; i += 16)
+	{
+		uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+		uint8x16x4_t px;
+		px.val[0] = swap_rb ? rgb.val[2] : rgb.val[0];
+		px.val[1] = rgb.val[1];
+		px.val[2] = swap_rb ? rgb.val[0] : rgb.val[2];
+		px.val[3] = vdupq_n_u8(255);
+		vst4q_u8(dst + i * 4, px);
+	}
+#endif
+	const int r = swap_rb ? 2 : 0;
+	const int b = swap_rb ? 0 : 2;
+	for (; i < count; ++i)
+	{
+		const uint8_t* s = src + i * 3;
+		uint8_t* d = dst + i * 4;
+		d[0] = s[r];
+		d[1] = s[1];
+		d[2] = s[b];
+		d[3] = 255;
+	}
+}
+
+void PixelConvert::PackRGBA4(const uint8_t* src, uint16_t* dst, size_t count)
+{
+	size_t i = 0;
+#if defined(PIXEL_CONVERT_SSE2)
+	{
+		const __m128i mask = _mm_set1_epi32(0xff);
+		auto pack4 = [&](const uint8_t* p) {
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i r = quantize_epi32(_mm_and_si128(px, mask), 15);
+			__m128i g = quantize_epi32(_mm_and_si128(_mm_srli_epi32(px, 8), mask), 15);
+			__m128i b = quantize_epi32(_mm_and_si128(_mm_srli_epi32(px, 16), mask), 15);
+			__m128i a = quantize_epi32(_mm_srli_epi32(px, 24), 15);
+			return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 12), _mm_slli_epi32(g, 8)),
+				_mm_or_si128(_mm_slli_epi32(b, 4), a));
+		};
+		for (; i + 8 <= count; i += 8) {
+			__m128i out = pack_u32_u16(pack4(src + i * 4), pack4(src + i * 4 + 16));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), out);
+		}
+	}
+#elif defined(PIXEL_CONVERT_NEON)
+	{
+		const uint8x8_t m = vdup_n_u8(15);
+		for (; i + 8 <= count; i += 8)
+		{
+			uint8x8x4_t px = vld4_u8(src + i * 4);
+			uint16x8_t r = vmovl_u8(div255_u16(vmull_u8(px.val[0], m)));
+			uint16x8_t g = vmovl_u8(div255_u16(vmull_u8(px.val[1], m)));
+			uint16x8_t b = vmovl_u8(div255_u16(vmull_u8(px.val[2], m)));
+			uint16x8_t a = vmovl_u8(div255_u16(vmull_u8(px.val[3], m)));
+			uint16x8_t out = vorrq_u16(vorrq_u16(vshlq_n_u16(r, 12), vshlq_n_u16(g, 8)),
+				vorrq_u16(vshlq_n_u16(b, 4), a));
+			vst1q_u16(dst + i, out);
+		}
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const uint8_t* s = src + i * 4;
+		dst[i] = static_cast<uint16_t>(div255(s[0] * 15) << 12 | div255(s[1] * 15) << 8
+			| div255(s[2] * 15) << 4 | div255(s[3] * 15));
+	}
+}
+
+void PixelConvert::PackRGB565(const uint8_t* src, uint16_t* dst, size_t count)
+{
+	size_t i = 0;
+#if defined(PIXEL_CONVERT_SSE2)
+	{
+		const __m128i mask = _mm_set1_epi32(0xff);
+		auto pack4 = [&](const uint8_t* p) {
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i r = quantize_epi32(_mm_and_si128(px, mask), 31);
+			__m128i g = quantize_epi32(_mm_and_si128(_mm_srli_epi32(px, 8), mask), 63);
+			__m128i b = quantize_epi32(_mm_and_si128(_mm_srli_epi32(px, 16), mask), 31);
+			return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 11), _mm_slli_epi32(g, 5)), b);
+		};
+		for (; i + 8 <= count; i += 8) {
+			__m128i out = pack_u32_u16(pack4(src + i * 4), pack4(src + i * 4 + 16));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), out);
+		}
+	}
+#elif defined(PIXEL_CONVERT_NEON)
+	for (; i + 8 <= count; i += 8)
+	{
+		uint8x8x4_t px = vld4_u8(src + i * 4);
+		uint16x8_t r = vmovl_u8(div255_u16(vmull_u8(px.val[0], vdup_n_u8(31))));
+		uint16x8_t g = vmovl_u8(div255_u16(vmull_u8(px.val[1], vdup_n_u8(63))));
+		uint16x8_t b = vmovl_u8(div255_u16(vmull_u8(px.val[2], vdup_n_u8(31))));
+		vst1q_u16(dst + i, vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const uint8_t* s = src + i * 4;
+		dst[i] = static_cast<uint16_t>(div255(s[0] * 31) << 11 | div255(s[1] * 63) << 5 | div255(s[2] * 31));
+	}
+}
+
+void PixelConvert::Premultiply(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+#ifdef PIXEL_CONVERT_AVX2
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i rgb_mask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+		const __m256i a_one = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+		auto mul = [&](__m256i px) {
+			__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			a = _mm256_or_si256(_mm256_and_si256(a, rgb_mask), a_one);
+			__m256i v = _mm256_add_epi16(_mm256_mullo_epi16(px, a), _mm256_set1_epi16(128));
+			return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+		};
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+			__m256i lo = mul(_mm256_unpacklo_epi8(px, zero));
+			__m256i hi = mul(_mm256_unpackhi_epi8(px, zero));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+		}
+	}
+#endif // PIXEL_CONVERT_AVX2
+#if defined(PIXEL_CONVERT_SSE2)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			__m128i lo = premultiply_epi16(_mm_unpacklo_epi8(px, zero));
+			__m128i hi = premultiply_epi16(_mm_unpackhi_epi8(px, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+		}
+	}
+#elif defined(PIXEL_CONVERT_NEON)
+	for (; i + 8 <= count; i += 8)
+	{
+		uint8x8x4_t px = vld4_u8(src + i * 4);
+		px.val[0] = div255_u16(vmull_u8(px.val[0], px.val[3]));
+		px.val[1] = div255_u16(vmull_u8(px.val[1], px.val[3]));
+		px.val[2] = div255_u16(vmull_u8(px.val[2], px.val[3]));
+		vst4_u8(dst + i * 4, px);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const uint8_t* s = src + i * 4;
+		uint8_t* d = dst + i * 4;
+		const uint32_t a = s[3];
+		d[0] = static_cast<uint8_t>(div255(s[0] * a));
+		d[1] = static_cast<uint8_t>(div255(s[1] * a));
+		d[2] = static_cast<uint8_t>(div255(s[2] * a));
+		d[3] = static_cast<uint8_t>(a);
+	}
+}
+
+void PixelConvert::SrgbToLinear(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	// a table lookup per channel, there is no gather worth using below avx2
+	const uint8_t* lut = tables().srgb8;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint8_t* s = src + i * 4;
+		uint8_t* d = dst + i * 4;
+		d[0] = lut[s[0]];
+		d[1] = lut[s[1]];
+		d[2] = lut[s[2]];
+		d[3] = s[3];
+	}
+}
+
+void PixelConvert::UnormToFloat(const uint8_t* src, float* dst, size_t count)
+{
+	size_t i = 0;
+#ifdef PIXEL_CONVERT_AVX2
+	{
+		const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+		}
+	}
+#endif // PIXEL_CONVERT_AVX2
+#if defined(PIXEL_CONVERT_SSE2)
+	{
+		const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+			_mm_storeu_ps(dst + i,      _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+			_mm_storeu_ps(dst + i + 4,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+			_mm_storeu_ps(dst + i + 8,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+			_mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+		}
+	}
+#elif defined(PIXEL_CONVERT_NEON)
+	for (; i + 8 <= count; i += 8)
+	{
+		uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+		vst1q_f32(dst + i,     vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), 1.0f / 255.0f));
+		vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), 1.0f / 255.0f));
+	}
+#endif
+	const float* lut = tables().unorm;
+	for (; i < count; ++i) {
+		dst[i] = lut[src[i]];
+	}
+}
+
+void PixelConvert::FloatToHalf(const float* src, uint16_t* dst, size_t count)
+{
+	size_t i = 0;
+#if defined(PIXEL_CONVERT_F16C)
+	for (; i + 8 <= count; i += 8) {
+		__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+	}
+#endif // PIXEL_CONVERT_F16C
+#if defined(PIXEL_CONVERT_SSE2)
+	for (; i + 8 <= count; i += 8) {
+		__m128i lo = float_to_half_epi32(_mm_loadu_ps(src + i));
+		__m128i hi = float_to_half_epi32(_mm_loadu_ps(src + i + 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), pack_u32_u16(lo, hi));
+	}
+#elif defined(PIXEL_CONVERT_NEON) && defined(__aarch64__)
+	for (; i + 4 <= count; i += 4) {
+		vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+	}
+#endif
+	for (; i < count; ++i) {
+		dst[i] = float_to_half(src[i]);
+	}
+}
+
+void PixelConvert::HalfToFloat(const uint16_t* src, float* dst, size_t count)
+{
+	size_t i = 0;
+#if defined(PIXEL_CONVERT_F16C)
+	for (; i + 8 <= count; i += 8) {
+		__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+	}
+#endif // PIXEL_CONVERT_F16C
+#if defined(PIXEL_CONVERT_SSE2)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= count; i += 8) {
+			__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_ps(dst + i,     half_to_float_ps(_mm_unpacklo_epi16(h, zero)));
+			_mm_storeu_ps(dst + i + 4, half_to_float_ps(_mm_unpackhi_epi16(h, zero)));
+		}
+	}
+#elif defined(PIXEL_CONVERT_NEON) && defined(__aarch64__)
+	for (; i + 4 <= count; i += 4) {
+		vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+	}
+#endif
+	for (; i < count; ++i) {
+		dst[i] = half_to_float(src[i]);
+	}
+}
+
+const char* PixelConvert::Target()
+{
+#if defined(PIXEL_CONVERT_AVX2)
+	return "avx2";
+#elif defined(PIXEL_CONVERT_SSE2)
+	return "sse2";
+#elif defined(PIXEL_CONVERT_NEON)
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
+
+std::vector<PixelConvert::BenchResult> PixelConvert::Benchmark(size_t count, int rounds)
+{
+	std::vector<uint8_t> src(count * 16), dst(count * 16);
+	for (size_t i = 0; i < src.size(); ++i) {
+		src[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+	}
+	std::vector<float> fsrc(count * 4);
+	UnormToFloat(src.data(), fsrc.data(), count * 4);
+
+	auto u8 = src.data();
+	auto d8 = dst.data();
+	auto d16 = reinterpret_cast<uint16_t*>(dst.data());
+	auto df = reinterpret_cast<float*>(dst.data());
+
+	std::vector<BenchResult> results;
+	auto run = [&](const char* name, const std::function<void()>& kernel)
+	{
+		double best = 0;
+		for (int i = 0; i < rounds; ++i)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			kernel();
+			double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			if (sec > 0) {
+				best = std::max(best, count / sec);
+			}
+		}
+		results.push_back({ name, static_cast<float>(best / 1e6) });
+	};
+
+	run("swizzle_rb",       [&]() { SwizzleRB(u8, d8, count); });
+	run("pad_rgb",          [&]() { PadRGB(u8, d8, count, false); });
+	run("pack_rgba4",       [&]() { PackRGBA4(u8, d16, count); });
+	run("pack_rgb565",      [&]() { PackRGB565(u8, d16, count); });
+	run("premultiply",      [&]() { Premultiply(u8, d8, count); });
+	run("srgb_to_linear",   [&]() { SrgbToLinear(u8, d8, count); });
+	run("unorm_to_float",   [&]() { UnormToFloat(u8, df, count * 4); });
+	run("float_to_half",    [&]() { FloatToHalf(fsrc.data(), d16, count * 4); });
+	run("half_to_float",    [&]() { HalfToFloat(reinterpret_cast<const uint16_t*>(u8), df, count * 4); });
+	run("generic_565_to_rgba4", [&]() {
+		Convert(u8, TEXTURE_RGB565, d8, TEXTURE_RGBA4, count, OP_PREMULTIPLY);
+	});
+
+	return results;
+}
+
+}
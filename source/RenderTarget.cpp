@@ -61,10 +61,9 @@ void RenderTarget::Resize(int width, int height)
 		return;
 	}
 
-	m_color_tex = std::make_unique<Texture>();
+	// the old storage goes back to the context's texture pool
 	m_color_tex->Upload(m_rc, width, height);
 	if (m_depth_tex) {
-		m_depth_tex = std::make_unique<Texture>();
 		m_depth_tex->Upload(m_rc, width, height, TEXTURE_DEPTH, nullptr, TEXTURE_REPEAT, TEXTURE_NEAREST);
 	}
 }
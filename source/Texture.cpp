@@ -1,6 +1,7 @@
 #include "unirender/Texture.h"
 #include "unirender/RenderContext.h"
 #include "unirender/Utility.h"
+#include "unirender/PixelConvert.h"
 
 #include <stdint.h>
 #include <string.h>
@@ -30,6 +31,10 @@ Texture::Texture(RenderContext* rc, int width, int height,
 Texture::~Texture()
 {
 	if (m_texid != 0) {
+		// the reloader refers to this, the id may outlive it when shared
+		if (m_retain_source) {
+			m_rc->RemoveTextureReloader(m_texid, this);
+		}
 		m_rc->ReleaseTexture(m_texid);
 	}
 }
@@ -37,29 +42,98 @@ Texture::~Texture()
 void Texture::Upload(RenderContext* rc, int width, int height, TEXTURE_FORMAT format,
 	                 const void* filling, TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
 {
-	if (m_texid != 0) {
+	// an id shared by the dedup table is left to its other owners
+	bool reuse = m_texid != 0 && m_rc == rc && !m_rc->IsTextureShared(m_texid)
+		&& m_width == width && m_height == height && m_format == format
+		&& m_wrap == wrap && m_filter == filter;
+
+	if (m_texid != 0 && !reuse) {
+		// the reloader refers to this, the id may outlive it when shared
+		if (m_retain_source) {
+			m_rc->RemoveTextureReloader(m_texid, this);
+		}
 		m_rc->ReleaseTexture(m_texid);
 	}
 	m_rc = rc;
 	m_width  = width;
 	m_height = height;
 	m_format = format;
+	m_wrap   = wrap;
+	m_filter = filter;
 
-	if (filling == nullptr)
+	if (reuse)
 	{
-		size_t sz = Utility::CalcTextureSize(m_format, m_width, m_height);
-		uint8_t* pixels = new uint8_t[sz];
-		memset(pixels, 0, sz);
-
-		m_texid = m_rc->CreateTexture(pixels, m_width, m_height, m_format, 0, wrap, filter);
-
-		delete[] pixels;
+		if (filling) {
+			m_rc->UpdateSubTexture(filling, 0, 0, m_width, m_height, m_texid);
+		} else {
+			m_rc->ClearTexture(m_texid);
+		}
+	}
+	else if (filling == nullptr)
+	{
+		m_texid = m_rc->CreateTexture(nullptr, m_width, m_height, m_format, 0, wrap, filter);
+		m_rc->ClearTexture(m_texid);
 	}
 	else
 	{
 		m_texid = m_rc->CreateTexture(filling, m_width, m_height, m_format, 0, wrap, filter);
 	}
 
+	m_source.clear();
+	if (m_retain_source)
+	{
+		// empty source reloads as zero
+		if (filling) {
+			size_t sz = Utility::CalcClientSize(m_format, m_width, m_height);
+			m_source.assign(static_cast<const uint8_t*>(filling), static_cast<const uint8_t*>(filling) + sz);
+		}
+		m_rc->SetTextureReloader(m_texid, [this](int id)
+		{
+			if (m_source.empty()) {
+				m_rc->UpdateTexture(id, nullptr, m_width, m_height, 0, 0, m_wrap, m_filter);
+				m_rc->ClearTexture(id);
+			} else {
+				m_rc->UpdateTexture(id, m_source.data(), m_width, m_height, 0, 0, m_wrap, m_filter);
+			}
+		}, this);
+	}
+}
+
+void Texture::Upload(RenderContext* rc, int width, int height, TEXTURE_FORMAT format, const void* filling,
+	                 TEXTURE_FORMAT src_format, uint32_t ops, TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
+{
+	PixelConvert conv;
+	Upload(rc, width, height, format, conv.Prepare(filling, src_format, format, width, height, ops), wrap, filter);
+}
+
+void Texture::UploadCompressed(RenderContext* rc, int width, int height, const void* rgba, bool alpha,
+	                           TextureCompressor::Preset preset, TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
+{
+	TEXTURE_FORMAT format = TEXTURE_INVALID;
+	if (rgba && width % 4 == 0 && height % 4 == 0) {
+		format = TextureCompressor::ChooseFormat(*rc, alpha);
+	}
+
+	std::vector<uint8_t> blocks;
+	if (format != TEXTURE_INVALID &&
+		TextureCompressor::Compress(static_cast<const uint8_t*>(rgba), width, height, format, blocks, preset)) {
+		Upload(rc, width, height, format, blocks.data(), wrap, filter);
+	} else {
+		Upload(rc, width, height, TEXTURE_RGBA8, rgba, wrap, filter);
+	}
+}
+
+void Texture::RetainSource(bool retain)
+{
+	if (m_retain_source && !retain)
+	{
+		if (m_texid != 0) {
+			m_rc->SetTextureReloader(m_texid, nullptr, this);
+		}
+		m_source.clear();
+		m_source.shrink_to_fit();
+	}
+	m_retain_source = retain;
 }
 
 }
\ No newline at end of file
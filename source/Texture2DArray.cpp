@@ -0,0 +1,66 @@
+#include "unirender/Texture2DArray.h"
+#include "unirender/RenderContext.h"
+
+#include <assert.h>
+
+namespace ur
+{
+
+Texture2DArray::Texture2DArray()
+	: m_rc(nullptr)
+	, m_width(0)
+	, m_height(0)
+	, m_layers(0)
+	, m_format(TEXTURE_INVALID)
+	, m_texid(0)
+{
+}
+
+Texture2DArray::Texture2DArray(RenderContext* rc, int width, int height, int layers,
+	                           TEXTURE_FORMAT format, unsigned int texid)
+	: m_rc(rc)
+	, m_width(width)
+	, m_height(height)
+	, m_layers(layers)
+	, m_format(format)
+	, m_texid(texid)
+{
+}
+
+Texture2DArray::~Texture2DArray()
+{
+	if (m_texid != 0) {
+		m_rc->ReleaseTexture(m_texid);
+	}
+}
+
+void Texture2DArray::Upload(RenderContext* rc, int width, int height, int layers, TEXTURE_FORMAT format,
+	                        const void* filling, TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
+{
+	if (m_texid != 0) {
+		m_rc->ReleaseTexture(m_texid);
+	}
+	m_rc = rc;
+	m_width  = width;
+	m_height = height;
+	m_layers = layers;
+	m_format = format;
+
+	m_texid = m_rc->CreateTexture2DArray(filling, m_width, m_height, m_layers, m_format, 0, wrap, filter);
+	if (filling == nullptr) {
+		m_rc->ClearTexture(m_texid);
+	}
+}
+
+void Texture2DArray::UploadLayer(int layer, const void* pixels)
+{
+	UpdateLayer(layer, pixels, 0, 0, m_width, m_height);
+}
+
+void Texture2DArray::UpdateLayer(int layer, const void* pixels, int x, int y, int w, int h)
+{
+	assert(m_texid != 0 && layer >= 0 && layer < m_layers);
+	m_rc->UpdateSubTexture(pixels, x, y, w, h, m_texid, layer);
+}
+
+}
@@ -1,6 +1,11 @@
 #include "unirender/Texture3D.h"
 #include "unirender/RenderContext.h"
 #include "unirender/Utility.h"
+#include "unirender/PixelConvert.h"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
 
 #include <stdint.h>
 #include <string.h>
@@ -48,21 +53,62 @@ void Texture3D::Upload(RenderContext* rc, int width, int height, int depth, TEXT
 	m_depth  = depth;
 	m_format = format;
 
-	if (filling == nullptr)
-	{
-		size_t sz = Utility::CalcTextureSize(m_format, m_width, m_height, m_depth);
-		uint8_t* pixels = new uint8_t[sz];
-		memset(pixels, 0, sz);
+	m_texid = m_rc->CreateTexture3D(filling, m_width, m_height, m_depth, m_format);
+	// no cpu volume of zeros, large ones are streamed in afterwards
+	if (filling == nullptr && m_texid != 0) {
+		m_rc->ClearTexture(m_texid);
+	}
+}
 
-		m_texid = m_rc->CreateTexture3D(pixels, m_width, m_height, m_depth, m_format);
+void Texture3D::UploadSlices(int z, int count, const void* pixels)
+{
+	if (m_texid == 0 || !pixels || z < 0 || count <= 0 || z + count > m_depth) {
+		return;
+	}
+	m_rc->UpdateSubTexture3D(pixels, 0, 0, z, m_width, m_height, count, m_texid);
+}
 
-		delete[] pixels;
+bool Texture3D::Stream(const std::function<const void*(int z, int count)>& fetch, int batch)
+{
+	if (m_texid == 0 || !fetch) {
+		return false;
 	}
-	else
+
+	batch = std::max(batch, 1);
+	for (int z = 0; z < m_depth; z += batch)
 	{
-		m_texid = m_rc->CreateTexture3D(filling, m_width, m_height, m_depth, m_format);
+		const int n = std::min(batch, m_depth - z);
+		const void* pixels = fetch(z, n);
+		if (!pixels) {
+			return false;
+		}
+		UploadSlices(z, n, pixels);
+	}
+	return true;
+}
+
+bool Texture3D::StreamFile(const std::string& filepath, size_t offset, int batch)
+{
+	std::ifstream fin(filepath, std::ios::binary);
+	if (fin.fail()) {
+		return false;
 	}
+	fin.seekg(offset);
+
+	batch = std::max(batch, 1);
+	std::vector<uint8_t> buf(SliceSize() * std::min(batch, m_depth));
+	return Stream([&](int, int count) -> const void* {
+		fin.read(reinterpret_cast<char*>(buf.data()), SliceSize() * count);
+		return fin.fail() ? nullptr : buf.data();
+	}, batch);
+}
 
+size_t Texture3D::SliceSize() const
+{
+	// the 16F formats are read as floats, wider than CalcTextureSize says
+	const int bpp = PixelConvert::PixelSize(m_format);
+	return bpp > 0 ? static_cast<size_t>(bpp) * m_width * m_height
+		: Utility::CalcTextureSize(m_format, m_width, m_height);
 }
 
 }
\ No newline at end of file
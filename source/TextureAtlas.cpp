@@ -0,0 +1,448 @@
+#include "unirender/TextureAtlas.h"
+#include "unirender/RenderContext.h"
+#include "unirender/Texture.h"
+#include "unirender/PixelBuffer.h"
+#include "unirender/Utility.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+#include <limits.h>
+
+namespace
+{
+
+// upload the dirty rects one by one up to this, then their bounding box
+const size_t MAX_PAGE_UPLOADS = 16;
+
+}
+
+namespace ur
+{
+
+TextureAtlas::TextureAtlas(RenderContext* rc, int page_width, int page_height,
+	                       TEXTURE_FORMAT format, int max_pages, int padding)
+	: m_rc(rc)
+	, m_page_width(page_width)
+	, m_page_height(page_height)
+	, m_format(format)
+	, m_max_pages(std::max(max_pages, 1))
+	, m_padding(padding)
+{
+	// rows are copied by byte, no block compressed formats, the 16F ones
+	// are read as floats
+	m_bpp = Utility::CalcClientSize(m_format, 1, 1);
+	assert(m_bpp > 0);
+}
+
+TextureAtlas::~TextureAtlas()
+{
+}
+
+bool TextureAtlas::Insert(uint64_t key, int w, int h, const void* pixels, Region* region)
+{
+	if (w <= 0 || h <= 0 || w + m_padding > m_page_width || h + m_padding > m_page_height) {
+		return false;
+	}
+
+	auto itr = m_entries.find(key);
+	if (itr != m_entries.end() && (itr->second.w != w || itr->second.h != h)) {
+		Remove(key);
+		itr = m_entries.end();
+	}
+
+	if (itr == m_entries.end())
+	{
+		Entry e;
+		if (!Allocate(w, h, e.page, e.x, e.y)) {
+			return false;
+		}
+		e.w = w;
+		e.h = h;
+		e.lru = m_lru.insert(m_lru.end(), key);
+		itr = m_entries.insert({ key, e }).first;
+	}
+
+	auto& e = itr->second;
+	Touch(e);
+
+	auto& page = *m_pages[e.page];
+	const size_t row = w * m_bpp;
+	auto src = static_cast<const uint8_t*>(pixels);
+	for (int i = 0; i < h; ++i) {
+		uint8_t* dst = &page.shadow[((e.y + i) * m_page_width + e.x) * m_bpp];
+		if (src) {
+			memcpy(dst, src + i * row, row);
+		} else {
+			memset(dst, 0, row);
+		}
+	}
+	page.dirty.push_back({ e.x, e.y, w, h });
+
+	if (region) {
+		FillRegion(e, *region);
+	}
+
+	return true;
+}
+
+bool TextureAtlas::Query(uint64_t key, Region& region)
+{
+	auto itr = m_entries.find(key);
+	if (itr == m_entries.end()) {
+		return false;
+	}
+
+	Touch(itr->second);
+	FillRegion(itr->second, region);
+
+	return true;
+}
+
+void TextureAtlas::Remove(uint64_t key)
+{
+	auto itr = m_entries.find(key);
+	if (itr == m_entries.end()) {
+		return;
+	}
+
+	auto& e = itr->second;
+	m_pages[e.page]->freed += (e.w + m_padding) * (e.h + m_padding);
+	m_lru.erase(e.lru);
+	m_entries.erase(itr);
+}
+
+void TextureAtlas::Clear()
+{
+	m_entries.clear();
+	m_lru.clear();
+	for (auto& page : m_pages)
+	{
+		page->skyline.clear();
+		page->skyline.push_back({ 0, 0, m_page_width });
+		page->dirty.clear();
+		page->freed = 0;
+	}
+	++m_version;
+}
+
+void TextureAtlas::Flush()
+{
+	for (auto& page_ptr : m_pages)
+	{
+		auto& page = *page_ptr;
+		if (page.dirty.empty()) {
+			continue;
+		}
+
+		Rect bound = page.dirty[0];
+		size_t area = 0;
+		for (auto& r : page.dirty)
+		{
+			int xmax = std::max(bound.x + bound.w, r.x + r.w),
+				ymax = std::max(bound.y + bound.h, r.y + r.h);
+			bound.x = std::min(bound.x, r.x);
+			bound.y = std::min(bound.y, r.y);
+			bound.w = xmax - bound.x;
+			bound.h = ymax - bound.y;
+			area += r.w * r.h;
+		}
+
+		// one call for the bounding box unless it is mostly empty, staged
+		// rects never exceed the page size so they fit in its pixel buffer
+		std::vector<Rect> uploads;
+		const size_t bound_area = bound.w * bound.h;
+		if (page.dirty.size() == 1 || page.dirty.size() > MAX_PAGE_UPLOADS
+		 || bound_area <= area * 2 || area > bound_area) {
+			uploads.push_back(bound);
+		} else {
+			uploads = page.dirty;
+		}
+		page.dirty.clear();
+
+		std::vector<int> offsets;
+		offsets.reserve(uploads.size());
+		uint8_t* dst = page.pbuf->Map(WRITE_ONLY);
+		if (!dst)
+		{
+			// no mapping, upload from the cpu copy directly
+			page.pbuf->Unmap();
+			m_rc->UnbindPixelBuffer();
+			std::vector<uint8_t> buf;
+			for (auto& r : uploads)
+			{
+				buf.resize(r.w * r.h * m_bpp);
+				for (int i = 0; i < r.h; ++i) {
+					memcpy(&buf[i * r.w * m_bpp], &page.shadow[((r.y + i) * m_page_width + r.x) * m_bpp], r.w * m_bpp);
+				}
+				m_rc->UpdateSubTexture(buf.data(), r.x, r.y, r.w, r.h, page.tex->TexID());
+			}
+			continue;
+		}
+
+		int offset = 0;
+		for (auto& r : uploads)
+		{
+			offsets.push_back(offset);
+			for (int i = 0; i < r.h; ++i) {
+				memcpy(dst + offset, &page.shadow[((r.y + i) * m_page_width + r.x) * m_bpp], r.w * m_bpp);
+				offset += r.w * m_bpp;
+			}
+		}
+		for (size_t i = 0, n = uploads.size(); i < n; ++i) {
+			auto& r = uploads[i];
+			page.pbuf->Upload(r.x, r.y, r.w, r.h, offsets[i], page.tex->TexID());
+		}
+		page.pbuf->Unmap();
+		m_rc->UnbindPixelBuffer();
+	}
+}
+
+void TextureAtlas::Defragment()
+{
+	for (int i = 0, n = m_pages.size(); i < n; ++i) {
+		if (m_pages[i]->freed > 0) {
+			Repack(i);
+		}
+	}
+}
+
+const Texture& TextureAtlas::GetPage(size_t idx) const
+{
+	assert(idx < m_pages.size());
+	return *m_pages[idx]->tex;
+}
+
+int TextureAtlas::AddPage()
+{
+	auto page = std::make_unique<Page>();
+
+	page->tex = std::make_unique<Texture>();
+	page->tex->Upload(m_rc, m_page_width, m_page_height, m_format);
+	page->pbuf = PixelBuffer::Create(m_rc, m_page_width, m_page_height, m_format);
+
+	page->shadow.resize(m_page_width * m_page_height * m_bpp, 0);
+	page->skyline.push_back({ 0, 0, m_page_width });
+
+	m_pages.push_back(std::move(page));
+
+	return m_pages.size() - 1;
+}
+
+// bottom-left skyline, from fontstash
+bool TextureAtlas::Pack(Page& page, int w, int h, int& x, int& y) const
+{
+	w += m_padding;
+	h += m_padding;
+
+	auto& nodes = page.skyline;
+
+	int best_i = -1, best_x = 0, best_y = 0;
+	int best_h = INT_MAX, best_w = INT_MAX;
+	for (int i = 0, n = nodes.size(); i < n; ++i)
+	{
+		int nx = nodes[i].x;
+		if (nx + w > m_page_width) {
+			continue;
+		}
+
+		// the top of the skyline under [nx, nx + w)
+		int ny = nodes[i].y;
+		int left = w;
+		for (int j = i; left > 0; ++j) {
+			assert(j < n);
+			ny = std::max(ny, nodes[j].y);
+			left -= nodes[j].w;
+		}
+		if (ny + h > m_page_height) {
+			continue;
+		}
+
+		if (ny + h < best_h || (ny + h == best_h && nodes[i].w < best_w))
+		{
+			best_i = i;
+			best_x = nx;
+			best_y = ny;
+			best_h = ny + h;
+			best_w = nodes[i].w;
+		}
+	}
+	if (best_i < 0) {
+		return false;
+	}
+
+	nodes.insert(nodes.begin() + best_i, { best_x, best_y + h, w });
+
+	// shrink the nodes under the new one
+	for (size_t i = best_i + 1; i < nodes.size(); )
+	{
+		int cover = nodes[i - 1].x + nodes[i - 1].w - nodes[i].x;
+		if (cover <= 0) {
+			break;
+		}
+		nodes[i].x += cover;
+		nodes[i].w -= cover;
+		if (nodes[i].w <= 0) {
+			nodes.erase(nodes.begin() + i);
+		} else {
+			break;
+		}
+	}
+
+	// merge the same level
+	for (size_t i = 0; i + 1 < nodes.size(); )
+	{
+		if (nodes[i].y == nodes[i + 1].y) {
+			nodes[i].w += nodes[i + 1].w;
+			nodes.erase(nodes.begin() + i + 1);
+		} else {
+			++i;
+		}
+	}
+
+	x = best_x;
+	y = best_y;
+
+	return true;
+}
+
+bool TextureAtlas::Allocate(int w, int h, int& page, int& x, int& y)
+{
+	for (int i = 0, n = m_pages.size(); i < n; ++i) {
+		if (Pack(*m_pages[i], w, h, x, y)) {
+			page = i;
+			return true;
+		}
+	}
+
+	const int need = (w + m_padding) * (h + m_padding);
+	for (int i = 0, n = m_pages.size(); i < n; ++i)
+	{
+		if (m_pages[i]->freed < need) {
+			continue;
+		}
+		Repack(i);
+		if (Pack(*m_pages[i], w, h, x, y)) {
+			page = i;
+			return true;
+		}
+	}
+
+	if (static_cast<int>(m_pages.size()) < m_max_pages)
+	{
+		int i = AddPage();
+		if (Pack(*m_pages[i], w, h, x, y)) {
+			page = i;
+			return true;
+		}
+		return false;
+	}
+
+	// the regions in use this frame stay
+	int evicted = -1;
+	while (EvictLRU(evicted))
+	{
+		if (m_pages[evicted]->freed < need) {
+			continue;
+		}
+		Repack(evicted);
+		if (Pack(*m_pages[evicted], w, h, x, y)) {
+			page = evicted;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void TextureAtlas::Repack(int page_idx)
+{
+	auto& page = *m_pages[page_idx];
+
+	std::vector<std::pair<uint64_t, Entry*>> entries;
+	for (auto& itr : m_entries) {
+		if (itr.second.page == page_idx) {
+			entries.push_back({ itr.first, &itr.second });
+		}
+	}
+	std::sort(entries.begin(), entries.end(), [](const std::pair<uint64_t, Entry*>& a, const std::pair<uint64_t, Entry*>& b) {
+		return a.second->h > b.second->h || (a.second->h == b.second->h && a.second->w > b.second->w);
+	});
+
+	page.skyline.clear();
+	page.skyline.push_back({ 0, 0, m_page_width });
+	page.freed = 0;
+
+	std::vector<uint8_t> old(page.shadow.size(), 0);
+	old.swap(page.shadow);
+
+	std::vector<uint64_t> lost;
+	for (auto& itr : entries)
+	{
+		auto& e = *itr.second;
+		int x, y;
+		if (!Pack(page, e.w, e.h, x, y)) {
+			lost.push_back(itr.first);
+			continue;
+		}
+		for (int i = 0; i < e.h; ++i) {
+			memcpy(&page.shadow[((y + i) * m_page_width + x) * m_bpp],
+				&old[((e.y + i) * m_page_width + e.x) * m_bpp], e.w * m_bpp);
+		}
+		e.x = x;
+		e.y = y;
+	}
+	for (auto& key : lost)
+	{
+		auto itr = m_entries.find(key);
+		m_lru.erase(itr->second.lru);
+		m_entries.erase(itr);
+	}
+
+	page.dirty.clear();
+	page.dirty.push_back({ 0, 0, m_page_width, m_page_height });
+
+	++m_version;
+}
+
+bool TextureAtlas::EvictLRU(int& page)
+{
+	if (m_lru.empty()) {
+		return false;
+	}
+
+	// touched entries move to the back, so the front is the oldest
+	auto itr = m_entries.find(m_lru.front());
+	assert(itr != m_entries.end());
+	if (itr->second.last_frame >= m_rc->GetCurrFrame()) {
+		return false;
+	}
+
+	page = itr->second.page;
+	Remove(itr->first);
+	++m_version;
+
+	return true;
+}
+
+void TextureAtlas::Touch(Entry& e)
+{
+	e.last_frame = m_rc->GetCurrFrame();
+	m_lru.splice(m_lru.end(), m_lru, e.lru);
+}
+
+void TextureAtlas::FillRegion(const Entry& e, Region& region) const
+{
+	region.page = e.page;
+	region.x = e.x;
+	region.y = e.y;
+	region.w = e.w;
+	region.h = e.h;
+	region.uv[0] = static_cast<float>(e.x) / m_page_width;
+	region.uv[1] = static_cast<float>(e.y) / m_page_height;
+	region.uv[2] = static_cast<float>(e.x + e.w) / m_page_width;
+	region.uv[3] = static_cast<float>(e.y + e.h) / m_page_height;
+}
+
+}
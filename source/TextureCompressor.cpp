@@ -0,0 +1,973 @@
+#include "unirender/TextureCompressor.h"
+#include "unirender/RenderContext.h"
+
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COMPRESSOR_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TEXTURE_COMPRESSOR_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+// block rows per worker below which spawning threads is not worth it
+const int ROWS_PER_THREAD = 4;
+
+// etc1 luminance modifiers, indexed by the table codeword; pixel indices
+// 0..3 select +small, +large, -small, -large
+const int ETC_MODIFIERS[8][2] = {
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+	{ 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+const int EAC_MODIFIERS[16][8] = {
+	{ -3, -6, -9, -15, 2, 5, 8, 14 },
+	{ -3, -7, -10, -13, 2, 6, 9, 12 },
+	{ -2, -5, -8, -13, 1, 4, 7, 12 },
+	{ -2, -4, -6, -13, 1, 3, 5, 12 },
+	{ -3, -6, -8, -12, 2, 5, 7, 11 },
+	{ -3, -7, -9, -11, 2, 6, 8, 10 },
+	{ -4, -7, -8, -11, 3, 6, 7, 10 },
+	{ -3, -5, -8, -11, 2, 4, 7, 10 },
+	{ -2, -6, -8, -10, 1, 5, 7, 9 },
+	{ -2, -5, -8, -10, 1, 4, 7, 9 },
+	{ -2, -4, -8, -10, 1, 3, 7, 9 },
+	{ -2, -5, -7, -10, 1, 4, 6, 9 },
+	{ -3, -4, -7, -10, 2, 3, 6, 9 },
+	{ -1, -2, -3, -10, 0, 1, 2, 9 },
+	{ -4, -6, -8, -9, 3, 5, 7, 8 },
+	{ -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+// planar, row major
+struct Block
+{
+	float r[16], g[16], b[16], a[16];
+};
+
+void load_block(const uint8_t* rgba, int width, int height, int bx, int by, Block& blk)
+{
+	for (int y = 0; y < 4; ++y)
+	{
+		const int sy = std::min(by * 4 + y, height - 1);
+		for (int x = 0; x < 4; ++x)
+		{
+			const int sx = std::min(bx * 4 + x, width - 1);
+			const uint8_t* p = rgba + (static_cast<size_t>(sy) * width + sx) * 4;
+			const int i = y * 4 + x;
+			blk.r[i] = p[0];
+			blk.g[i] = p[1];
+			blk.b[i] = p[2];
+			blk.a[i] = p[3];
+		}
+	}
+}
+
+inline int clamp255(int v)
+{
+	return std::min(std::max(v, 0), 255);
+}
+
+inline int quantize(float v, int max)
+{
+	return static_cast<int>(std::min(std::max(v, 0.0f), 255.0f) * max / 255.0f + 0.5f);
+}
+
+// Nearest palette color per pixel, n a multiple of 4. Pixels and palette
+// are integers, so the summed squared error is exact in any lane order.
+float fit_palette(const float* r, const float* g, const float* b, int n,
+	              const float (*pal)[3], int pal_n, uint8_t* idx)
+{
+	float total = 0;
+	int i = 0;
+#if defined(TEXTURE_COMPRESSOR_SSE2)
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m128 pr = _mm_loadu_ps(r + i);
+		const __m128 pg = _mm_loadu_ps(g + i);
+		const __m128 pb = _mm_loadu_ps(b + i);
+		__m128  best   = _mm_set1_ps(FLT_MAX);
+		__m128i best_k = _mm_setzero_si128();
+		for (int k = 0; k < pal_n; ++k)
+		{
+			__m128 dr = _mm_sub_ps(pr, _mm_set1_ps(pal[k][0]));
+			__m128 dg = _mm_sub_ps(pg, _mm_set1_ps(pal[k][1]));
+			__m128 db = _mm_sub_ps(pb, _mm_set1_ps(pal[k][2]));
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			__m128i lt = _mm_castps_si128(_mm_cmplt_ps(d, best));
+			best = _mm_min_ps(d, best);
+			best_k = _mm_or_si128(_mm_and_si128(lt, _mm_set1_epi32(k)), _mm_andnot_si128(lt, best_k));
+		}
+		int32_t k4[4];
+		float e4[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(k4), best_k);
+		_mm_storeu_ps(e4, best);
+		for (int j = 0; j < 4; ++j) {
+			idx[i + j] = static_cast<uint8_t>(k4[j]);
+			total += e4[j];
+		}
+	}
+#elif defined(TEXTURE_COMPRESSOR_NEON)
+	for (; i + 4 <= n; i += 4)
+	{
+		const float32x4_t pr = vld1q_f32(r + i);
+		const float32x4_t pg = vld1q_f32(g + i);
+		const float32x4_t pb = vld1q_f32(b + i);
+		float32x4_t best   = vdupq_n_f32(FLT_MAX);
+		uint32x4_t  best_k = vdupq_n_u32(0);
+		for (int k = 0; k < pal_n; ++k)
+		{
+			float32x4_t dr = vsubq_f32(pr, vdupq_n_f32(pal[k][0]));
+			float32x4_t dg = vsubq_f32(pg, vdupq_n_f32(pal[k][1]));
+			float32x4_t db = vsubq_f32(pb, vdupq_n_f32(pal[k][2]));
+			float32x4_t d = vmlaq_f32(vmlaq_f32(vmulq_f32(dr, dr), dg, dg), db, db);
+			uint32x4_t lt = vcltq_f32(d, best);
+			best = vbslq_f32(lt, d, best);
+			best_k = vbslq_u32(lt, vdupq_n_u32(k), best_k);
+		}
+		uint32_t k4[4];
+		float e4[4];
+		vst1q_u32(k4, best_k);
+		vst1q_f32(e4, best);
+		for (int j = 0; j < 4; ++j) {
+			idx[i + j] = static_cast<uint8_t>(k4[j]);
+			total += e4[j];
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		float best = FLT_MAX;
+		for (int k = 0; k < pal_n; ++k)
+		{
+			float dr = r[i] - pal[k][0], dg = g[i] - pal[k][1], db = b[i] - pal[k][2];
+			float d = dr * dr + dg * dg + db * db;
+			if (d < best) {
+				best = d;
+				idx[i] = static_cast<uint8_t>(k);
+			}
+		}
+		total += best;
+	}
+	return total;
+}
+
+// single channel version of fit_palette, for alpha
+float fit_values(const float* v, int n, const float* pal, int pal_n, uint8_t* idx)
+{
+	float total = 0;
+	int i = 0;
+#if defined(TEXTURE_COMPRESSOR_SSE2)
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m128 pv = _mm_loadu_ps(v + i);
+		__m128  best   = _mm_set1_ps(FLT_MAX);
+		__m128i best_k = _mm_setzero_si128();
+		for (int k = 0; k < pal_n; ++k)
+		{
+			__m128 dv = _mm_sub_ps(pv, _mm_set1_ps(pal[k]));
+			__m128 d = _mm_mul_ps(dv, dv);
+			__m128i lt = _mm_castps_si128(_mm_cmplt_ps(d, best));
+			best = _mm_min_ps(d, best);
+			best_k = _mm_or_si128(_mm_and_si128(lt, _mm_set1_epi32(k)), _mm_andnot_si128(lt, best_k));
+		}
+		int32_t k4[4];
+		float e4[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(k4), best_k);
+		_mm_storeu_ps(e4, best);
+		for (int j = 0; j < 4; ++j) {
+			idx[i + j] = static_cast<uint8_t>(k4[j]);
+			total += e4[j];
+		}
+	}
+#elif defined(TEXTURE_COMPRESSOR_NEON)
+	for (; i + 4 <= n; i += 4)
+	{
+		const float32x4_t pv = vld1q_f32(v + i);
+		float32x4_t best   = vdupq_n_f32(FLT_MAX);
+		uint32x4_t  best_k = vdupq_n_u32(0);
+		for (int k = 0; k < pal_n; ++k)
+		{
+			float32x4_t dv = vsubq_f32(pv, vdupq_n_f32(pal[k]));
+			float32x4_t d = vmulq_f32(dv, dv);
+			uint32x4_t lt = vcltq_f32(d, best);
+			best = vbslq_f32(lt, d, best);
+			best_k = vbslq_u32(lt, vdupq_n_u32(k), best_k);
+		}
+		uint32_t k4[4];
+		float e4[4];
+		vst1q_u32(k4, best_k);
+		vst1q_f32(e4, best);
+		for (int j = 0; j < 4; ++j) {
+			idx[i + j] = static_cast<uint8_t>(k4[j]);
+			total += e4[j];
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		float best = FLT_MAX;
+		for (int k = 0; k < pal_n; ++k)
+		{
+			float d = (v[i] - pal[k]) * (v[i] - pal[k]);
+			if (d < best) {
+				best = d;
+				idx[i] = static_cast<uint8_t>(k);
+			}
+		}
+		total += best;
+	}
+	return total;
+}
+
+/************************************************************************/
+/* BC1 / BC2 / BC3                                                      */
+/************************************************************************/
+
+inline uint16_t pack565(const float c[3])
+{
+	return static_cast<uint16_t>(quantize(c[0], 31) << 11 | quantize(c[1], 63) << 5 | quantize(c[2], 31));
+}
+
+inline void unpack565(uint16_t v, int c[3])
+{
+	const int r = v >> 11, g = (v >> 5) & 0x3f, b = v & 0x1f;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+void bc1_palette(uint16_t c0, uint16_t c1, bool four, float pal[4][3])
+{
+	int a[3], b[3];
+	unpack565(c0, a);
+	unpack565(c1, b);
+	for (int i = 0; i < 3; ++i)
+	{
+		pal[0][i] = static_cast<float>(a[i]);
+		pal[1][i] = static_cast<float>(b[i]);
+		if (four) {
+			pal[2][i] = static_cast<float>((2 * a[i] + b[i] + 1) / 3);
+			pal[3][i] = static_cast<float>((a[i] + 2 * b[i] + 1) / 3);
+		} else {
+			pal[2][i] = static_cast<float>((a[i] + b[i] + 1) / 2);
+			pal[3][i] = 0;
+		}
+	}
+}
+
+// endpoints along the principal axis of the colors, inset by 1/16 of
+// the extent against the quantization
+void principal_endpoints(const float* r, const float* g, const float* b, int n, float lo[3], float hi[3])
+{
+	const float* ch[3] = { r, g, b };
+
+	float mean[3] = { 0, 0, 0 };
+	float cmin[3] = { 255, 255, 255 }, cmax[3] = { 0, 0, 0 };
+	for (int c = 0; c < 3; ++c) {
+		for (int i = 0; i < n; ++i) {
+			mean[c] += ch[c][i];
+			cmin[c] = std::min(cmin[c], ch[c][i]);
+			cmax[c] = std::max(cmax[c], ch[c][i]);
+		}
+		mean[c] /= n;
+	}
+
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < n; ++i)
+	{
+		float d[3] = { r[i] - mean[0], g[i] - mean[1], b[i] - mean[2] };
+		cov[0] += d[0] * d[0];
+		cov[1] += d[0] * d[1];
+		cov[2] += d[0] * d[2];
+		cov[3] += d[1] * d[1];
+		cov[4] += d[1] * d[2];
+		cov[5] += d[2] * d[2];
+	}
+
+	// power iteration from the bounding box diagonal
+	float axis[3] = { cmax[0] - cmin[0], cmax[1] - cmin[1], cmax[2] - cmin[2] };
+	for (int iter = 0; iter < 8; ++iter)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float m = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+		if (m < 1e-6f) {
+			break;
+		}
+		axis[0] = x / m;
+		axis[1] = y / m;
+		axis[2] = z / m;
+	}
+	float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	if (len2 < 1e-6f)
+	{
+		memcpy(lo, mean, sizeof(mean));
+		memcpy(hi, mean, sizeof(mean));
+		return;
+	}
+
+	float tmin = FLT_MAX, tmax = -FLT_MAX;
+	for (int i = 0; i < n; ++i) {
+		float t = ((r[i] - mean[0]) * axis[0] + (g[i] - mean[1]) * axis[1] + (b[i] - mean[2]) * axis[2]) / len2;
+		tmin = std::min(tmin, t);
+		tmax = std::max(tmax, t);
+	}
+	const float inset = (tmax - tmin) / 16;
+	tmin += inset;
+	tmax -= inset;
+	for (int c = 0; c < 3; ++c) {
+		lo[c] = std::min(std::max(mean[c] + axis[c] * tmin, 0.0f), 255.0f);
+		hi[c] = std::min(std::max(mean[c] + axis[c] * tmax, 0.0f), 255.0f);
+	}
+}
+
+// least squares endpoints for the given indices, false if degenerate
+bool refine_endpoints(const Block& blk, const uint8_t* idx, bool four, uint16_t& c0, uint16_t& c1)
+{
+	static const float W4[4] = { 1, 0, 2.0f / 3, 1.0f / 3 };
+	static const float W3[4] = { 1, 0, 0.5f, 0 };
+
+	float aa = 0, bb = 0, ab = 0;
+	float ra[3] = { 0, 0, 0 }, rb[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+	{
+		if (!four && idx[i] == 3) {
+			continue;
+		}
+		const float w = four ? W4[idx[i]] : W3[idx[i]];
+		const float v = 1 - w;
+		aa += w * w;
+		bb += v * v;
+		ab += w * v;
+		const float p[3] = { blk.r[i], blk.g[i], blk.b[i] };
+		for (int c = 0; c < 3; ++c) {
+			ra[c] += w * p[c];
+			rb[c] += v * p[c];
+		}
+	}
+
+	const float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f) {
+		return false;
+	}
+
+	float e0[3], e1[3];
+	for (int c = 0; c < 3; ++c) {
+		e0[c] = (bb * ra[c] - ab * rb[c]) / det;
+		e1[c] = (aa * rb[c] - ab * ra[c]) / det;
+	}
+	c0 = pack565(e0);
+	c1 = pack565(e1);
+	return true;
+}
+
+// Orders the endpoints for the mode and fits the indices; transparent
+// pixels, only in the 3 color mode, get index 3.
+float bc1_fit(const Block& blk, const bool* transparent, uint16_t& c0, uint16_t& c1, bool four, uint8_t* idx)
+{
+	if (four ? c0 < c1 : c0 > c1) {
+		std::swap(c0, c1);
+	}
+
+	float pal[4][3];
+	bc1_palette(c0, c1, four, pal);
+	float err = fit_palette(blk.r, blk.g, blk.b, 16, pal, four ? 4 : 3, idx);
+	if (!four) {
+		for (int i = 0; i < 16; ++i) {
+			if (transparent[i]) {
+				idx[i] = 3;
+			}
+		}
+	}
+	return err;
+}
+
+void encode_bc1(const Block& src, bool punch_through, bool quality, uint8_t* out)
+{
+	bool transparent[16];
+	int opaque = 0;
+	for (int i = 0; i < 16; ++i) {
+		transparent[i] = punch_through && src.a[i] < 128;
+		if (!transparent[i]) {
+			++opaque;
+		}
+	}
+
+	uint16_t c0 = 0, c1 = 0;
+	uint32_t bits = 0;
+	if (opaque == 0)
+	{
+		bits = 0xffffffff;
+	}
+	else
+	{
+		// transparent pixels take the color of an opaque one, so they
+		// don't pull the endpoints
+		Block blk = src;
+		const bool four = opaque == 16;
+		if (!four)
+		{
+			int first = 0;
+			while (transparent[first]) {
+				++first;
+			}
+			for (int i = 0; i < 16; ++i) {
+				if (transparent[i]) {
+					blk.r[i] = blk.r[first];
+					blk.g[i] = blk.g[first];
+					blk.b[i] = blk.b[first];
+				}
+			}
+		}
+
+		float lo[3], hi[3];
+		principal_endpoints(blk.r, blk.g, blk.b, 16, lo, hi);
+		c0 = pack565(hi);
+		c1 = pack565(lo);
+
+		uint8_t idx[16];
+		float err = bc1_fit(blk, transparent, c0, c1, four, idx);
+		if (quality)
+		{
+			for (int iter = 0; iter < 2 && err > 0; ++iter)
+			{
+				uint16_t n0, n1;
+				if (!refine_endpoints(blk, idx, four, n0, n1)) {
+					break;
+				}
+				uint8_t nidx[16];
+				float nerr = bc1_fit(blk, transparent, n0, n1, four, nidx);
+				if (nerr >= err) {
+					break;
+				}
+				err = nerr;
+				c0 = n0;
+				c1 = n1;
+				memcpy(idx, nidx, sizeof(idx));
+			}
+		}
+
+		for (int i = 0; i < 16; ++i) {
+			bits |= static_cast<uint32_t>(idx[i]) << (i * 2);
+		}
+	}
+
+	out[0] = c0 & 0xff;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;
+	out[3] = c1 >> 8;
+	for (int i = 0; i < 4; ++i) {
+		out[4 + i] = (bits >> (i * 8)) & 0xff;
+	}
+}
+
+void encode_bc2_alpha(const Block& blk, uint8_t* out)
+{
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; ++i) {
+		bits |= static_cast<uint64_t>(quantize(blk.a[i], 15)) << (i * 4);
+	}
+	for (int i = 0; i < 8; ++i) {
+		out[i] = (bits >> (i * 8)) & 0xff;
+	}
+}
+
+float bc3_alpha_fit(const Block& blk, int a0, int a1, uint8_t* idx)
+{
+	float pal[8];
+	pal[0] = static_cast<float>(a0);
+	pal[1] = static_cast<float>(a1);
+	if (a0 > a1)
+	{
+		for (int i = 1; i < 7; ++i) {
+			pal[i + 1] = static_cast<float>(((7 - i) * a0 + i * a1 + 3) / 7);
+		}
+	}
+	else
+	{
+		for (int i = 1; i < 5; ++i) {
+			pal[i + 1] = static_cast<float>(((5 - i) * a0 + i * a1 + 2) / 5);
+		}
+		pal[6] = 0;
+		pal[7] = 255;
+	}
+	return fit_values(blk.a, 16, pal, 8, idx);
+}
+
+void encode_bc3_alpha(const Block& blk, bool quality, uint8_t* out)
+{
+	float amin = 255, amax = 0;
+	for (int i = 0; i < 16; ++i) {
+		amin = std::min(amin, blk.a[i]);
+		amax = std::max(amax, blk.a[i]);
+	}
+
+	int a0 = static_cast<int>(amax), a1 = static_cast<int>(amin);
+	uint8_t idx[16];
+	float err = bc3_alpha_fit(blk, a0, a1, idx);
+
+	// six interpolated values with explicit 0 and 255, for blocks with
+	// both extremes and a cluster between
+	if (quality && err > 0)
+	{
+		float lo = 255, hi = 0;
+		for (int i = 0; i < 16; ++i) {
+			if (blk.a[i] > 0 && blk.a[i] < 255) {
+				lo = std::min(lo, blk.a[i]);
+				hi = std::max(hi, blk.a[i]);
+			}
+		}
+		if (lo <= hi)
+		{
+			uint8_t idx6[16];
+			float err6 = bc3_alpha_fit(blk, static_cast<int>(lo), static_cast<int>(hi), idx6);
+			if (err6 < err) {
+				a0 = static_cast<int>(lo);
+				a1 = static_cast<int>(hi);
+				memcpy(idx, idx6, sizeof(idx));
+			}
+		}
+	}
+
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; ++i) {
+		bits |= static_cast<uint64_t>(idx[i]) << (i * 3);
+	}
+	out[0] = static_cast<uint8_t>(a0);
+	out[1] = static_cast<uint8_t>(a1);
+	for (int i = 0; i < 6; ++i) {
+		out[2 + i] = (bits >> (i * 8)) & 0xff;
+	}
+}
+
+/************************************************************************/
+/* ETC1 / ETC2 EAC                                                      */
+/************************************************************************/
+
+inline int expand4(int v) { return v * 17; }
+inline int expand5(int v) { return (v << 3) | (v >> 2); }
+
+struct EtcSub
+{
+	float r[8], g[8], b[8];
+	int   pixel[8];	// row major index in the block
+	float avg[3];
+};
+
+void etc_split(const Block& blk, bool flip, EtcSub sub[2])
+{
+	int n[2] = { 0, 0 };
+	for (int y = 0; y < 4; ++y)
+	{
+		for (int x = 0; x < 4; ++x)
+		{
+			const int s = flip ? y / 2 : x / 2;
+			const int i = y * 4 + x;
+			EtcSub& d = sub[s];
+			d.r[n[s]] = blk.r[i];
+			d.g[n[s]] = blk.g[i];
+			d.b[n[s]] = blk.b[i];
+			d.pixel[n[s]] = i;
+			++n[s];
+		}
+	}
+	for (int s = 0; s < 2; ++s)
+	{
+		float sum[3] = { 0, 0, 0 };
+		for (int i = 0; i < 8; ++i) {
+			sum[0] += sub[s].r[i];
+			sum[1] += sub[s].g[i];
+			sum[2] += sub[s].b[i];
+		}
+		for (int c = 0; c < 3; ++c) {
+			sub[s].avg[c] = sum[c] / 8;
+		}
+	}
+}
+
+// best modifier table around an expanded base color
+float etc_fit_table(const EtcSub& sub, const int base[3], int& table, uint8_t* idx)
+{
+	float best = FLT_MAX;
+	for (int t = 0; t < 8; ++t)
+	{
+		const int mod[4] = { ETC_MODIFIERS[t][0], ETC_MODIFIERS[t][1], -ETC_MODIFIERS[t][0], -ETC_MODIFIERS[t][1] };
+		float pal[4][3];
+		for (int k = 0; k < 4; ++k) {
+			for (int c = 0; c < 3; ++c) {
+				pal[k][c] = static_cast<float>(clamp255(base[c] + mod[k]));
+			}
+		}
+		uint8_t tidx[8];
+		float err = fit_palette(sub.r, sub.g, sub.b, 8, pal, 4, tidx);
+		if (err < best) {
+			best = err;
+			table = t;
+			memcpy(idx, tidx, sizeof(tidx));
+		}
+	}
+	return best;
+}
+
+struct EtcSubFit
+{
+	int     q[3];	// quantized base
+	int     table;
+	uint8_t idx[8];
+	float   err;
+};
+
+// quantized base colors to try for a sub-block, the rounded average and,
+// for quality, every floor/ceil combination around it
+int etc_candidates(const float avg[3], int max, bool quality, int cand[8][3])
+{
+	int q[3], f[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		q[c] = quantize(avg[c], max);
+		f[c] = std::min(static_cast<int>(std::min(std::max(avg[c], 0.0f), 255.0f) * max / 255.0f), max - 1);
+	}
+	memcpy(cand[0], q, sizeof(q));
+	if (!quality) {
+		return 1;
+	}
+
+	int n = 1;
+	for (int i = 0; i < 8; ++i)
+	{
+		int c3[3] = { f[0] + (i & 1), f[1] + ((i >> 1) & 1), f[2] + ((i >> 2) & 1) };
+		if (memcmp(c3, q, sizeof(q)) != 0) {
+			memcpy(cand[n++], c3, sizeof(c3));
+		}
+	}
+	return n;
+}
+
+EtcSubFit etc_fit_sub(const EtcSub& sub, const int q[3], bool diff)
+{
+	EtcSubFit fit;
+	memcpy(fit.q, q, sizeof(fit.q));
+	int base[3];
+	for (int c = 0; c < 3; ++c) {
+		base[c] = diff ? expand5(q[c]) : expand4(q[c]);
+	}
+	fit.err = etc_fit_table(sub, base, fit.table, fit.idx);
+	return fit;
+}
+
+EtcSubFit etc_best_sub(const EtcSub& sub, bool diff, bool quality)
+{
+	int cand[8][3];
+	int n = etc_candidates(sub.avg, diff ? 31 : 15, quality, cand);
+	EtcSubFit best = etc_fit_sub(sub, cand[0], diff);
+	for (int i = 1; i < n && best.err > 0; ++i) {
+		EtcSubFit fit = etc_fit_sub(sub, cand[i], diff);
+		if (fit.err < best.err) {
+			best = fit;
+		}
+	}
+	return best;
+}
+
+void etc_pack(const EtcSub sub[2], const EtcSubFit fit[2], bool diff, bool flip, uint8_t* out)
+{
+	uint32_t hi = 0, lo = 0;
+	if (diff)
+	{
+		for (int c = 0; c < 3; ++c) {
+			const int delta = fit[1].q[c] - fit[0].q[c];
+			hi |= static_cast<uint32_t>(fit[0].q[c] << 3 | (delta & 7)) << (24 - c * 8);
+		}
+	}
+	else
+	{
+		for (int c = 0; c < 3; ++c) {
+			hi |= static_cast<uint32_t>(fit[0].q[c] << 4 | fit[1].q[c]) << (24 - c * 8);
+		}
+	}
+	hi |= fit[0].table << 5 | fit[1].table << 2 | (diff ? 2 : 0) | (flip ? 1 : 0);
+
+	// indices are stored column major, msb and lsb planes
+	for (int s = 0; s < 2; ++s)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			const int p = sub[s].pixel[i];
+			const int bit = (p % 4) * 4 + p / 4;
+			const uint32_t k = fit[s].idx[i];
+			lo |= (k >> 1) << (16 + bit);
+			lo |= (k & 1) << bit;
+		}
+	}
+
+	for (int i = 0; i < 4; ++i) {
+		out[i]     = (hi >> (24 - i * 8)) & 0xff;
+		out[4 + i] = (lo >> (24 - i * 8)) & 0xff;
+	}
+}
+
+// Individual and differential modes only, which also decode as etc2.
+// The differential delta is clamped, so no base overflows into the etc2
+// T, H or planar modes.
+void encode_etc1(const Block& blk, bool quality, uint8_t* out)
+{
+	float best_err = FLT_MAX;
+	EtcSub best_sub[2];
+	EtcSubFit best_fit[2];
+	bool best_diff = false, best_flip = false;
+
+	for (int flip = 0; flip < 2; ++flip)
+	{
+		EtcSub sub[2];
+		etc_split(blk, flip != 0, sub);
+
+		// differential, the second base follows the first within [-4, 3]
+		{
+			EtcSubFit fit[2];
+			fit[0] = etc_best_sub(sub[0], true, quality);
+			int q1[3];
+			for (int c = 0; c < 3; ++c) {
+				int q = quantize(sub[1].avg[c], 31);
+				q1[c] = fit[0].q[c] + std::min(std::max(q - fit[0].q[c], -4), 3);
+			}
+			fit[1] = etc_fit_sub(sub[1], q1, true);
+			if (quality)
+			{
+				EtcSubFit alt = etc_best_sub(sub[1], true, true);
+				bool in_range = true;
+				for (int c = 0; c < 3; ++c) {
+					int d = alt.q[c] - fit[0].q[c];
+					in_range = in_range && d >= -4 && d <= 3;
+				}
+				if (in_range && alt.err < fit[1].err) {
+					fit[1] = alt;
+				}
+			}
+			float err = fit[0].err + fit[1].err;
+			if (err < best_err) {
+				best_err = err;
+				memcpy(best_sub, sub, sizeof(sub));
+				memcpy(best_fit, fit, sizeof(fit));
+				best_diff = true;
+				best_flip = flip != 0;
+			}
+		}
+
+		// individual, 4 bits per channel each
+		if (quality || best_err > 0)
+		{
+			EtcSubFit fit[2] = { etc_best_sub(sub[0], false, quality), etc_best_sub(sub[1], false, quality) };
+			float err = fit[0].err + fit[1].err;
+			if (err < best_err) {
+				best_err = err;
+				memcpy(best_sub, sub, sizeof(sub));
+				memcpy(best_fit, fit, sizeof(fit));
+				best_diff = false;
+				best_flip = flip != 0;
+			}
+		}
+	}
+
+	etc_pack(best_sub, best_fit, best_diff, best_flip, out);
+}
+
+float eac_fit(const Block& blk, int base, int mult, int table, uint8_t* idx)
+{
+	float pal[8];
+	for (int k = 0; k < 8; ++k) {
+		pal[k] = static_cast<float>(clamp255(base + EAC_MODIFIERS[table][k] * mult));
+	}
+	return fit_values(blk.a, 16, pal, 8, idx);
+}
+
+void encode_eac_alpha(const Block& blk, bool quality, uint8_t* out)
+{
+	float amin = 255, amax = 0;
+	for (int i = 0; i < 16; ++i) {
+		amin = std::min(amin, blk.a[i]);
+		amax = std::max(amax, blk.a[i]);
+	}
+
+	float best_err = FLT_MAX;
+	int best_base = 0, best_mult = 1, best_table = 0;
+	uint8_t best_idx[16];
+	for (int t = 0; t < 16 && best_err > 0; ++t)
+	{
+		const int* mod = EAC_MODIFIERS[t];
+		const int tmin = *std::min_element(mod, mod + 8), tmax = *std::max_element(mod, mod + 8);
+		// the multiplier 0 is not used for 8 bit alpha
+		const int mult = std::min(std::max(static_cast<int>((amax - amin) / (tmax - tmin) + 0.5f), 1), 15);
+
+		const int spread = quality ? 1 : 0;
+		for (int m = mult - spread; m <= mult + spread; ++m)
+		{
+			if (m < 1 || m > 15) {
+				continue;
+			}
+			const int base = static_cast<int>(((amin - tmin * m) + (amax - tmax * m)) / 2 + 0.5f);
+			for (int b = base - spread; b <= base + spread; ++b)
+			{
+				const int cb = clamp255(b);
+				uint8_t idx[16];
+				float err = eac_fit(blk, cb, m, t, idx);
+				if (err < best_err) {
+					best_err = err;
+					best_base = cb;
+					best_mult = m;
+					best_table = t;
+					memcpy(best_idx, idx, sizeof(idx));
+				}
+			}
+		}
+	}
+
+	uint64_t bits = static_cast<uint64_t>(best_base) << 56 | static_cast<uint64_t>(best_mult) << 52
+		| static_cast<uint64_t>(best_table) << 48;
+	// column major, first pixel in the highest bits
+	for (int i = 0; i < 16; ++i) {
+		const int j = (i % 4) * 4 + i / 4;
+		bits |= static_cast<uint64_t>(best_idx[i]) << (45 - j * 3);
+	}
+	for (int i = 0; i < 8; ++i) {
+		out[i] = (bits >> (56 - i * 8)) & 0xff;
+	}
+}
+
+size_t block_size(ur::TEXTURE_FORMAT fmt)
+{
+	switch (fmt)
+	{
+	case ur::TEXTURE_ETC1:
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return 8;
+	case ur::TEXTURE_ETC2:
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+void encode_block(const Block& blk, ur::TEXTURE_FORMAT fmt, bool quality, uint8_t* out)
+{
+	switch (fmt)
+	{
+	case ur::TEXTURE_ETC1:
+		encode_etc1(blk, quality, out);
+		break;
+	case ur::TEXTURE_ETC2:
+		encode_eac_alpha(blk, quality, out);
+		encode_etc1(blk, quality, out + 8);
+		break;
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		encode_bc1(blk, true, quality, out);
+		break;
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		encode_bc2_alpha(blk, out);
+		encode_bc1(blk, false, quality, out + 8);
+		break;
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		encode_bc3_alpha(blk, quality, out);
+		encode_bc1(blk, false, quality, out + 8);
+		break;
+	default:
+		break;
+	}
+}
+
+}
+
+namespace ur
+{
+
+bool TextureCompressor::IsSupported(TEXTURE_FORMAT fmt)
+{
+	return block_size(fmt) != 0;
+}
+
+TEXTURE_FORMAT TextureCompressor::ChooseFormat(const RenderContext& rc, bool alpha)
+{
+	// dxt1 alpha is a single bit, it only serves opaque data here
+	static const TEXTURE_FORMAT OPAQUE[] = {
+		TEXTURE_COMPRESSED_RGBA_S3TC_DXT1_EXT, TEXTURE_ETC1,
+		TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT, TEXTURE_ETC2,
+	};
+	static const TEXTURE_FORMAT ALPHA[] = {
+		TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT, TEXTURE_ETC2, TEXTURE_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+	};
+
+	if (alpha) {
+		for (auto fmt : ALPHA) {
+			if (rc.IsSupportTextureFormat(fmt)) {
+				return fmt;
+			}
+		}
+	} else {
+		for (auto fmt : OPAQUE) {
+			if (rc.IsSupportTextureFormat(fmt)) {
+				return fmt;
+			}
+		}
+	}
+	return TEXTURE_INVALID;
+}
+
+size_t TextureCompressor::CompressedSize(TEXTURE_FORMAT fmt, int width, int height)
+{
+	return block_size(fmt) * ((width + 3) / 4) * ((height + 3) / 4);
+}
+
+bool TextureCompressor::Compress(const uint8_t* rgba, int width, int height, TEXTURE_FORMAT fmt,
+	                             std::vector<uint8_t>& dst, Preset preset, int threads)
+{
+	if (!rgba || width <= 0 || height <= 0 || !IsSupported(fmt)) {
+		return false;
+	}
+
+	const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+	const size_t bsize = block_size(fmt);
+	const bool quality = preset == PRESET_QUALITY;
+	dst.resize(CompressedSize(fmt, width, height));
+
+	std::atomic<int> next(0);
+	auto work = [&]()
+	{
+		Block blk;
+		for (int by = next++; by < bh; by = next++)
+		{
+			uint8_t* out = dst.data() + static_cast<size_t>(by) * bw * bsize;
+			for (int bx = 0; bx < bw; ++bx, out += bsize) {
+				load_block(rgba, width, height, bx, by, blk);
+				encode_block(blk, fmt, quality, out);
+			}
+		}
+	};
+
+	int n = threads > 0 ? threads : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+	n = std::min(n, (bh + ROWS_PER_THREAD - 1) / ROWS_PER_THREAD);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < n; ++i) {
+		workers.emplace_back(work);
+	}
+	work();
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	return true;
+}
+
+}
@@ -0,0 +1,143 @@
+#include "unirender/TextureStreamer.h"
+#include "unirender/RenderContext.h"
+
+#include <algorithm>
+
+#include <math.h>
+
+namespace ur
+{
+
+TextureStreamer::TextureStreamer(RenderContext* rc, size_t frame_bytes)
+	: m_rc(rc)
+	, m_frame_bytes(frame_bytes)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	for (auto& itr : m_textures) {
+		m_rc->ReleaseTexture(itr.first);
+	}
+}
+
+int TextureStreamer::CreateTexture(int width, int height, TEXTURE_FORMAT format, int mipmap_levels,
+	                               int resident_levels, const Loader& loader, TEXTURE_WRAP wrap,
+	                               TEXTURE_FILTER filter)
+{
+	Entry e;
+	e.width        = width;
+	e.height       = height;
+	e.format       = format;
+	e.levels       = std::max(mipmap_levels, 1);
+	e.min_resident = std::min(std::max(resident_levels, 1), e.levels);
+	e.wrap         = wrap;
+	e.filter       = filter;
+	e.loader       = loader;
+	e.base         = e.levels;
+
+	int id = m_rc->CreateTextureID(width, height, format, e.levels);
+	if (id == 0) {
+		return 0;
+	}
+
+	// before the first upload, so the levels are allocated one by one
+	m_rc->SetTextureLodRange(id, e.levels - e.min_resident, e.levels - 1);
+
+	size_t bytes = 0;
+	for (int i = e.levels - 1; i >= e.levels - e.min_resident; --i) {
+		if (!LoadLevel(id, e, i, bytes)) {
+			break;
+		}
+	}
+
+	m_textures.insert({ id, e });
+
+	return id;
+}
+
+void TextureStreamer::ReleaseTexture(int id)
+{
+	auto itr = m_textures.find(id);
+	if (itr != m_textures.end()) {
+		m_rc->ReleaseTexture(id);
+		m_textures.erase(itr);
+	}
+}
+
+void TextureStreamer::SetScreenSize(int id, float pixels)
+{
+	auto itr = m_textures.find(id);
+	if (itr != m_textures.end()) {
+		itr->second.screen_size = pixels;
+	}
+}
+
+void TextureStreamer::Update()
+{
+	std::vector<std::pair<int, Entry*>> wanted;
+	for (auto& itr : m_textures)
+	{
+		auto& e = itr.second;
+		int base = CalcWantedBase(e);
+		if (base > e.base) {
+			// free the levels not needed any more
+			e.base = base;
+			m_rc->SetTextureLodRange(itr.first, e.base, e.levels - 1);
+		} else if (base < e.base) {
+			wanted.push_back({ itr.first, &e });
+		}
+	}
+
+	// the largest on screen first
+	std::sort(wanted.begin(), wanted.end(), [](const std::pair<int, Entry*>& a, const std::pair<int, Entry*>& b) {
+		return a.second->screen_size > b.second->screen_size;
+	});
+
+	// one level per texture per frame, each level halves the blur
+	size_t bytes = 0;
+	for (auto& itr : wanted)
+	{
+		if (bytes >= m_frame_bytes) {
+			break;
+		}
+		LoadLevel(itr.first, *itr.second, itr.second->base - 1, bytes);
+	}
+}
+
+int TextureStreamer::GetBaseLevel(int id) const
+{
+	auto itr = m_textures.find(id);
+	return itr == m_textures.end() ? -1 : itr->second.base;
+}
+
+int TextureStreamer::CalcWantedBase(const Entry& e) const
+{
+	const int lowest = e.levels - e.min_resident;
+	if (e.screen_size <= 0) {
+		return lowest;
+	}
+
+	float ratio = std::max(e.width, e.height) / e.screen_size;
+	int base = ratio > 1 ? static_cast<int>(floorf(log2f(ratio))) : 0;
+	return std::min(base, lowest);
+}
+
+bool TextureStreamer::LoadLevel(int id, Entry& e, int level, size_t& bytes)
+{
+	if (!e.loader || !e.loader(level, m_buf)) {
+		return false;
+	}
+
+	int w = std::max(e.width >> level, 1),
+		h = std::max(e.height >> level, 1);
+	m_rc->UpdateTexture(id, m_buf.data(), w, h, 0, level, e.wrap, e.filter);
+	bytes += m_buf.size();
+
+	e.base = level;
+	m_rc->SetTextureLodRange(id, e.base, e.levels - 1);
+
+	return true;
+}
+
+}
@@ -0,0 +1,549 @@
+#include "unirender/TextureTranscoder.h"
+#include "unirender/TextureCompressor.h"
+#include "unirender/RenderContext.h"
+#include "unirender/Utility.h"
+
+#include <logger.h>
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_TRANSCODER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TEXTURE_TRANSCODER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+const uint32_t CACHE_MAGIC   = 0x43545255;	// "URTC"
+const uint32_t CACHE_VERSION = 1;
+
+// block rows per worker below which spawning threads is not worth it
+const int ROWS_PER_THREAD = 8;
+
+const int ETC_MODIFIERS[8][2] = {
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+	{ 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+// T and H mode distances
+const int ETC_DISTANCES[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+const int EAC_MODIFIERS[16][8] = {
+	{ -3, -6, -9, -15, 2, 5, 8, 14 },
+	{ -3, -7, -10, -13, 2, 6, 9, 12 },
+	{ -2, -5, -8, -13, 1, 4, 7, 12 },
+	{ -2, -4, -6, -13, 1, 3, 5, 12 },
+	{ -3, -6, -8, -12, 2, 5, 7, 11 },
+	{ -3, -7, -9, -11, 2, 6, 8, 10 },
+	{ -4, -7, -8, -11, 3, 6, 7, 10 },
+	{ -3, -5, -8, -11, 2, 4, 7, 10 },
+	{ -2, -6, -8, -10, 1, 5, 7, 9 },
+	{ -2, -5, -8, -10, 1, 4, 7, 9 },
+	{ -2, -4, -8, -10, 1, 3, 7, 9 },
+	{ -2, -5, -7, -10, 1, 4, 6, 9 },
+	{ -3, -4, -7, -10, 2, 3, 6, 9 },
+	{ -1, -2, -3, -10, 0, 1, 2, 9 },
+	{ -4, -6, -8, -9, 3, 5, 7, 8 },
+	{ -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+inline int clamp255(int v)
+{
+	return std::min(std::max(v, 0), 255);
+}
+
+inline uint32_t read_be32(const uint8_t* p)
+{
+	return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Four rgba colors base + pos - neg, saturated per byte. A color has
+// either pos or neg set, so this is the clamped base +- modifier.
+inline void offset_colors(const uint8_t* base, const uint8_t* pos, const uint8_t* neg, uint8_t* pal)
+{
+#if defined(TEXTURE_TRANSCODER_SSE2)
+	__m128i v = _mm_adds_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base)),
+		_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos)));
+	v = _mm_subs_epu8(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(neg)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(pal), v);
+#elif defined(TEXTURE_TRANSCODER_NEON)
+	vst1q_u8(pal, vqsubq_u8(vqaddq_u8(vld1q_u8(base), vld1q_u8(pos)), vld1q_u8(neg)));
+#else
+	for (int i = 0; i < 16; ++i) {
+		pal[i] = static_cast<uint8_t>(std::max(std::min(base[i] + pos[i], 255) - neg[i], 0));
+	}
+#endif
+}
+
+inline void set_color(uint8_t* dst, int r, int g, int b)
+{
+	dst[0] = static_cast<uint8_t>(r);
+	dst[1] = static_cast<uint8_t>(g);
+	dst[2] = static_cast<uint8_t>(b);
+	dst[3] = 255;
+}
+
+// index of pixel x, y in the column major msb and lsb planes
+inline int etc_index(uint32_t lo, int x, int y)
+{
+	const int bit = x * 4 + y;
+	return ((lo >> (bit + 16)) & 1) << 1 | ((lo >> bit) & 1);
+}
+
+void etc_paint(uint32_t lo, const uint8_t* pal, uint8_t px[16][4])
+{
+	for (int y = 0; y < 4; ++y) {
+		for (int x = 0; x < 4; ++x) {
+			memcpy(px[y * 4 + x], pal + etc_index(lo, x, y) * 4, 4);
+		}
+	}
+}
+
+void decode_etc_planar(uint32_t hi, uint32_t lo, uint8_t px[16][4])
+{
+	auto ext6 = [](int c) { return (c << 2) | (c >> 4); };
+	auto ext7 = [](int c) { return (c << 1) | (c >> 6); };
+
+	const int ro = ext6((hi >> 25) & 63);
+	const int go = ext7(((hi >> 24) & 1) << 6 | ((hi >> 17) & 63));
+	const int bo = ext6(((hi >> 16) & 1) << 5 | ((hi >> 11) & 3) << 3 | ((hi >> 7) & 7));
+	const int rh = ext6(((hi >> 2) & 31) << 1 | (hi & 1));
+	const int gh = ext7((lo >> 25) & 127);
+	const int bh = ext6((lo >> 19) & 63);
+	const int rv = ext6((lo >> 13) & 63);
+	const int gv = ext7((lo >> 6) & 127);
+	const int bv = ext6(lo & 63);
+
+	for (int y = 0; y < 4; ++y) {
+		for (int x = 0; x < 4; ++x) {
+			set_color(px[y * 4 + x],
+				clamp255((x * (rh - ro) + y * (rv - ro) + 4 * ro + 2) >> 2),
+				clamp255((x * (gh - go) + y * (gv - go) + 4 * go + 2) >> 2),
+				clamp255((x * (bh - bo) + y * (bv - bo) + 4 * bo + 2) >> 2));
+		}
+	}
+}
+
+// etc1 blocks are valid etc2 blocks, one decoder serves both
+void decode_etc2_rgb(const uint8_t* src, uint8_t px[16][4])
+{
+	const uint32_t hi = read_be32(src), lo = read_be32(src + 4);
+	const bool diff = (hi & 2) != 0;
+	const bool flip = (hi & 1) != 0;
+
+	uint8_t base[16], pos[16], neg[16], pal[16];
+	memset(pos, 0, sizeof(pos));
+	memset(neg, 0, sizeof(neg));
+
+	int c1[3], c2[3];
+	if (diff)
+	{
+		int overflow = -1;
+		for (int c = 0; c < 3; ++c)
+		{
+			const int b = (hi >> (27 - c * 8)) & 31;
+			int d = (hi >> (24 - c * 8)) & 7;
+			d = d >= 4 ? d - 8 : d;
+			if ((b + d < 0 || b + d > 31) && overflow < 0) {
+				overflow = c;
+			}
+			c1[c] = (b << 3) | (b >> 2);
+			c2[c] = ((b + d) << 3) | ((b + d) >> 2);
+		}
+
+		if (overflow == 0)
+		{
+			// T mode
+			int t1[3] = {
+				static_cast<int>(((hi >> 27) & 3) << 2 | ((hi >> 24) & 3)),
+				static_cast<int>((hi >> 20) & 15),
+				static_cast<int>((hi >> 16) & 15),
+			};
+			int t2[3] = {
+				static_cast<int>((hi >> 12) & 15),
+				static_cast<int>((hi >> 8) & 15),
+				static_cast<int>((hi >> 4) & 15),
+			};
+			const uint8_t d = static_cast<uint8_t>(ETC_DISTANCES[((hi >> 2) & 3) << 1 | (hi & 1)]);
+			for (int c = 0; c < 3; ++c) {
+				base[c] = static_cast<uint8_t>(t1[c] * 17);
+				base[4 + c] = base[8 + c] = base[12 + c] = static_cast<uint8_t>(t2[c] * 17);
+				pos[4 + c] = d;
+				neg[12 + c] = d;
+			}
+			base[3] = base[7] = base[11] = base[15] = 255;
+			offset_colors(base, pos, neg, pal);
+			etc_paint(lo, pal, px);
+			return;
+		}
+		if (overflow == 1)
+		{
+			// H mode
+			int h1[3] = {
+				static_cast<int>((hi >> 27) & 15),
+				static_cast<int>(((hi >> 24) & 7) << 1 | ((hi >> 20) & 1)),
+				static_cast<int>(((hi >> 19) & 1) << 3 | ((hi >> 15) & 7)),
+			};
+			int h2[3] = {
+				static_cast<int>((hi >> 11) & 15),
+				static_cast<int>((hi >> 7) & 15),
+				static_cast<int>((hi >> 3) & 15),
+			};
+			const int v1 = h1[0] << 8 | h1[1] << 4 | h1[2];
+			const int v2 = h2[0] << 8 | h2[1] << 4 | h2[2];
+			const int di = static_cast<int>(((hi >> 2) & 1) << 2 | (hi & 1) << 1) | (v1 >= v2 ? 1 : 0);
+			const uint8_t d = static_cast<uint8_t>(ETC_DISTANCES[di]);
+			for (int c = 0; c < 3; ++c) {
+				base[c] = base[4 + c] = static_cast<uint8_t>(h1[c] * 17);
+				base[8 + c] = base[12 + c] = static_cast<uint8_t>(h2[c] * 17);
+				pos[c] = pos[8 + c] = d;
+				neg[4 + c] = neg[12 + c] = d;
+			}
+			base[3] = base[7] = base[11] = base[15] = 255;
+			offset_colors(base, pos, neg, pal);
+			etc_paint(lo, pal, px);
+			return;
+		}
+		if (overflow == 2) {
+			decode_etc_planar(hi, lo, px);
+			return;
+		}
+	}
+	else
+	{
+		for (int c = 0; c < 3; ++c) {
+			c1[c] = ((hi >> (28 - c * 8)) & 15) * 17;
+			c2[c] = ((hi >> (24 - c * 8)) & 15) * 17;
+		}
+	}
+
+	// individual or differential, a palette per sub-block
+	const int tables[2] = { static_cast<int>((hi >> 5) & 7), static_cast<int>((hi >> 2) & 7) };
+	uint8_t sub_pal[2][16];
+	for (int s = 0; s < 2; ++s)
+	{
+		const int* c = s == 0 ? c1 : c2;
+		const uint8_t a = static_cast<uint8_t>(ETC_MODIFIERS[tables[s]][0]);
+		const uint8_t b = static_cast<uint8_t>(ETC_MODIFIERS[tables[s]][1]);
+		for (int k = 0; k < 4; ++k) {
+			set_color(base + k * 4, c[0], c[1], c[2]);
+		}
+		for (int i = 0; i < 3; ++i) {
+			pos[i] = a;
+			pos[4 + i] = b;
+			neg[8 + i] = a;
+			neg[12 + i] = b;
+		}
+		offset_colors(base, pos, neg, sub_pal[s]);
+	}
+
+	for (int y = 0; y < 4; ++y) {
+		for (int x = 0; x < 4; ++x) {
+			const int s = flip ? y / 2 : x / 2;
+			memcpy(px[y * 4 + x], sub_pal[s] + etc_index(lo, x, y) * 4, 4);
+		}
+	}
+}
+
+void decode_eac_alpha(const uint8_t* src, uint8_t px[16][4])
+{
+	uint64_t bits = 0;
+	for (int i = 0; i < 8; ++i) {
+		bits = bits << 8 | src[i];
+	}
+	const int base = static_cast<int>(bits >> 56);
+	const int mult = static_cast<int>((bits >> 52) & 15);
+	const int* mod = EAC_MODIFIERS[(bits >> 48) & 15];
+	for (int j = 0; j < 16; ++j) {
+		const int k = static_cast<int>((bits >> (45 - j * 3)) & 7);
+		px[(j % 4) * 4 + j / 4][3] = static_cast<uint8_t>(clamp255(base + mod[k] * mult));
+	}
+}
+
+void decode_bc1(const uint8_t* src, bool four_only, uint8_t px[16][4])
+{
+	const int c0 = src[0] | src[1] << 8;
+	const int c1 = src[2] | src[3] << 8;
+
+	uint8_t pal[4][4];
+	auto expand = [](int v, uint8_t* c) {
+		const int r = v >> 11, g = (v >> 5) & 0x3f, b = v & 0x1f;
+		set_color(c, (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+	};
+	expand(c0, pal[0]);
+	expand(c1, pal[1]);
+	if (c0 > c1 || four_only)
+	{
+		for (int c = 0; c < 3; ++c) {
+			pal[2][c] = static_cast<uint8_t>((2 * pal[0][c] + pal[1][c] + 1) / 3);
+			pal[3][c] = static_cast<uint8_t>((pal[0][c] + 2 * pal[1][c] + 1) / 3);
+		}
+		pal[2][3] = pal[3][3] = 255;
+	}
+	else
+	{
+		for (int c = 0; c < 3; ++c) {
+			pal[2][c] = static_cast<uint8_t>((pal[0][c] + pal[1][c] + 1) / 2);
+		}
+		pal[2][3] = 255;
+		memset(pal[3], 0, 4);
+	}
+
+	for (int i = 0; i < 16; ++i) {
+		memcpy(px[i], pal[(src[4 + i / 4] >> ((i % 4) * 2)) & 3], 4);
+	}
+}
+
+void decode_bc2_alpha(const uint8_t* src, uint8_t px[16][4])
+{
+	for (int i = 0; i < 16; ++i) {
+		px[i][3] = static_cast<uint8_t>(((src[i / 2] >> ((i % 2) * 4)) & 15) * 17);
+	}
+}
+
+void decode_bc3_alpha(const uint8_t* src, uint8_t px[16][4])
+{
+	const int a0 = src[0], a1 = src[1];
+	int pal[8] = { a0, a1 };
+	if (a0 > a1)
+	{
+		for (int i = 1; i < 7; ++i) {
+			pal[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+		}
+	}
+	else
+	{
+		for (int i = 1; i < 5; ++i) {
+			pal[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+		}
+		pal[6] = 0;
+		pal[7] = 255;
+	}
+
+	uint64_t bits = 0;
+	for (int i = 0; i < 6; ++i) {
+		bits |= static_cast<uint64_t>(src[2 + i]) << (i * 8);
+	}
+	for (int i = 0; i < 16; ++i) {
+		px[i][3] = static_cast<uint8_t>(pal[(bits >> (i * 3)) & 7]);
+	}
+}
+
+size_t block_size(ur::TEXTURE_FORMAT fmt)
+{
+	switch (fmt)
+	{
+	case ur::TEXTURE_ETC1:
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return 8;
+	case ur::TEXTURE_ETC2:
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+void decode_block(const uint8_t* src, ur::TEXTURE_FORMAT fmt, uint8_t px[16][4])
+{
+	switch (fmt)
+	{
+	case ur::TEXTURE_ETC1:
+		decode_etc2_rgb(src, px);
+		break;
+	case ur::TEXTURE_ETC2:
+		decode_etc2_rgb(src + 8, px);
+		decode_eac_alpha(src, px);
+		break;
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		decode_bc1(src, false, px);
+		break;
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		decode_bc1(src + 8, true, px);
+		decode_bc2_alpha(src, px);
+		break;
+	case ur::TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		decode_bc1(src + 8, true, px);
+		decode_bc3_alpha(src, px);
+		break;
+	default:
+		break;
+	}
+}
+
+}
+
+namespace ur
+{
+
+TextureTranscoder::TextureTranscoder(const std::string& driver, const std::string& cache_dir)
+	: m_driver_hash(Utility::HashBytes(driver.data(), driver.size()))
+	, m_cache_dir(cache_dir)
+{
+}
+
+bool TextureTranscoder::IsDecodable(TEXTURE_FORMAT fmt)
+{
+	return block_size(fmt) != 0;
+}
+
+TEXTURE_FORMAT TextureTranscoder::ChooseTarget(const RenderContext& rc, TEXTURE_FORMAT src)
+{
+	// dxt1 may hold punch through alpha
+	auto fmt = TextureCompressor::ChooseFormat(rc, src != TEXTURE_ETC1);
+	return fmt != TEXTURE_INVALID ? fmt : TEXTURE_RGBA8;
+}
+
+bool TextureTranscoder::Decode(const uint8_t* blocks, int width, int height, TEXTURE_FORMAT fmt,
+	                           std::vector<uint8_t>& rgba, int threads)
+{
+	if (!blocks || width <= 0 || height <= 0 || !IsDecodable(fmt)) {
+		return false;
+	}
+
+	const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+	const size_t bsize = block_size(fmt);
+	rgba.resize(static_cast<size_t>(width) * height * 4);
+
+	std::atomic<int> next(0);
+	auto work = [&]()
+	{
+		uint8_t px[16][4];
+		for (int by = next++; by < bh; by = next++)
+		{
+			const uint8_t* src = blocks + static_cast<size_t>(by) * bw * bsize;
+			const int rows = std::min(4, height - by * 4);
+			for (int bx = 0; bx < bw; ++bx, src += bsize)
+			{
+				decode_block(src, fmt, px);
+				const int cols = std::min(4, width - bx * 4);
+				for (int y = 0; y < rows; ++y) {
+					uint8_t* dst = rgba.data() + (static_cast<size_t>(by * 4 + y) * width + bx * 4) * 4;
+					memcpy(dst, px[y * 4], cols * 4);
+				}
+			}
+		}
+	};
+
+	int n = threads > 0 ? threads : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+	n = std::min(n, (bh + ROWS_PER_THREAD - 1) / ROWS_PER_THREAD);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < n; ++i) {
+		workers.emplace_back(work);
+	}
+	work();
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	return true;
+}
+
+bool TextureTranscoder::Transcode(const void* data, int width, int height, TEXTURE_FORMAT src,
+	                              TEXTURE_FORMAT dst, std::vector<uint8_t>& out)
+{
+	if (!data || !IsDecodable(src) || (dst != TEXTURE_RGBA8 && !TextureCompressor::IsSupported(dst))) {
+		return false;
+	}
+
+	const size_t size = TextureCompressor::CompressedSize(src, width, height);
+	const int params[] = { width, height, src, dst };
+	const uint64_t key = Utility::HashBytes(data, size, Utility::HashBytes(params, sizeof(params), m_driver_hash));
+	if (!m_cache_dir.empty() && LoadCache(key, width, height, src, dst, out)) {
+		return true;
+	}
+
+	if (dst == TEXTURE_RGBA8)
+	{
+		if (!Decode(static_cast<const uint8_t*>(data), width, height, src, out)) {
+			return false;
+		}
+	}
+	else
+	{
+		std::vector<uint8_t> rgba;
+		if (!Decode(static_cast<const uint8_t*>(data), width, height, src, rgba) ||
+			!TextureCompressor::Compress(rgba.data(), width, height, dst, out)) {
+			return false;
+		}
+	}
+
+	if (!m_cache_dir.empty()) {
+		StoreCache(key, width, height, src, dst, out);
+	}
+	return true;
+}
+
+std::string TextureTranscoder::CachePath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.urtc", static_cast<unsigned long long>(key));
+
+	std::string path = m_cache_dir;
+	if (path.back() != '/' && path.back() != '\\') {
+		path += '/';
+	}
+	return path + name;
+}
+
+bool TextureTranscoder::LoadCache(uint64_t key, int width, int height, TEXTURE_FORMAT src,
+	                              TEXTURE_FORMAT dst, std::vector<uint8_t>& out) const
+{
+	std::ifstream fin(CachePath(key), std::ios::binary);
+	if (fin.fail()) {
+		return false;
+	}
+
+	uint32_t header[6];
+	uint64_t size = 0;
+	fin.read(reinterpret_cast<char*>(header), sizeof(header));
+	fin.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if (fin.fail() || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION ||
+		header[2] != static_cast<uint32_t>(width) || header[3] != static_cast<uint32_t>(height) ||
+		header[4] != static_cast<uint32_t>(src) || header[5] != static_cast<uint32_t>(dst)) {
+		return false;
+	}
+
+	const size_t expect = dst == TEXTURE_RGBA8 ? static_cast<size_t>(width) * height * 4
+		: TextureCompressor::CompressedSize(dst, width, height);
+	if (size != expect) {
+		return false;
+	}
+
+	out.resize(static_cast<size_t>(size));
+	fin.read(reinterpret_cast<char*>(out.data()), size);
+	return !fin.fail();
+}
+
+void TextureTranscoder::StoreCache(uint64_t key, int width, int height, TEXTURE_FORMAT src,
+	                               TEXTURE_FORMAT dst, const std::vector<uint8_t>& data) const
+{
+	const std::string path = CachePath(key);
+	std::ofstream fout(path, std::ios::binary);
+	if (fout.fail()) {
+		LOGW("Can't write transcode cache %s\n", path.c_str());
+		return;
+	}
+
+	const uint32_t header[6] = {
+		CACHE_MAGIC, CACHE_VERSION, static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+		static_cast<uint32_t>(src), static_cast<uint32_t>(dst),
+	};
+	const uint64_t size = data.size();
+	fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+	fout.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	fout.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+}
@@ -0,0 +1,236 @@
+#include "unirender/UploadScheduler.h"
+#include "unirender/RenderContext.h"
+#include "unirender/Utility.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+
+bool is_compressed(ur::TEXTURE_FORMAT format)
+{
+	return format >= ur::TEXTURE_PVR2;
+}
+
+// rows uploaded together and their size
+void calc_row_unit(ur::TEXTURE_FORMAT format, int width, int& rows, size_t& bytes)
+{
+	if (is_compressed(format)) {
+		rows = 4;
+		bytes = ur::Utility::CalcTextureSize(format, (width + 3) & ~3, 4);
+	} else {
+		// 16F rows are read as floats
+		rows = 1;
+		bytes = ur::Utility::CalcClientSize(format, width, 1);
+	}
+}
+
+}
+
+namespace ur
+{
+
+UploadScheduler::UploadScheduler(RenderContext* rc, size_t frame_bytes, float frame_ms)
+	: m_rc(rc)
+	, m_frame_bytes(frame_bytes)
+	, m_frame_ms(frame_ms)
+{
+}
+
+void UploadScheduler::SetFrameBudget(size_t bytes, float ms)
+{
+	m_frame_bytes = bytes;
+	m_frame_ms = ms;
+}
+
+void UploadScheduler::QueueTexture(int tex_id, int width, int height, TEXTURE_FORMAT format,
+	                               const std::vector<const void*>& levels, int priority, int required_levels,
+	                               TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
+{
+	CancelTexture(tex_id);
+
+	const int n = levels.size();
+	if (required_levels < 0 || required_levels > n) {
+		required_levels = n;
+	}
+
+	// allocate the storage, not read from a bound pixel buffer
+	m_rc->UnbindPixelBuffer();
+	for (int i = 0; i < n; ++i) {
+		m_rc->UpdateTexture(tex_id, nullptr, std::max(width >> i, 1), std::max(height >> i, 1), 0, i, wrap, filter);
+	}
+
+	// small levels first, they make the texture usable soonest
+	int pending = 0;
+	for (int i = n - 1; i >= 0; --i)
+	{
+		if (!levels[i]) {
+			continue;
+		}
+
+		Job job;
+		job.type     = JOB_TEXTURE;
+		job.id       = tex_id;
+		job.priority = priority;
+		job.level    = i;
+		job.width    = std::max(width >> i, 1);
+		job.height   = std::max(height >> i, 1);
+		job.format   = format;
+		job.required = i >= n - required_levels;
+
+		auto src = static_cast<const uint8_t*>(levels[i]);
+		job.data.assign(src, src + Utility::CalcClientSize(format, job.width, job.height));
+
+		if (job.required) {
+			++pending;
+		}
+		Push(std::move(job));
+	}
+	if (pending > 0) {
+		m_tex_pending[tex_id] = pending;
+	}
+}
+
+void UploadScheduler::QueueBuffer(BUFFER_TYPE type, int id, const void* data, int size, int priority)
+{
+	CancelBuffer(type, id);
+
+	Job job;
+	job.type     = type == BUFFER_VERTEX ? JOB_VERTEX_BUFFER : JOB_INDEX_BUFFER;
+	job.id       = id;
+	job.priority = priority;
+
+	auto src = static_cast<const uint8_t*>(data);
+	job.data.assign(src, src + size);
+
+	Push(std::move(job));
+}
+
+void UploadScheduler::CancelTexture(int tex_id)
+{
+	m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(), [tex_id](const Job& job) {
+		return job.type == JOB_TEXTURE && job.id == tex_id;
+	}), m_jobs.end());
+	m_tex_pending.erase(tex_id);
+}
+
+void UploadScheduler::CancelBuffer(BUFFER_TYPE type, int id)
+{
+	JobType jt = type == BUFFER_VERTEX ? JOB_VERTEX_BUFFER : JOB_INDEX_BUFFER;
+	m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(), [jt, id](const Job& job) {
+		return job.type == jt && job.id == id;
+	}), m_jobs.end());
+}
+
+void UploadScheduler::Update()
+{
+	auto begin = std::chrono::steady_clock::now();
+	auto elapsed_ms = [&begin]() {
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	};
+
+	size_t uploaded = 0;
+	while (!m_jobs.empty() && uploaded < m_frame_bytes)
+	{
+		if (m_frame_ms > 0 && uploaded > 0 && elapsed_ms() >= m_frame_ms) {
+			break;
+		}
+
+		auto& job = m_jobs.front();
+		uploaded += Step(job, m_frame_bytes - uploaded);
+		if (!IsFinished(job)) {
+			continue;
+		}
+
+		Finish(job);
+		m_jobs.erase(m_jobs.begin());
+	}
+
+	m_stats.uploaded_bytes = uploaded;
+	m_stats.upload_ms      = elapsed_ms();
+
+	m_stats.queued_jobs  = m_jobs.size();
+	m_stats.queued_bytes = 0;
+	for (auto& job : m_jobs) {
+		m_stats.queued_bytes += job.data.size();
+	}
+}
+
+bool UploadScheduler::IsTextureReady(int tex_id) const
+{
+	return m_tex_pending.find(tex_id) == m_tex_pending.end();
+}
+
+void UploadScheduler::Push(Job&& job)
+{
+	job.seq = m_next_seq++;
+	job.queue_frame = m_rc->GetCurrFrame();
+
+	auto itr = std::upper_bound(m_jobs.begin(), m_jobs.end(), job, [](const Job& a, const Job& b) {
+		return a.priority > b.priority || (a.priority == b.priority && a.seq < b.seq);
+	});
+	m_jobs.insert(itr, std::move(job));
+
+	m_stats.queued_jobs = m_jobs.size();
+}
+
+size_t UploadScheduler::Step(Job& job, size_t bytes)
+{
+	if (job.type == JOB_TEXTURE)
+	{
+		int unit_rows;
+		size_t unit_bytes;
+		calc_row_unit(job.format, job.width, unit_rows, unit_bytes);
+
+		// at least one band to make progress
+		int units = std::max<int>(bytes / unit_bytes, 1);
+		int rows = std::min(units * unit_rows, job.height - job.done);
+		size_t offset = (job.done / unit_rows) * unit_bytes;
+		m_rc->UpdateSubTexture(&job.data[offset], 0, job.done, job.width, rows, job.id, 0, job.level);
+		job.done += rows;
+
+		return ((rows + unit_rows - 1) / unit_rows) * unit_bytes;
+	}
+	else
+	{
+		int size = job.data.size();
+		int n = std::min<int>(std::max<size_t>(bytes, 1), size - job.done);
+		BUFFER_TYPE type = job.type == JOB_VERTEX_BUFFER ? BUFFER_VERTEX : BUFFER_INDEX;
+		m_rc->UpdateBufferRaw(type, job.id, &job.data[job.done], n, job.done);
+		job.done += n;
+
+		return n;
+	}
+}
+
+bool UploadScheduler::IsFinished(const Job& job) const
+{
+	if (job.type == JOB_TEXTURE) {
+		return job.done >= job.height;
+	} else {
+		return job.done >= static_cast<int>(job.data.size());
+	}
+}
+
+void UploadScheduler::Finish(const Job& job)
+{
+	int latency = m_rc->GetCurrFrame() - job.queue_frame;
+	m_stats.max_latency = std::max(m_stats.max_latency, latency);
+	++m_finished;
+	m_stats.avg_latency += (latency - m_stats.avg_latency) / m_finished;
+
+	if (job.type == JOB_TEXTURE && job.required)
+	{
+		auto itr = m_tex_pending.find(job.id);
+		assert(itr != m_tex_pending.end());
+		if (--itr->second == 0) {
+			m_tex_pending.erase(itr);
+		}
+	}
+}
+
+}
@@ -1,6 +1,51 @@
 #include "unirender/Utility.h"
 #include "unirender/typedef.h"
 
+#include <string.h>
+
+namespace
+{
+
+const uint64_t PRIME64_1 = 11400714785074694791ULL;
+const uint64_t PRIME64_2 = 14029467366897019727ULL;
+const uint64_t PRIME64_3 = 1609587929392839161ULL;
+const uint64_t PRIME64_4 = 9650029242287828579ULL;
+const uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc  = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+inline uint64_t merge64(uint64_t acc, uint64_t val)
+{
+	acc ^= round64(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+}
+
 namespace ur
 {
 
@@ -66,4 +111,83 @@ int Utility::CalcTextureSize(int format, int width, int height, int depth)
 	return static_cast<int>(sz);
 }
 
+size_t Utility::CalcClientSize(int format, int width, int height)
+{
+	size_t times = 0;
+
+	switch (format) {
+	case TEXTURE_RGBA16F:
+		times = 16;
+		break;
+	case TEXTURE_RGB16F:
+		times = 12;
+		break;
+	case TEXTURE_RG16F:
+		times = 8;
+		break;
+	default:
+		return CalcTextureSize(format, width, height);
+	}
+
+	return times * width * height;
+}
+
+uint64_t Utility::HashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + size;
+
+	uint64_t h;
+	if (size >= 32)
+	{
+		// four independent lanes, the compiler keeps them in flight together
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+		const uint8_t* limit = end - 32;
+		do {
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = merge64(h, v1);
+		h = merge64(h, v2);
+		h = merge64(h, v3);
+		h = merge64(h, v4);
+	}
+	else
+	{
+		h = seed + PRIME64_5;
+	}
+
+	h += static_cast<uint64_t>(size);
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= round64(0, read64(p));
+		h  = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (p + 4 <= end) {
+		h ^= static_cast<uint64_t>(read32(p)) * PRIME64_1;
+		h  = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		h ^= (*p) * PRIME64_5;
+		h  = rotl64(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include "unirender/VirtualTexture.h"
+#include "unirender/RenderContext.h"
+
+#include <algorithm>
+
+#include <limits.h>
+
+namespace
+{
+
+const char* FEEDBACK_GLSL = R"(
+uniform vec4  u_vt_params;
+uniform float u_vt_bias;
+
+vec4 vt_feedback(vec2 uv)
+{
+	vec2 vuv = uv * u_vt_params.xy;
+	vec2 px = vuv * u_vt_params.z;
+	vec2 dx = dFdx(px), dy = dFdy(px);
+	float lod = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + u_vt_bias), 0.0, u_vt_params.w);
+	vec2 page = min(floor(vuv * exp2(u_vt_params.w - lod)), vec2(exp2(u_vt_params.w - lod) - 1.0));
+	float hi = floor(page.x / 256.0) + floor(page.y / 256.0) * 16.0;
+	return vec4(mod(page.x, 256.0), mod(page.y, 256.0), hi, lod + 1.0) / 255.0;
+}
+)";
+
+const char* SAMPLE_GLSL = R"(
+uniform sampler2D u_vt_cache;
+uniform sampler2D u_vt_indirection;
+uniform vec4 u_vt_params;
+uniform vec4 u_vt_cache;
+
+vec4 vt_sample(vec2 uv)
+{
+	vec2 vuv = uv * u_vt_params.xy;
+	vec2 px = vuv * u_vt_params.z;
+	vec2 dx = dFdx(px), dy = dFdy(px);
+	float lod = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy)))), 0.0, u_vt_params.w);
+	int pages = int(exp2(u_vt_params.w - lod));
+	ivec2 page = min(ivec2(vuv * float(pages)), ivec2(pages - 1));
+	vec4 e = floor(texelFetch(u_vt_indirection, page, int(lod)) * 255.0 + 0.5);
+
+	// e.b is the level of the resident page, a parent while loading
+	vec2 in_page = fract(vuv * exp2(u_vt_params.w - e.b));
+	vec2 texel = e.rg * u_vt_cache.z + u_vt_cache.y + in_page * u_vt_cache.x;
+	return textureLod(u_vt_cache, texel / u_vt_cache.w, 0.0);
+}
+)";
+
+inline uint64_t make_key(int level, int x, int y)
+{
+	return static_cast<uint64_t>(level) << 48 | static_cast<uint64_t>(y) << 24 | static_cast<uint64_t>(x);
+}
+
+inline int key_level(uint64_t key) { return static_cast<int>(key >> 48); }
+inline int key_y(uint64_t key) { return static_cast<int>((key >> 24) & 0xffffff); }
+inline int key_x(uint64_t key) { return static_cast<int>(key & 0xffffff); }
+
+}
+
+namespace ur
+{
+
+VirtualTexture::VirtualTexture(RenderContext* rc, int width, int height, const Loader& loader,
+	                           int page_size, int border, int cache_side, int threads)
+	: m_rc(rc)
+	, m_width(width)
+	, m_height(height)
+	, m_loader(loader)
+	, m_page_size(page_size)
+	, m_border(border)
+	, m_slot_size(page_size + border * 2)
+{
+	const int pages = std::max((width + page_size - 1) / page_size, (height + page_size - 1) / page_size);
+	m_levels = 1;
+	while ((1 << (m_levels - 1)) < pages) {
+		++m_levels;
+	}
+
+	// slots are addressed with 8 bits per axis in the indirection
+	const int max_size = m_rc->GetCapability(CAP_MAX_TEXTURE_SIZE);
+	m_cache_side = std::min(cache_side, 256);
+	if (max_size > 0) {
+		m_cache_side = std::min(m_cache_side, max_size / m_slot_size);
+	}
+	m_cache_side = std::max(m_cache_side, 1);
+	m_slots.resize(m_cache_side * m_cache_side);
+
+	const int cache_size = m_cache_side * m_slot_size;
+	m_cache_tex = m_rc->CreateTexture(nullptr, cache_size, cache_size, TEXTURE_RGBA8, 0,
+		TEXTURE_CLAMP_TO_EDGE, TEXTURE_LINEAR);
+
+	const int side = 1 << (m_levels - 1);
+	m_indirection.resize(m_levels);
+	for (int i = 0; i < m_levels; ++i) {
+		m_indirection[i].resize((side >> i) * (side >> i));
+	}
+	m_indirection_tex = m_rc->CreateTexture(nullptr, side, side, TEXTURE_RGBA8, m_levels,
+		TEXTURE_CLAMP_TO_EDGE, TEXTURE_NEAREST);
+	m_dirty[0] = m_dirty[1] = 0;
+	m_dirty[2] = m_dirty[3] = side;
+
+	// the coarsest page is the fallback for everything else
+	Loaded root;
+	root.key = make_key(m_levels - 1, 0, 0);
+	root.ok = LoadPage(root.key, root.pixels);
+	if (root.ok && StorePage(root)) {
+		m_slots[m_resident[root.key]].locked = true;
+	}
+	UpdateIndirection();
+
+	threads = std::max(threads, 1);
+	for (int i = 0; i < threads; ++i) {
+		m_workers.emplace_back(&VirtualTexture::WorkerLoop, this);
+	}
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_all();
+	for (auto& t : m_workers) {
+		t.join();
+	}
+
+	for (auto& f : m_feedbacks) {
+		m_rc->ReleaseReadback(f.ticket);
+	}
+	if (m_cache_tex != 0) {
+		m_rc->ReleaseTexture(m_cache_tex);
+	}
+	if (m_indirection_tex != 0) {
+		m_rc->ReleaseTexture(m_indirection_tex);
+	}
+}
+
+void VirtualTexture::RequestFeedback(int x, int y, int w, int h)
+{
+	// earlier ones still in flight are enough, don't pile up buffers
+	if (m_feedbacks.size() >= 3 || w <= 0 || h <= 0) {
+		return;
+	}
+
+	int ticket = m_rc->ReadPixelsAsync(x, y, w, h, TEXTURE_RGBA8);
+	if (ticket != 0) {
+		m_feedbacks.push_back({ ticket, w, h });
+	}
+}
+
+void VirtualTexture::Update(int max_uploads)
+{
+	++m_frame;
+
+	// the newest ready feedback wins, older ones are stale
+	std::unordered_set<uint64_t> wanted;
+	bool has_feedback = false;
+	while (!m_feedbacks.empty() && m_rc->IsReadbackReady(m_feedbacks.front().ticket))
+	{
+		auto f = m_feedbacks.front();
+		m_feedbacks.pop_front();
+		if (!m_feedbacks.empty() && m_rc->IsReadbackReady(m_feedbacks.front().ticket)) {
+			m_rc->ReleaseReadback(f.ticket);
+			continue;
+		}
+
+		auto pixels = static_cast<const uint8_t*>(m_rc->MapReadback(f.ticket, false));
+		if (pixels) {
+			ParseFeedback(pixels, f.w * f.h, wanted);
+			has_feedback = true;
+		}
+		m_rc->ReleaseReadback(f.ticket);
+	}
+	if (has_feedback) {
+		m_feedback_frame = m_frame;
+		QueueRequests(wanted);
+	}
+
+	// offsets otherwise
+	m_rc->UnbindPixelBuffer();
+
+	for (int i = 0; i < max_uploads; ++i)
+	{
+		Loaded page;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_loaded.empty()) {
+				break;
+			}
+			page = std::move(m_loaded.front());
+			m_loaded.pop_front();
+		}
+		// failures are requested again by the next feedback
+		if (page.ok && m_resident.find(page.key) == m_resident.end()) {
+			StorePage(page);
+		}
+	}
+
+	UpdateIndirection();
+}
+
+void VirtualTexture::GetShaderParams(float params[4], float cache[4]) const
+{
+	const float virtual_size = static_cast<float>(m_page_size << (m_levels - 1));
+	params[0] = m_width / virtual_size;
+	params[1] = m_height / virtual_size;
+	params[2] = virtual_size;
+	params[3] = static_cast<float>(m_levels - 1);
+
+	cache[0] = static_cast<float>(m_page_size);
+	cache[1] = static_cast<float>(m_border);
+	cache[2] = static_cast<float>(m_slot_size);
+	cache[3] = static_cast<float>(m_cache_side * m_slot_size);
+}
+
+const char* VirtualTexture::GetFeedbackGLSL()
+{
+	return FEEDBACK_GLSL;
+}
+
+const char* VirtualTexture::GetSampleGLSL()
+{
+	return SAMPLE_GLSL;
+}
+
+void VirtualTexture::WorkerLoop()
+{
+	while (true)
+	{
+		Loaded page;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cond.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+			if (m_stop) {
+				return;
+			}
+			page.key = m_requests.front();
+			m_requests.pop_front();
+			m_in_flight.insert(page.key);
+		}
+
+		page.ok = LoadPage(page.key, page.pixels);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_in_flight.erase(page.key);
+		m_loaded.push_back(std::move(page));
+	}
+}
+
+bool VirtualTexture::LoadPage(uint64_t key, std::vector<uint8_t>& pixels) const
+{
+	pixels.resize(static_cast<size_t>(m_slot_size) * m_slot_size * 4);
+	return m_loader(key_level(key), key_x(key), key_y(key), pixels.data());
+}
+
+bool VirtualTexture::StorePage(const Loaded& page)
+{
+	// a free slot, else the least recently used one not in view
+	int best = -1;
+	for (int i = 0, n = static_cast<int>(m_slots.size()); i < n; ++i)
+	{
+		auto& s = m_slots[i];
+		if (!s.used) {
+			best = i;
+			break;
+		}
+		if (!s.locked && s.last_used < m_feedback_frame &&
+			(best < 0 || s.last_used < m_slots[best].last_used)) {
+			best = i;
+		}
+	}
+	if (best < 0) {
+		return false;
+	}
+
+	auto& slot = m_slots[best];
+	if (slot.used) {
+		m_resident.erase(slot.key);
+		MarkIndirectionDirty(slot.key);
+	}
+	slot.key       = page.key;
+	slot.last_used = m_frame;
+	slot.used      = true;
+	m_resident[page.key] = best;
+
+	const int x = (best % m_cache_side) * m_slot_size;
+	const int y = (best / m_cache_side) * m_slot_size;
+	m_rc->UpdateSubTexture(page.pixels.data(), x, y, m_slot_size, m_slot_size, m_cache_tex);
+
+	MarkIndirectionDirty(page.key);
+	return true;
+}
+
+void VirtualTexture::ParseFeedback(const uint8_t* pixels, int count, std::unordered_set<uint64_t>& wanted) const
+{
+	uint32_t last = 0;
+	for (int i = 0; i < count; ++i, pixels += 4)
+	{
+		// a is level + 1, 0 where nothing was drawn
+		if (pixels[3] == 0 || pixels[3] > m_levels) {
+			continue;
+		}
+		// neighbours mostly want the same page
+		const uint32_t v = pixels[0] | pixels[1] << 8 | pixels[2] << 16 | static_cast<uint32_t>(pixels[3]) << 24;
+		if (v == last) {
+			continue;
+		}
+		last = v;
+
+		const int x = pixels[0] | (pixels[2] & 0xf) << 8;
+		const int y = pixels[1] | (pixels[2] >> 4) << 8;
+		const int level = pixels[3] - 1;
+		const int side = 1 << (m_levels - 1 - level);
+		if (x < side && y < side) {
+			wanted.insert(make_key(level, x, y));
+		}
+	}
+}
+
+void VirtualTexture::QueueRequests(const std::unordered_set<uint64_t>& wanted)
+{
+	// parents refine the view first and keep it sharp as a fallback
+	std::unordered_set<uint64_t> closure;
+	for (auto key : wanted)
+	{
+		int level = key_level(key), x = key_x(key), y = key_y(key);
+		for (; level < m_levels; ++level, x >>= 1, y >>= 1)
+		{
+			if (!closure.insert(make_key(level, x, y)).second) {
+				break;
+			}
+		}
+	}
+
+	std::vector<uint64_t> missing;
+	for (auto key : closure)
+	{
+		auto itr = m_resident.find(key);
+		if (itr != m_resident.end()) {
+			m_slots[itr->second].last_used = m_frame;
+		} else {
+			missing.push_back(key);
+		}
+	}
+	// coarse levels first
+	std::sort(missing.begin(), missing.end(), [](uint64_t a, uint64_t b) { return a > b; });
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unordered_set<uint64_t> loaded;
+		for (auto& page : m_loaded) {
+			loaded.insert(page.key);
+		}
+
+		// pages out of view since the last feedback are dropped
+		m_requests.clear();
+		for (auto key : missing) {
+			if (m_in_flight.find(key) == m_in_flight.end() && loaded.find(key) == loaded.end()) {
+				m_requests.push_back(key);
+			}
+		}
+	}
+	m_cond.notify_all();
+}
+
+void VirtualTexture::MarkIndirectionDirty(uint64_t key)
+{
+	// the page's footprint in level 0
+	const int level = key_level(key);
+	m_dirty[0] = std::min(m_dirty[0], key_x(key) << level);
+	m_dirty[1] = std::min(m_dirty[1], key_y(key) << level);
+	m_dirty[2] = std::max(m_dirty[2], (key_x(key) + 1) << level);
+	m_dirty[3] = std::max(m_dirty[3], (key_y(key) + 1) << level);
+}
+
+void VirtualTexture::UpdateIndirection()
+{
+	if (m_dirty[0] >= m_dirty[2] || m_dirty[1] >= m_dirty[3]) {
+		return;
+	}
+
+	// each page points at itself if resident, else at its parent's target
+	int rects[32][4];
+	for (int level = m_levels - 1; level >= 0; --level)
+	{
+		const int side = 1 << (m_levels - 1 - level);
+		const int mask = (1 << level) - 1;
+		int* r = rects[level];
+		r[0] = m_dirty[0] >> level;
+		r[1] = m_dirty[1] >> level;
+		r[2] = std::min((m_dirty[2] + mask) >> level, side);
+		r[3] = std::min((m_dirty[3] + mask) >> level, side);
+
+		auto& table = m_indirection[level];
+		for (int y = r[1]; y < r[3]; ++y)
+		{
+			for (int x = r[0]; x < r[2]; ++x)
+			{
+				uint32_t& e = table[y * side + x];
+				auto itr = m_resident.find(make_key(level, x, y));
+				if (itr != m_resident.end()) {
+					const uint32_t sx = itr->second % m_cache_side, sy = itr->second / m_cache_side;
+					e = sx | sy << 8 | static_cast<uint32_t>(level) << 16 | 0xff000000;
+				} else if (level + 1 < m_levels) {
+					e = m_indirection[level + 1][(y >> 1) * (side >> 1) + (x >> 1)];
+				} else {
+					e = 0;
+				}
+			}
+		}
+	}
+
+	if (!m_indirection_uploaded)
+	{
+		// coarse to fine, uploaded levels keep the driver from generating mips
+		for (int level = m_levels - 1; level >= 0; --level) {
+			const int side = 1 << (m_levels - 1 - level);
+			m_rc->UpdateTexture(m_indirection_tex, m_indirection[level].data(), side, side, 0, level,
+				TEXTURE_CLAMP_TO_EDGE, TEXTURE_NEAREST);
+		}
+		m_indirection_uploaded = true;
+	}
+	else
+	{
+		for (int level = m_levels - 1; level >= 0; --level)
+		{
+			const int side = 1 << (m_levels - 1 - level);
+			const int* r = rects[level];
+			m_rc->SetUnpackRowLength(side);
+			m_rc->UpdateSubTexture(&m_indirection[level][r[1] * side + r[0]], r[0], r[1],
+				r[2] - r[0], r[3] - r[1], m_indirection_tex, 0, level);
+		}
+		m_rc->SetUnpackRowLength(0);
+	}
+
+	m_dirty[0] = m_dirty[1] = INT_MAX;
+	m_dirty[2] = m_dirty[3] = 0;
+}
+
+}
@@ -0,0 +1,405 @@
+#include "unirender/gl/Capabilities.h"
+
+#include <ejoy2d/opengl.h>
+#include <logger.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <string.h>
+
+namespace
+{
+
+const char* CACHE_VERSION = "ur_caps_1";
+
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif // GL_COMPRESSED_RGBA8_ETC2_EAC
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#endif // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+
+// 0 if the enum is not available with this gl header
+const GLenum cap_names[] = {
+	GL_MAX_TEXTURE_SIZE,
+#ifdef GL_MAX_3D_TEXTURE_SIZE
+	GL_MAX_3D_TEXTURE_SIZE,
+#else
+	0,
+#endif // GL_MAX_3D_TEXTURE_SIZE
+	GL_MAX_CUBE_MAP_TEXTURE_SIZE,
+#ifdef GL_MAX_ARRAY_TEXTURE_LAYERS
+	GL_MAX_ARRAY_TEXTURE_LAYERS,
+#else
+	0,
+#endif // GL_MAX_ARRAY_TEXTURE_LAYERS
+	GL_MAX_TEXTURE_IMAGE_UNITS,
+	GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS,
+#ifdef GL_MAX_UNIFORM_BLOCK_SIZE
+	GL_MAX_UNIFORM_BLOCK_SIZE,
+	GL_MAX_UNIFORM_BUFFER_BINDINGS,
+#else
+	0,
+	0,
+#endif // GL_MAX_UNIFORM_BLOCK_SIZE
+#ifdef GL_MAX_SHADER_STORAGE_BLOCK_SIZE
+	GL_MAX_SHADER_STORAGE_BLOCK_SIZE,
+	GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS,
+#else
+	0,
+	0,
+#endif // GL_MAX_SHADER_STORAGE_BLOCK_SIZE
+#ifdef GL_MAX_COLOR_ATTACHMENTS
+	GL_MAX_COLOR_ATTACHMENTS,
+#else
+	0,
+#endif // GL_MAX_COLOR_ATTACHMENTS
+};
+
+static_assert(sizeof(cap_names) / sizeof(cap_names[0]) == ur::CAP_COUNT, "cap_names size");
+
+}
+
+namespace ur
+{
+namespace gl
+{
+
+Capabilities::Capabilities(const std::string& cache_filepath)
+	: m_filepath(cache_filepath)
+{
+	for (int i = 0; i < CAP_COUNT; ++i) {
+		m_values[i] = -1;
+	}
+	for (int i = 0; i < FORMAT_COUNT; ++i) {
+		m_formats[i] = -1;
+	}
+
+	const char* vendor   = (const char*)glGetString(GL_VENDOR);
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version  = (const char*)glGetString(GL_VERSION);
+	m_driver = std::string(vendor ? vendor : "") + "|" +
+		       std::string(renderer ? renderer : "") + "|" +
+		       std::string(version ? version : "");
+
+	if (!m_filepath.empty()) {
+		LoadCache();
+	}
+}
+
+Capabilities::~Capabilities()
+{
+	Flush();
+}
+
+int Capabilities::GetValue(CAPABILITY cap) const
+{
+	if (cap < 0 || cap >= CAP_COUNT) {
+		return 0;
+	}
+	if (m_values[cap] >= 0) {
+		return m_values[cap];
+	}
+
+	GLint val = 0;
+	if (cap_names[cap] != 0)
+	{
+		glGetError();
+		glGetIntegerv(cap_names[cap], &val);
+		// enum unknown to this context
+		if (glGetError() != GL_NO_ERROR) {
+			val = 0;
+		}
+	}
+
+	m_values[cap] = val;
+	m_dirty = true;
+
+	return val;
+}
+
+bool Capabilities::IsSupportFormat(TEXTURE_FORMAT format) const
+{
+	if (format <= TEXTURE_INVALID || format >= FORMAT_COUNT) {
+		return false;
+	}
+	if (m_formats[format] < 0) {
+		m_formats[format] = ProbeFormat(format) ? 1 : 0;
+		m_dirty = true;
+	}
+	return m_formats[format] != 0;
+}
+
+bool Capabilities::IsSupportExtension(const char* name) const
+{
+	if (!m_ext_loaded) {
+		LoadExtensions();
+	}
+	return m_extensions.find(name) != m_extensions.end();
+}
+
+int Capabilities::GetVersion() const
+{
+	if (m_version >= 0) {
+		return m_version;
+	}
+
+	int major = 0, minor = 0;
+	const char* str = (const char*)glGetString(GL_VERSION);
+	if (str)
+	{
+		// skip prefix like "OpenGL ES "
+		while (*str && (*str < '0' || *str > '9')) {
+			++str;
+		}
+		sscanf(str, "%d.%d", &major, &minor);
+	}
+
+	m_version = major * 10 + minor;
+	m_dirty = true;
+
+	return m_version;
+}
+
+void Capabilities::Flush() const
+{
+	if (m_dirty && !m_filepath.empty()) {
+		StoreCache();
+	}
+	m_dirty = false;
+}
+
+void Capabilities::LoadCache()
+{
+	std::ifstream fin(m_filepath);
+	if (fin.fail()) {
+		return;
+	}
+
+	std::string line;
+	if (!std::getline(fin, line) || line != CACHE_VERSION) {
+		return;
+	}
+	// driver changed, probe again
+	if (!std::getline(fin, line) || line != m_driver) {
+		return;
+	}
+
+	bool has_ext = false;
+	while (std::getline(fin, line))
+	{
+		std::istringstream ss(line);
+		std::string key;
+		ss >> key;
+		if (key == "version")
+		{
+			ss >> m_version;
+		}
+		else if (key == "cap")
+		{
+			int cap = -1, val = -1;
+			ss >> cap >> val;
+			if (cap >= 0 && cap < CAP_COUNT) {
+				m_values[cap] = val;
+			}
+		}
+		else if (key == "fmt")
+		{
+			int fmt = -1, val = -1;
+			ss >> fmt >> val;
+			if (fmt >= 0 && fmt < FORMAT_COUNT) {
+				m_formats[fmt] = static_cast<int8_t>(val);
+			}
+		}
+		else if (key == "ext")
+		{
+			std::string ext;
+			ss >> ext;
+			if (!ext.empty()) {
+				m_extensions.insert(ext);
+			}
+			has_ext = true;
+		}
+		else if (key == "ext_none")
+		{
+			has_ext = true;
+		}
+	}
+	m_ext_loaded = has_ext;
+
+	LOGI("Load caps cache %s\n", m_filepath.c_str());
+}
+
+void Capabilities::StoreCache() const
+{
+	std::ofstream fout(m_filepath);
+	if (fout.fail()) {
+		LOGW("Can't write caps cache %s\n", m_filepath.c_str());
+		return;
+	}
+
+	fout << CACHE_VERSION << "\n";
+	fout << m_driver << "\n";
+	if (m_version >= 0) {
+		fout << "version " << m_version << "\n";
+	}
+	for (int i = 0; i < CAP_COUNT; ++i) {
+		if (m_values[i] >= 0) {
+			fout << "cap " << i << " " << m_values[i] << "\n";
+		}
+	}
+	for (int i = 0; i < FORMAT_COUNT; ++i) {
+		if (m_formats[i] >= 0) {
+			fout << "fmt " << i << " " << static_cast<int>(m_formats[i]) << "\n";
+		}
+	}
+	if (m_ext_loaded)
+	{
+		if (m_extensions.empty()) {
+			fout << "ext_none\n";
+		}
+		for (auto& ext : m_extensions) {
+			fout << "ext " << ext << "\n";
+		}
+	}
+}
+
+void Capabilities::LoadExtensions() const
+{
+	m_ext_loaded = true;
+	m_dirty = true;
+
+#if OPENGLES == 2
+	const char* str = (const char*)glGetString(GL_EXTENSIONS);
+	if (!str) {
+		return;
+	}
+	std::istringstream ss(str);
+	std::string ext;
+	while (ss >> ext) {
+		m_extensions.insert(ext);
+	}
+#else
+	GLint n = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+	for (GLint i = 0; i < n; ++i) {
+		const char* ext = (const char*)(glGetStringi(GL_EXTENSIONS, i));
+		if (ext) {
+			m_extensions.insert(ext);
+		}
+	}
+#endif // OPENGLES
+}
+
+bool Capabilities::ProbeFormat(TEXTURE_FORMAT format) const
+{
+	switch (format)
+	{
+	case TEXTURE_PVR2:
+	case TEXTURE_PVR4:
+#ifdef GL_COMPRESSED_RGBA_PVRTC_4BPPV1_IMG
+		return IsSupportExtension("GL_IMG_texture_compression_pvrtc");
+#else
+		return false;
+#endif // GL_COMPRESSED_RGBA_PVRTC_4BPPV1_IMG
+	case TEXTURE_ETC1:
+#ifdef GL_ETC1_RGB8_OES
+		return IsSupportExtension("GL_OES_compressed_ETC1_RGB8_texture");
+#else
+		return false;
+#endif // GL_ETC1_RGB8_OES
+	case TEXTURE_ETC2:
+		return ProbeETC2();
+	case TEXTURE_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return IsSupportExtension("GL_EXT_texture_compression_s3tc")
+			|| IsInCompressedFormats(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT);
+	case TEXTURE_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		return IsSupportExtension("GL_EXT_texture_compression_s3tc")
+			|| IsInCompressedFormats(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT);
+	case TEXTURE_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return IsSupportExtension("GL_EXT_texture_compression_s3tc")
+			|| IsInCompressedFormats(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	default:
+		return true;
+	}
+}
+
+bool Capabilities::ProbeETC2() const
+{
+#if defined( __APPLE__ ) && !defined(__MACOSX)
+	return false;
+#else
+	bool ret = false;
+#ifdef _WIN32
+	ret = IsSupportExtension("GL_ARB_ES3_compatibility");
+#else
+	ret = IsInCompressedFormats(GL_COMPRESSED_RGBA8_ETC2_EAC);
+#endif // _WIN32
+	if (!ret) {
+		ret = CheckETC2SupportSlow();
+	}
+	return ret;
+#endif
+}
+
+bool Capabilities::IsInCompressedFormats(int gl_format) const
+{
+	if (!m_compressed_loaded)
+	{
+		m_compressed_loaded = true;
+
+		GLint num = 0;
+		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &num);
+		if (num > 0)
+		{
+			std::vector<GLint> fmt_list(num);
+			glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, &fmt_list[0]);
+			m_compressed_formats.insert(fmt_list.begin(), fmt_list.end());
+		}
+	}
+	return m_compressed_formats.find(gl_format) != m_compressed_formats.end();
+}
+
+bool Capabilities::CheckETC2SupportSlow()
+{
+	bool ret = false;
+
+	const int WIDTH = 4;
+	const int HEIGHT = 4;
+	const int BPP = 8;
+	const int SIZE = WIDTH * HEIGHT * BPP / 8;
+	char pixels[SIZE];
+	memset(pixels, 0, SIZE);
+
+	// may run lazily after the context setup, keep bindings untouched
+	GLint old_unit = 0, old_tex = 0;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &old_unit);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &old_tex);
+
+	GLuint tex_id;
+	glGenTextures(1, &tex_id);
+	glBindTexture(GL_TEXTURE_2D, tex_id);
+
+	glGetError();
+	glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA8_ETC2_EAC, 4, 4, 0, SIZE, pixels);
+	GLenum error = glGetError();
+	ret = error == GL_NO_ERROR;
+
+	glBindTexture(GL_TEXTURE_2D, old_tex);
+	glDeleteTextures(1, &tex_id);
+	glActiveTexture(old_unit);
+
+	return ret;
+}
+
+}
+}
@@ -1,6 +1,7 @@
 #include "unirender/gl/RenderContext.h"
 #include "unirender/gl/typedef.h"
 #include "unirender/Utility.h"
+#include "unirender/PixelConvert.h"
 
 #include <guard/check.h>
 #include <ejoy2d/render.h>
@@ -10,6 +11,7 @@
 #include <SM_Vector.h>
 
 #include <cmath>
+#include <algorithm>
 
 #include <stdlib.h>
 #include <assert.h>
@@ -120,6 +122,118 @@ const GLenum access[] = {
     GL_READ_WRITE,
 };
 
+#ifndef GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+#define GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX 0x9048
+#endif // GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif // GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif // GL_TEXTURE_FREE_MEMORY_ATI
+
+uint64_t resource_key(ur::RENDER_OBJ what, uint32_t id)
+{
+    return (static_cast<uint64_t>(what) << 32) | id;
+}
+
+// drivers pad 24 bit formats to 32
+size_t calc_renderbuffer_size(ur::INTERNAL_FORMAT fmt, size_t width, size_t height)
+{
+    size_t bpp = 4;
+    switch (fmt)
+    {
+    case ur::FMT_ALPHA:
+    case ur::FMT_ALPHA4:
+    case ur::FMT_ALPHA8:
+    case ur::FMT_LUMINANCE:
+    case ur::FMT_LUMINANCE4:
+    case ur::FMT_LUMINANCE8:
+    case ur::FMT_INTENSITY:
+    case ur::FMT_INTENSITY4:
+    case ur::FMT_INTENSITY8:
+    case ur::FMT_R3_G3_B2:
+    case ur::FMT_SLUMINANCE:
+    case ur::FMT_SLUMINANCE8:
+        bpp = 1;
+        break;
+    case ur::FMT_ALPHA12:
+    case ur::FMT_ALPHA16:
+    case ur::FMT_DEPTH_COMPONENT16:
+    case ur::FMT_LUMINANCE12:
+    case ur::FMT_LUMINANCE16:
+    case ur::FMT_LUMINANCE_ALPHA:
+    case ur::FMT_LUMINANCE4_ALPHA4:
+    case ur::FMT_LUMINANCE6_ALPHA2:
+    case ur::FMT_LUMINANCE8_ALPHA8:
+    case ur::FMT_INTENSITY12:
+    case ur::FMT_INTENSITY16:
+    case ur::FMT_RGBA2:
+    case ur::FMT_RGBA4:
+    case ur::FMT_RGB5_A1:
+    case ur::FMT_SLUMINANCE_ALPHA:
+    case ur::FMT_SLUMINANCE8_ALPHA8:
+        bpp = 2;
+        break;
+    case ur::FMT_RGB12:
+    case ur::FMT_RGB16:
+    case ur::FMT_RGBA12:
+    case ur::FMT_RGBA16:
+        bpp = 8;
+        break;
+    default:
+        break;
+    }
+    return bpp * width * height;
+}
+
+// float formats read back as 32 bit floats
+bool calc_readback_format(ur::TEXTURE_FORMAT fmt, GLenum& gl_fmt, GLenum& gl_type, size_t& bpp)
+{
+    switch (fmt)
+    {
+    case ur::TEXTURE_RGBA8:
+        gl_fmt = GL_RGBA;
+        gl_type = GL_UNSIGNED_BYTE;
+        bpp = 4;
+        break;
+    case ur::TEXTURE_RED:
+        gl_fmt = GL_RED;
+        gl_type = GL_UNSIGNED_BYTE;
+        bpp = 1;
+        break;
+    case ur::TEXTURE_R16:
+        gl_fmt = GL_RED;
+        gl_type = GL_SHORT;
+        bpp = 2;
+        break;
+    case ur::TEXTURE_RGBA16F:
+        gl_fmt = GL_RGBA;
+        gl_type = GL_FLOAT;
+        bpp = 16;
+        break;
+    case ur::TEXTURE_RGB16F:
+    case ur::TEXTURE_RGB32F:
+        gl_fmt = GL_RGB;
+        gl_type = GL_FLOAT;
+        bpp = 12;
+        break;
+    case ur::TEXTURE_RG16F:
+        gl_fmt = GL_RG;
+        gl_type = GL_FLOAT;
+        bpp = 8;
+        break;
+    case ur::TEXTURE_DEPTH:
+        gl_fmt = GL_DEPTH_COMPONENT;
+        gl_type = GL_FLOAT;
+        bpp = 4;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 const GLenum poly_modes[] = {
     GL_POINT,
     GL_LINE,
@@ -201,8 +315,11 @@ namespace gl
 static std::thread::id MAIN_THREAD_ID;
 #endif // CHECK_MT
 
-RenderContext::RenderContext(int max_texture, std::function<void(ur::RenderContext&)> flush_shader)
-	: m_flush_shader(std::move(flush_shader))
+RenderContext::RenderContext(int max_texture, std::function<void(ur::RenderContext&)> flush_shader,
+	                         const std::string& caps_cache)
+	: m_caps(caps_cache)
+	, m_flush_shader(std::move(flush_shader))
+	, m_transcoder(m_caps.GetDriverInfo())
 {
 #ifdef CHECK_MT
 	MAIN_THREAD_ID = std::this_thread::get_id();
@@ -214,8 +331,8 @@ RenderContext::RenderContext(int max_texture, std::function<void(ur::RenderConte
 	glewInit();
 #endif
 
+	// initial pool capacities, the pools grow in chunks of this size
 	render_init_args RA;
-	// todo: config these args
 	RA.max_buffer  = 128;
 	RA.max_layout  = MAX_LAYOUT;
 	RA.max_target  = 128;
@@ -226,6 +343,43 @@ RenderContext::RenderContext(int max_texture, std::function<void(ur::RenderConte
 	m_render = (render*)malloc(smz);
 	m_render = render_init(&RA, m_render, smz);
 
+	memset(m_raw_memory, 0, sizeof(m_raw_memory));
+	render_set_texture_reload(m_render, ReloadTextureCB, this);
+
+	uint32_t features = 0;
+	if (m_caps.GetVersion() >= 44 || m_caps.IsSupportExtension("GL_ARB_clear_texture")) {
+		features |= EJ_FEATURE_CLEAR_TEXTURE;
+	}
+#if OPENGLES == 0
+	if (m_caps.GetVersion() >= 42 || m_caps.IsSupportExtension("GL_ARB_texture_storage")) {
+		features |= EJ_FEATURE_TEXTURE_STORAGE;
+	}
+	if (m_caps.GetVersion() >= 33 || m_caps.IsSupportExtension("GL_ARB_sampler_objects")) {
+		features |= EJ_FEATURE_SAMPLER_OBJECT;
+	}
+#else
+	if (m_caps.GetVersion() >= 30) {
+		features |= EJ_FEATURE_TEXTURE_STORAGE | EJ_FEATURE_SAMPLER_OBJECT;
+	}
+#endif // OPENGLES
+	render_set_features(m_render, features);
+
+#if OPENGLES == 0 && defined(GL_TEXTURE_CUBE_MAP_SEAMLESS)
+	// filter across cube faces, the small levels of prefiltered maps show
+	// the seams otherwise; always on in es 3.0
+	if (m_caps.GetVersion() >= 32 || m_caps.IsSupportExtension("GL_ARB_seamless_cube_map")) {
+		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	}
+#endif // OPENGLES
+
+#if defined(GL_VERSION_3_2) || defined(GL_ES_VERSION_3_0)
+#if OPENGLES == 0
+	m_fence_support = m_caps.GetVersion() >= 32 || m_caps.IsSupportExtension("GL_ARB_sync");
+#else
+	m_fence_support = m_caps.GetVersion() >= 30;
+#endif // OPENGLES
+#endif
+
 	// Texture
     m_textures.resize(MAX_TEXTURE_CHANNEL, 0);
 
@@ -254,7 +408,9 @@ RenderContext::RenderContext(int max_texture, std::function<void(ur::RenderConte
 
 #if defined( __APPLE__ ) && !defined(__MACOSX)
 #else
-	m_etc2 = CheckETC2Support();
+	// free with a cache hit, the slow probe only runs for an unknown driver
+	m_etc2 = m_caps.IsSupportFormat(TEXTURE_ETC2);
+	m_caps.Flush();
 #endif
 	LOGI("Support etc2 %d\n", IsSupportETC2());
 
@@ -280,6 +436,13 @@ RenderContext::~RenderContext()
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	while (!m_readbacks.empty()) {
+		ReleaseReadback(m_readbacks.begin()->first);
+	}
+	for (auto& buf : m_readback_free) {
+		ReleasePixelBuffer(buf.first);
+	}
+
 	render_exit(m_render);
 	free(m_render);
 }
@@ -293,6 +456,42 @@ int RenderContext::RenderVersion() const
 	return render_version(m_render);
 }
 
+/************************************************************************/
+/* Capability                                                           */
+/************************************************************************/
+
+int RenderContext::GetCapability(CAPABILITY cap) const
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	return m_caps.GetValue(cap);
+}
+
+bool RenderContext::IsSupportTextureFormat(TEXTURE_FORMAT format) const
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	return m_caps.IsSupportFormat(format);
+}
+
+bool RenderContext::IsSupportExtension(const char* name) const
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	return m_caps.IsSupportExtension(name);
+}
+
+const std::string& RenderContext::GetDriverInfo() const
+{
+	return m_caps.GetDriverInfo();
+}
+
 /************************************************************************/
 /* Texture                                                              */
 /************************************************************************/
@@ -306,12 +505,82 @@ int  RenderContext::CreateTexture(const void* pixels, int width, int height, int
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-	RID id = render_texture_create(m_render, width, height, 0, (EJ_TEXTURE_FORMAT)(format), EJ_TEXTURE_2D, mipmap_levels);
+	uint64_t key = 0;
+	size_t size = 0;
+	// offsets into a bound unpack buffer can't be hashed
+	bool dedup = m_tex_dedup && pixels && m_pbo == 0;
+	if (dedup)
+	{
+		const int params[] = { width, height, format, mipmap_levels, wrap, filter };
+		size = Utility::CalcClientSize(format, width, height);
+		key = Utility::HashBytes(pixels, size, Utility::HashBytes(params, sizeof(params)));
 
-	render_texture_update(m_render, id, width, height, 0, pixels, 0, 0,
-        static_cast<EJ_TEXTURE_WRAP>(wrap), static_cast<EJ_TEXTURE_FILTER>(filter));
+		auto itr = m_dedup_keys.find(key);
+		if (itr != m_dedup_keys.end())
+		{
+			auto& tex = m_dedup_textures[itr->second];
+			if (tex.pixels.size() == size && memcmp(tex.pixels.data(), pixels, size) == 0) {
+				++tex.refs;
+				m_tex_dedup_saved += tex.size;
+				return itr->second;
+			}
+			// a hash collision, this one stays unshared
+			dedup = false;
+		}
+	}
+
+	const void* src_pixels = pixels;
+	const int src_format = format;
+	const uint32_t pbo = m_pbo;
+	if (NeedTranscode(format))
+	{
+		format = TextureTranscoder::ChooseTarget(*this, static_cast<TEXTURE_FORMAT>(format));
+		pixels = TranscodePixels(pixels, width, height, src_format, format);
+	}
+
+	RID id = AcquirePooledTexture(width, height, format, mipmap_levels);
+	if (id != 0)
+	{
+		// same storage, no reallocation
+		render_texture_set_param(m_render, id, static_cast<EJ_TEXTURE_WRAP>(wrap),
+			static_cast<EJ_TEXTURE_FILTER>(filter));
+		if (pixels)
+		{
+			if (mipmap_levels > 1) {
+				render_texture_update(m_render, id, width, height, 0, pixels, 0, 0,
+					static_cast<EJ_TEXTURE_WRAP>(wrap), static_cast<EJ_TEXTURE_FILTER>(filter));
+			} else {
+				render_texture_subupdate(m_render, id, pixels, 0, 0, width, height, 0, 0);
+			}
+		}
+	}
+	else
+	{
+		id = render_texture_create(m_render, width, height, 0, (EJ_TEXTURE_FORMAT)(format), EJ_TEXTURE_2D, mipmap_levels);
+		render_texture_update(m_render, id, width, height, 0, pixels, 0, 0,
+			static_cast<EJ_TEXTURE_WRAP>(wrap), static_cast<EJ_TEXTURE_FILTER>(filter));
+	}
     m_textures[7] = id;
 
+	BindPixelBuffer(pbo);
+
+	if (format != src_format && id != 0) {
+		m_transcoded[id] = static_cast<TEXTURE_FORMAT>(src_format);
+	}
+
+	if (dedup && id != 0)
+	{
+		DedupTexture tex;
+		tex.key  = key;
+		tex.refs = 1;
+		tex.size = render_texture_memsize(m_render, id);
+		tex.pixels.assign(static_cast<const uint8_t*>(src_pixels), static_cast<const uint8_t*>(src_pixels) + size);
+		m_dedup_keys.insert({ key, id });
+		m_dedup_textures.insert({ id, std::move(tex) });
+	}
+
+	EnforceTextureBudget();
+
 	return id;
 }
 
@@ -328,10 +597,12 @@ int RenderContext::CreateTexture3D(const void* pixels, int width, int height, in
     render_texture_update(m_render, id, width, height, depth, pixels, 0, 0, EJ_TEXTURE_REPEAT, EJ_TEXTURE_LINEAR);
     m_textures[7] = id;
 
+	EnforceTextureBudget();
+
 	return id;
 }
 
-int RenderContext::CreateTextureCube(int width, int height, int mipmap_levels)
+int RenderContext::CreateTextureCube(int width, int height, int mipmap_levels, int format)
 {
     CheckError();
 
@@ -339,21 +610,54 @@ int RenderContext::CreateTextureCube(int width, int height, int mipmap_levels)
     assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-    RID id = render_texture_create(m_render, 0, 0, 0, EJ_TEXTURE_RGB16F, EJ_TEXTURE_CUBE, mipmap_levels);
+    RID id = render_texture_create(m_render, width, height, 0, (EJ_TEXTURE_FORMAT)(format), EJ_TEXTURE_CUBE, mipmap_levels);
 
     render_texture_update(m_render, id, width, height, 0, nullptr, 0, 0, EJ_TEXTURE_REPEAT, EJ_TEXTURE_LINEAR);
     m_textures[7] = id;
 
+    EnforceTextureBudget();
+
     return id;
 }
 
+int RenderContext::CreateTexture2DArray(const void* pixels, int width, int height, int layers, int format,
+                                        int mipmap_levels, TEXTURE_WRAP wrap, TEXTURE_FILTER filter)
+{
+	CheckError();
+
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	RID id = render_texture_create(m_render, width, height, layers, (EJ_TEXTURE_FORMAT)(format), EJ_TEXTURE_2D_ARRAY, mipmap_levels);
+
+	render_texture_update(m_render, id, width, height, layers, pixels, 0, 0,
+		static_cast<EJ_TEXTURE_WRAP>(wrap), static_cast<EJ_TEXTURE_FILTER>(filter));
+	m_textures[7] = id;
+
+	EnforceTextureBudget();
+
+	return id;
+}
+
 int RenderContext::CreateTextureID(int width, int height, int format, int mipmap_levels)
 {
 #ifdef CHECK_MT
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-	RID id = render_texture_create(m_render, width, height, 0, (EJ_TEXTURE_FORMAT)(format), EJ_TEXTURE_2D, mipmap_levels);
+	const int src_format = format;
+	if (NeedTranscode(format)) {
+		format = TextureTranscoder::ChooseTarget(*this, static_cast<TEXTURE_FORMAT>(format));
+	}
+
+	RID id = AcquirePooledTexture(width, height, format, mipmap_levels);
+	if (id == 0) {
+		id = render_texture_create(m_render, width, height, 0, (EJ_TEXTURE_FORMAT)(format), EJ_TEXTURE_2D, mipmap_levels);
+	}
+	if (format != src_format && id != 0) {
+		m_transcoded[id] = static_cast<TEXTURE_FORMAT>(src_format);
+	}
 	return id;
 }
 
@@ -363,6 +667,10 @@ void RenderContext::ReleaseTexture(int id)
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	if (!ReleaseDedupTexture(id)) {
+		return;
+	}
+
 	// clear texture curr
 	for (int i = 0; i < MAX_TEXTURE_CHANNEL; ++i) {
 		if (m_textures[i] == id) {
@@ -370,6 +678,15 @@ void RenderContext::ReleaseTexture(int id)
 		}
 	}
 
+	m_tex_reloaders.erase(id);
+	m_dirty_textures.erase(id);
+	m_transcoded.erase(id);
+	EraseResourceLabel(TEXTURE, id);
+
+	if (m_tex_pool_cap > 0 && PoolTexture(id)) {
+		return;
+	}
+
 	render_release(m_render, EJ_TEXTURE, id);
 }
 
@@ -380,9 +697,26 @@ void RenderContext::UpdateTexture(int tex_id, const void* pixels, int width, int
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	// reloading an evicted texture restores the same contents
+	if (render_texture_resident(m_render, tex_id)) {
+		DetachDedupTexture(tex_id);
+	}
+
+	const uint32_t pbo = m_pbo;
+	auto itr = m_transcoded.find(tex_id);
+	if (itr != m_transcoded.end())
+	{
+		render_object_info info;
+		if (render_query(m_render, EJ_TEXTURE, tex_id, &info)) {
+			pixels = TranscodePixels(pixels, width, height, itr->second, info.format);
+		}
+	}
+
 	render_texture_update(m_render, tex_id, width, height, 0, pixels, slice, miplevel,
         static_cast<EJ_TEXTURE_WRAP>(wrap), static_cast<EJ_TEXTURE_FILTER>(filter));
     m_textures[7] = tex_id;
+
+	BindPixelBuffer(pbo);
 }
 
 void RenderContext::UpdateTexture3d(int tex_id, const void* pixels, int width, int height, int depth)
@@ -401,8 +735,74 @@ void RenderContext::UpdateSubTexture(const void* pixels, int x, int y, int w, in
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	// the storage must exist before a partial update
+	if (!render_texture_resident(m_render, id)) {
+		ReloadTexture(id);
+	}
+
+	DetachDedupTexture(id);
+
+	const uint32_t pbo = m_pbo;
+	auto itr = m_transcoded.find(id);
+	if (itr != m_transcoded.end())
+	{
+		render_object_info info;
+		if (render_query(m_render, EJ_TEXTURE, id, &info)) {
+			pixels = TranscodePixels(pixels, w, h, itr->second, info.format);
+		}
+	}
+
 	render_texture_subupdate(m_render, id, pixels, x, y, w, h, slice, miplevel);
     m_textures[7] = id;
+
+	BindPixelBuffer(pbo);
+}
+
+void RenderContext::UpdateSubTexture3D(const void* pixels, int x, int y, int z, int w, int h, int d, unsigned int id, int miplevel)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	if (!render_texture_resident(m_render, id)) {
+		ReloadTexture(id);
+	}
+
+	render_texture_subupdate3d(m_render, id, pixels, x, y, z, w, h, d, miplevel);
+	m_textures[7] = id;
+}
+
+void RenderContext::ClearTexture(int id)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	DetachDedupTexture(id);
+
+	if (render_texture_clear(m_render, id)) {
+		m_textures[7] = id;
+		return;
+	}
+
+	// no gpu path for this format, upload zeros
+	render_object_info info;
+	if (!render_query(m_render, EJ_TEXTURE, id, &info) || info.texture_type == EJ_TEXTURE_CUBE) {
+		return;
+	}
+	// in the layout the upload reads, 16F formats are floats
+	const int bpp = PixelConvert::PixelSize(static_cast<TEXTURE_FORMAT>(info.format));
+	std::vector<uint8_t> zero(bpp > 0 ? static_cast<size_t>(bpp) * info.width * info.height
+		: Utility::CalcTextureSize(info.format, info.width, info.height), 0);
+	if (info.texture_type == EJ_TEXTURE_2D) {
+		render_texture_subupdate(m_render, id, zero.data(), 0, 0, info.width, info.height, 0, 0);
+	} else {
+		// a slice at a time, volumes can be large
+		for (int z = 0; z < info.depth; ++z) {
+			render_texture_subupdate3d(m_render, id, zero.data(), 0, 0, z, info.width, info.height, 1, 0);
+		}
+	}
+	m_textures[7] = id;
 }
 
 void RenderContext::BindTexture(int id, int channel)
@@ -411,6 +811,10 @@ void RenderContext::BindTexture(int id, int channel)
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	if (!m_dirty_textures.empty()) {
+		FlushDirtyTexture(id);
+	}
+
 	if (channel < 0 || channel >= MAX_TEXTURE_CHANNEL || m_textures[channel] == id) {
 		return;
 	}
@@ -436,10 +840,72 @@ int RenderContext::GetBindedTexture(TEXTURE_TYPE type, int channel) const
     case TEXTURE_CUBE:
         glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &id);
         break;
+    case TEXTURE_2D_ARRAY:
+        glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &id);
+        break;
     }
     return id;
 }
 
+void RenderContext::SetTextureLodRange(int id, int base, int max)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	render_texture_set_lod_range(m_render, id, base, max);
+	m_textures[7] = id;
+}
+
+void RenderContext::GenerateTextureMipmap(int id)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	render_texture_generate_mipmap(m_render, id);
+	m_textures[7] = id;
+}
+
+bool RenderContext::MarkTextureDirty(int id, const void* image, int x, int y, int w, int h)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	// the rects are copied by rows from the image
+	render_object_info info;
+	if (!render_query(m_render, EJ_TEXTURE, id, &info) || info.format >= EJ_TEXTURE_DEPTH) {
+		LOGW("Can't mark texture %d dirty, not an uncompressed color texture\n", id);
+		return false;
+	}
+
+	auto& dirty = m_dirty_textures[id];
+	dirty.image = static_cast<const uint8_t*>(image);
+	dirty.rects.Add(x, y, w, h);
+	return true;
+}
+
+void RenderContext::SetTranscodeCacheDir(const std::string& dir)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	m_transcoder.SetCacheDir(dir);
+}
+
+void RenderContext::FlushDirtyTextures()
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	while (!m_dirty_textures.empty()) {
+		FlushDirtyTexture(m_dirty_textures.begin()->first);
+	}
+}
+
 void RenderContext::ClearTextureCache()
 {
 #ifdef CHECK_MT
@@ -494,6 +960,11 @@ int  RenderContext::CreateRenderTarget(int id)
 
 	GLuint gl_id = id;
 	glGenFramebuffers(1, &gl_id);
+
+	RawObject obj;
+	obj.create_frame = obj.last_frame = m_frame;
+	m_raw_targets[gl_id] = obj;
+
 	return gl_id;
 }
 
@@ -505,6 +976,9 @@ void RenderContext::ReleaseRenderTarget(int id)
 
 	GLuint gl_id = id;
 	glDeleteFramebuffers(1, &gl_id);
+
+	m_raw_targets.erase(gl_id);
+	EraseResourceLabel(TARGET, gl_id);
 }
 
 void RenderContext::BindRenderTarget(int id)
@@ -522,6 +996,11 @@ void RenderContext::BindRenderTarget(int id)
 		glBindFramebuffer(GL_FRAMEBUFFER, id);
 	}
 
+	auto itr = m_raw_targets.find(id);
+	if (itr != m_raw_targets.end()) {
+		itr->second.last_frame = m_frame;
+	}
+
 	m_rt_layers[m_rt_depth++] = id;
 }
 
@@ -560,6 +1039,16 @@ void RenderContext::BindRenderTargetTex(int tex, ATTACHMENT_TYPE attachment,
     glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[attachment], texture_targets[textarget], gl_tex, level);
 }
 
+void RenderContext::BindRenderTargetTexLayer(int tex, int layer, ATTACHMENT_TYPE attachment, int level)
+{
+#ifdef CHECK_MT
+    assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+    int gl_tex = render_get_texture_gl_id(m_render, tex);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, attachments[attachment], gl_tex, level, layer);
+}
+
 void RenderContext::SetColorBufferList(const std::vector<ATTACHMENT_TYPE>& list)
 {
     std::vector<unsigned int> attachments;
@@ -598,6 +1087,14 @@ uint32_t RenderContext::CreateRenderbufferObject(uint32_t fbo, INTERNAL_FORMAT f
     glGenRenderbuffers(1, &rbo);
     glBindRenderbuffer(GL_RENDERBUFFER, rbo);
     glRenderbufferStorage(GL_RENDERBUFFER, internal_formats[fmt], width, height);
+
+    RawObject obj;
+    obj.mem = MEMORY_RENDERBUFFER;
+    obj.size = calc_renderbuffer_size(fmt, width, height);
+    obj.create_frame = obj.last_frame = m_frame;
+    m_raw_rbos[rbo] = obj;
+    m_raw_memory[MEMORY_RENDERBUFFER] += obj.size;
+
     return rbo;
 }
 
@@ -608,6 +1105,13 @@ void RenderContext::ReleaseRenderbufferObject(uint32_t id)
 #endif // CHECK_MT
 
     glDeleteRenderbuffers(1, &id);
+
+    auto itr = m_raw_rbos.find(id);
+    if (itr != m_raw_rbos.end()) {
+        m_raw_memory[MEMORY_RENDERBUFFER] -= itr->second.size;
+        m_raw_rbos.erase(itr);
+    }
+    EraseResourceLabel(RENDERBUFFER, id);
 }
 
 void RenderContext::BindRenderbufferObject(uint32_t rbo, ATTACHMENT_TYPE attachment)
@@ -675,15 +1179,17 @@ int RenderContext::CreatePixelBuffer(uint32_t id, int width, int height, int for
 	GLuint gl_id = id;
 	glGenBuffers(1, &gl_id);
 	BindPixelBuffer(gl_id);
-	size_t sz = Utility::CalcTextureSize(format, width, height);
+	size_t sz = Utility::CalcClientSize(format, width, height);
 	glBufferData(GL_PIXEL_UNPACK_BUFFER, sz, 0, GL_STREAM_DRAW);
 	UnbindPixelBuffer();
+	TrackBuffer(gl_id, MEMORY_PIXELBUFFER, sz);
 	return gl_id;
 }
 
 void RenderContext::ReleasePixelBuffer(uint32_t id)
 {
 	glDeleteBuffers(1, &id);
+	UntrackBuffer(id);
 }
 
 void RenderContext::BindPixelBuffer(uint32_t id)
@@ -709,52 +1215,247 @@ void* RenderContext::MapPixelBuffer(ACCESS_MODE mode)
 	return glMapBuffer(GL_PIXEL_UNPACK_BUFFER, access[mode]);
 }
 
+void* RenderContext::MapPixelBufferRange(size_t offset, size_t size, bool unsynchronized)
+{
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+	if (unsynchronized) {
+		flags |= GL_MAP_UNSYNCHRONIZED_BIT;
+	}
+	return glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, flags);
+}
+
 void  RenderContext::UnmapPixelBuffer()
 {
 	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 }
 
-/************************************************************************/
-/* Shader                                                               */
-/************************************************************************/
-
-int  RenderContext::CreateShader(const char* vs, const char* fs, const std::vector<std::string>& textures, bool no_header)
+int RenderContext::ReadPixelsAsync(int x, int y, int w, int h, TEXTURE_FORMAT format)
 {
 #ifdef CHECK_MT
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-	struct shader_init_args args;
+	GLenum gl_fmt, gl_type;
+	size_t bpp;
+	if (!calc_readback_format(format, gl_fmt, gl_type, bpp)) {
+		return 0;
+	}
+	const size_t size = bpp * w * h;
 
-	args.vs = vs;
-	args.fs = fs;
-    args.cs = nullptr;
-    args.no_header = no_header ? 1 : 0;
-    if (std::string(vs).find("#version") != std::string::npos &&
-        std::string(fs).find("#version") != std::string::npos) {
-        args.no_header = 1;
-    }
+	Readback rb;
+	rb.size = size;
 
-	int n = textures.size();
-	args.texture = n;
-	if (n > 0)
+	// smallest free buffer large enough, at most twice the size
+	int best = -1;
+	for (int i = 0, n = m_readback_free.size(); i < n; ++i)
 	{
-		args.texture_uniform = (const char**)malloc(sizeof(char*) * n);
-		for (int i = 0; i < args.texture; ++i)
-		{
-			auto& src = textures[i];
-			char* dst = (char*)malloc(src.size() + 1);
-			strcpy(dst, src.c_str());
-			args.texture_uniform[i] = dst;
+		auto sz = m_readback_free[i].second;
+		if (sz >= size && sz <= size * 2 && (best < 0 || sz < m_readback_free[best].second)) {
+			best = i;
 		}
 	}
+	if (best >= 0)
+	{
+		rb.pbo = m_readback_free[best].first;
+		m_readback_free.erase(m_readback_free.begin() + best);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+	}
 	else
 	{
-		args.texture_uniform = NULL;
+		GLuint pbo = 0;
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+		TrackBuffer(pbo, MEMORY_PIXELBUFFER, size);
+		rb.pbo = pbo;
 	}
 
-	return render_shader_create(m_render, &args);
-}
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, w, h, gl_fmt, gl_type, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	rb.fence = CreateFence();
+
+	int ticket = m_next_readback++;
+	if (m_next_readback <= 0) {
+		m_next_readback = 1;
+	}
+	m_readbacks.insert({ ticket, rb });
+
+	return ticket;
+}
+
+bool RenderContext::IsReadbackReady(int ticket) const
+{
+	auto itr = m_readbacks.find(ticket);
+	if (itr == m_readbacks.end()) {
+		return false;
+	}
+	return IsFenceSignaled(itr->second.fence);
+}
+
+const void* RenderContext::MapReadback(int ticket, bool wait)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	auto itr = m_readbacks.find(ticket);
+	if (itr == m_readbacks.end()) {
+		return nullptr;
+	}
+
+	auto& rb = itr->second;
+	if (rb.mapped) {
+		return rb.mapped;
+	}
+
+	if (rb.fence != 0)
+	{
+		if (!IsFenceSignaled(rb.fence))
+		{
+			if (!wait) {
+				return nullptr;
+			}
+			WaitFence(rb.fence);
+		}
+		ReleaseFence(rb.fence);
+		rb.fence = 0;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+	rb.mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rb.size, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return rb.mapped;
+}
+
+void RenderContext::ReleaseReadback(int ticket)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	auto itr = m_readbacks.find(ticket);
+	if (itr == m_readbacks.end()) {
+		return;
+	}
+
+	auto& rb = itr->second;
+	if (rb.mapped) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	ReleaseFence(rb.fence);
+
+	if (m_readback_free.size() < MAX_FREE_READBACK) {
+		m_readback_free.push_back({ rb.pbo, rb.size });
+	} else {
+		ReleasePixelBuffer(rb.pbo);
+	}
+
+	m_readbacks.erase(itr);
+}
+
+/************************************************************************/
+/* Fence                                                                */
+/************************************************************************/
+
+uint64_t RenderContext::CreateFence()
+{
+#if defined(GL_VERSION_3_2) || defined(GL_ES_VERSION_3_0)
+	if (m_fence_support) {
+		GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		// polls don't flush, without it an offscreen context never
+		// submits the fence
+		glFlush();
+		return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(sync));
+	}
+#endif
+	return 0;
+}
+
+void RenderContext::ReleaseFence(uint64_t fence)
+{
+#if defined(GL_VERSION_3_2) || defined(GL_ES_VERSION_3_0)
+	if (fence != 0) {
+		glDeleteSync(reinterpret_cast<GLsync>(static_cast<uintptr_t>(fence)));
+	}
+#endif
+}
+
+bool RenderContext::IsFenceSignaled(uint64_t fence) const
+{
+#if defined(GL_VERSION_3_2) || defined(GL_ES_VERSION_3_0)
+	if (fence != 0) {
+		GLenum ret = glClientWaitSync(reinterpret_cast<GLsync>(static_cast<uintptr_t>(fence)), 0, 0);
+		return ret == GL_ALREADY_SIGNALED || ret == GL_CONDITION_SATISFIED;
+	}
+#endif
+	return true;
+}
+
+void RenderContext::WaitFence(uint64_t fence)
+{
+#if defined(GL_VERSION_3_2) || defined(GL_ES_VERSION_3_0)
+	if (fence != 0) {
+		// flush on the first wait, or the fence may never be submitted
+		GLsync sync = reinterpret_cast<GLsync>(static_cast<uintptr_t>(fence));
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (true)
+		{
+			GLenum ret = glClientWaitSync(sync, flags, 1000000);
+			if (ret != GL_TIMEOUT_EXPIRED) {
+				break;
+			}
+			flags = 0;
+		}
+	}
+#endif
+}
+
+/************************************************************************/
+/* Shader                                                               */
+/************************************************************************/
+
+int  RenderContext::CreateShader(const char* vs, const char* fs, const std::vector<std::string>& textures, bool no_header)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	struct shader_init_args args;
+
+	args.vs = vs;
+	args.fs = fs;
+    args.cs = nullptr;
+    args.no_header = no_header ? 1 : 0;
+    if (std::string(vs).find("#version") != std::string::npos &&
+        std::string(fs).find("#version") != std::string::npos) {
+        args.no_header = 1;
+    }
+
+	int n = textures.size();
+	args.texture = n;
+	if (n > 0)
+	{
+		args.texture_uniform = (const char**)malloc(sizeof(char*) * n);
+		for (int i = 0; i < args.texture; ++i)
+		{
+			auto& src = textures[i];
+			char* dst = (char*)malloc(src.size() + 1);
+			strcpy(dst, src.c_str());
+			args.texture_uniform[i] = dst;
+		}
+	}
+	else
+	{
+		args.texture_uniform = NULL;
+	}
+
+	return render_shader_create(m_render, &args);
+}
 
 int RenderContext::CreateShader(const char* cs)
 {
@@ -780,6 +1481,8 @@ void RenderContext::ReleaseShader(int id)
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	EraseResourceLabel(SHADER, id);
+
 	render_release(m_render, EJ_SHADER, id);
 }
 
@@ -1209,6 +1912,8 @@ void RenderContext::DrawElements(DRAW_MODE mode, int fromidx, int ni, bool type_
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	FlushBoundDirtyTextures();
+
 	render_draw_elements(m_render, (EJ_DRAW_MODE)mode, fromidx, ni, type_short ? 1 : 0);
 }
 
@@ -1218,6 +1923,8 @@ void RenderContext::DrawElements(DRAW_MODE mode, int count, unsigned int* indice
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	FlushBoundDirtyTextures();
+
 	render_draw_elements_no_buf(m_render, (EJ_DRAW_MODE)mode, count, indices);
 }
 
@@ -1227,6 +1934,8 @@ void RenderContext::DrawArrays(DRAW_MODE mode, int fromidx, int ni)
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	FlushBoundDirtyTextures();
+
 	render_draw_arrays(m_render, (EJ_DRAW_MODE)mode, fromidx, ni);
 }
 
@@ -1245,6 +1954,8 @@ void RenderContext::ReleaseBuffer(RENDER_OBJ what, int id)
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	EraseResourceLabel(what, id);
+
 	render_release(m_render, (EJ_RENDER_OBJ)what, id);
 }
 
@@ -1306,6 +2017,8 @@ void RenderContext::ReleaseVertexLayout(int id)
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	EraseResourceLabel(VERTEXLAYOUT, id);
+
 	render_release(m_render, EJ_VERTEXLAYOUT, id);
 }
 
@@ -1368,13 +2081,16 @@ void RenderContext::CreateVAO(const VertexInfo& vi,
 
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	glBufferData(GL_ARRAY_BUFFER, vi.vn * vi.stride, vi.vertices, usages[vi.vert_usage]);
+	TrackBuffer(vbo, MEMORY_BUFFER, vi.vn * vi.stride);
 
 	if (element) {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
         if (vi.idx_short) {
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(short) * vi.in, vi.indices, usages[vi.index_usage]);
+            TrackBuffer(ebo, MEMORY_BUFFER, sizeof(short) * vi.in);
         } else {
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * vi.in, vi.indices, usages[vi.index_usage]);
+            TrackBuffer(ebo, MEMORY_BUFFER, sizeof(uint32_t) * vi.in);
         }
     } else {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -1421,8 +2137,10 @@ void RenderContext::ReleaseVAO(unsigned int vao, unsigned int vbo, unsigned int
 {
 	glDeleteVertexArrays(1, &vao);
 	glDeleteBuffers(1, &vbo);
+	UntrackBuffer(vbo);
 	if (ebo != 0) {
 		glDeleteBuffers(1, &ebo);
+		UntrackBuffer(ebo);
 	}
 }
 
@@ -1432,6 +2150,8 @@ void RenderContext::DrawElementsVAO(DRAW_MODE mode, int fromidx, int ni, unsigne
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	FlushBoundDirtyTextures();
+
 	render_draw_elements_vao(m_render, (EJ_DRAW_MODE)mode, fromidx, ni, vao, type_short ? 1 : 0);
 }
 
@@ -1441,6 +2161,8 @@ void RenderContext::DrawArraysVAO(DRAW_MODE mode, int fromidx, int ni, unsigned
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
+	FlushBoundDirtyTextures();
+
 	render_draw_arrays_vao(m_render, (EJ_DRAW_MODE)mode, fromidx, ni, vao);
 }
 
@@ -1816,12 +2538,21 @@ uint32_t RenderContext::CreateComputeBuffer(const std::vector<float>& buf, size_
 void RenderContext::ReleaseComputeBuffer(uint32_t id) const
 {
     glDeleteBuffers(1, &id);
+    UntrackBuffer(id);
+}
+
+void RenderContext::BindComputeBuffer(uint32_t id, size_t index) const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, id);
 }
 
 void RenderContext::DispatchCompute(int thread_group_count) const
 {
+    // textures set by BindTexture are only recorded until a commit
+    render_commit(m_render);
     glDispatchCompute(thread_group_count, 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    // outputs may be copied into textures through GL_PIXEL_UNPACK_BUFFER
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
 }
 
 void RenderContext::GetComputeBufferData(uint32_t id, std::vector<int>& result) const
@@ -1830,183 +2561,627 @@ void RenderContext::GetComputeBufferData(uint32_t id, std::vector<int>& result)
 }
 
 /************************************************************************/
-/* Debug                                                                */
+/* Memory                                                               */
 /************************************************************************/
 
-int RenderContext::GetRealTexID(int id)
+size_t RenderContext::GetMemoryUsage(MEMORY_TYPE type) const
+{
+	switch (type)
+	{
+	case MEMORY_TEXTURE:
+		// pooled textures are still allocated in the render layer
+		return static_cast<size_t>(render_memory_usage(m_render, EJ_MEMORY_TEXTURE)) - m_tex_pool_size;
+	case MEMORY_TEXTURE_POOL:
+		return m_tex_pool_size;
+	case MEMORY_BUFFER:
+		return static_cast<size_t>(render_memory_usage(m_render, EJ_MEMORY_BUFFER))
+			+ m_raw_memory[MEMORY_BUFFER];
+	case MEMORY_RENDERBUFFER:
+	case MEMORY_PIXELBUFFER:
+		return m_raw_memory[type];
+	default:
+	{
+		size_t sum = 0;
+		for (int i = 0; i < MEMORY_COUNT; ++i) {
+			sum += GetMemoryUsage(static_cast<MEMORY_TYPE>(i));
+		}
+		return sum;
+	}
+	}
+}
+
+bool RenderContext::QueryDeviceMemory(size_t& total, size_t& available) const
 {
 #ifdef CHECK_MT
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-	return render_get_texture_gl_id(m_render, id);
+	// both report in kB
+	if (m_caps.IsSupportExtension("GL_NVX_gpu_memory_info"))
+	{
+		GLint total_kb = 0, avail_kb = 0;
+		glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total_kb);
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &avail_kb);
+		total = static_cast<size_t>(total_kb) * 1024;
+		available = static_cast<size_t>(avail_kb) * 1024;
+		return true;
+	}
+	else if (m_caps.IsSupportExtension("GL_ATI_meminfo"))
+	{
+		// total free, largest free block, total aux free, largest aux free
+		GLint info[4] = { 0 };
+		glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, info);
+		total = 0;
+		available = static_cast<size_t>(info[0]) * 1024;
+		return true;
+	}
+	return false;
 }
 
-/************************************************************************/
-/* Other                                                                */
-/************************************************************************/
+bool RenderContext::CheckAvailableMemory(int need_texture_area) const
+{
+	// area of RGBA4 pixels
+	const size_t need = static_cast<size_t>(need_texture_area) * 2;
 
-void RenderContext::ReadBuffer()
+	size_t total, available;
+	if (QueryDeviceMemory(total, available)) {
+		return available >= need;
+	}
+
+	// unknown device, nothing to check against
+	return true;
+}
+
+void RenderContext::SetTextureBudget(size_t bytes)
 {
-#ifdef CHECK_MT
-	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
-#endif // CHECK_MT
+	m_tex_budget = bytes;
+	EnforceTextureBudget();
+}
 
-#if OPENGLES != 2
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
-#endif // OPENGLES
+void RenderContext::SetTextureReloader(int id, std::function<void(int id)> reload, const void* owner)
+{
+	if (reload)
+	{
+		auto& list = m_tex_reloaders[id];
+		auto itr = std::find_if(list.begin(), list.end(),
+			[owner](const std::pair<const void*, std::function<void(int)>>& r) { return r.first == owner; });
+		if (itr != list.end()) {
+			itr->second = std::move(reload);
+		} else {
+			list.push_back({ owner, std::move(reload) });
+		}
+	}
+	else
+	{
+		// can't be restored afterwards
+		if (!render_texture_resident(m_render, id)) {
+			ReloadTexture(id);
+		}
+		RemoveTextureReloader(id, owner);
+	}
 }
 
-void RenderContext::ReadPixels(const unsigned char* pixels, int channels, int x, int y, int w, int h)
+void RenderContext::RemoveTextureReloader(int id, const void* owner)
 {
-    ReadPixelsImpl(pixels, channels, x, y, w, h, GL_UNSIGNED_BYTE);
+	auto itr = m_tex_reloaders.find(id);
+	if (itr == m_tex_reloaders.end()) {
+		return;
+	}
+
+	auto is_owner = [owner](const std::pair<const void*, std::function<void(int)>>& r) {
+		return r.first == owner;
+	};
+	if (std::find_if(itr->second.begin(), itr->second.end(), is_owner) == itr->second.end()) {
+		return;
+	}
+
+	// the other references of a shared id still need the contents
+	if (itr->second.size() == 1 && !render_texture_resident(m_render, id))
+	{
+		auto dedup = m_dedup_textures.find(id);
+		if (dedup != m_dedup_textures.end() && dedup->second.refs > 1) {
+			ReloadTexture(id);
+			itr = m_tex_reloaders.find(id);
+		}
+	}
+
+	auto& list = itr->second;
+	list.erase(std::find_if(list.begin(), list.end(), is_owner));
+	if (list.empty()) {
+		m_tex_reloaders.erase(itr);
+	}
 }
 
-void RenderContext::ReadPixels(const short* pixels, int channels, int x, int y, int w, int h)
+bool RenderContext::IsTextureResident(int id) const
 {
-    ReadPixelsImpl(pixels, channels, x, y, w, h, GL_SHORT);
+	return render_texture_resident(m_render, id) != 0;
 }
 
-bool RenderContext::CheckAvailableMemory(int need_texture_area) const
+void RenderContext::SetTexturePoolSize(size_t bytes)
 {
-#ifdef CHECK_MT
-	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
-#endif // CHECK_MT
+	m_tex_pool_cap = bytes;
+	TrimTexturePool(m_tex_pool_cap);
+}
 
-	const int EDGE = 1024;
-	const int AREA = EDGE * EDGE;
-	uint8_t* empty_data = new uint8_t[AREA * 2];
-	memset(empty_data, 0x00, AREA * 2);
+bool RenderContext::PoolTexture(int id)
+{
+	render_object_info info;
+	if (!render_query(m_render, EJ_TEXTURE, id, &info) ||
+		info.texture_type != EJ_TEXTURE_2D ||
+		info.streaming ||
+		!render_texture_resident(m_render, id) ||
+		static_cast<size_t>(info.size) > m_tex_pool_cap) {
+		return false;
+	}
 
-	glActiveTexture(GL_TEXTURE0);
+	PooledTexture tex;
+	tex.id            = id;
+	tex.width         = info.width;
+	tex.height        = info.height;
+	tex.format        = info.format;
+	tex.mipmap_levels = info.mipmap_levels;
+	tex.size          = info.size;
+	m_tex_pool.push_front(tex);
+	m_tex_pool_size += tex.size;
 
-	int max_count = static_cast<int>(std::ceil((float)need_texture_area / AREA));
-	GLuint* id_list = new GLuint[max_count];
+	TrimTexturePool(m_tex_pool_cap);
 
-	int curr_area = 0;
-	int curr_count = 0;
-	while (true) {
-		unsigned int texid = 0;
-		glGenTextures(1, &texid);
-		glBindTexture(GL_TEXTURE_2D, texid);
+	return true;
+}
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei)EDGE, (GLsizei)EDGE, 0, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, empty_data);
-		if (glGetError() == GL_OUT_OF_MEMORY) {
-			break;
-		} else {
-			id_list[curr_count++] = texid;
-			curr_area += AREA;
-			if (curr_area >= need_texture_area) {
-				break;
-			}
+int RenderContext::AcquirePooledTexture(int width, int height, int format, int mipmap_levels)
+{
+	for (auto itr = m_tex_pool.begin(); itr != m_tex_pool.end(); ++itr)
+	{
+		if (itr->width == width && itr->height == height &&
+			itr->format == format && itr->mipmap_levels == mipmap_levels)
+		{
+			int id = itr->id;
+			m_tex_pool_size -= itr->size;
+			m_tex_pool.erase(itr);
+			return id;
+		}
+	}
+	return 0;
+}
+
+void RenderContext::TrimTexturePool(size_t cap)
+{
+	while (m_tex_pool_size > cap && !m_tex_pool.empty())
+	{
+		auto& tex = m_tex_pool.back();
+		m_tex_pool_size -= tex.size;
+		render_release(m_render, EJ_TEXTURE, tex.id);
+		m_tex_pool.pop_back();
+	}
+}
+
+bool RenderContext::IsPooledTexture(int id) const
+{
+	for (auto& tex : m_tex_pool) {
+		if (tex.id == id) {
+			return true;
 		}
 	}
+	return false;
+}
 
-	glDeleteTextures(curr_count, id_list);
+bool RenderContext::ReleaseDedupTexture(int id)
+{
+	auto itr = m_dedup_textures.find(id);
+	if (itr == m_dedup_textures.end()) {
+		return true;
+	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	auto& tex = itr->second;
+	if (--tex.refs > 0) {
+		m_tex_dedup_saved -= tex.size;
+		return false;
+	}
 
-	delete[] empty_data;
-	delete[] id_list;
+	if (tex.attached) {
+		m_dedup_keys.erase(tex.key);
+	}
+	m_dedup_textures.erase(itr);
+	return true;
+}
 
-	return curr_area >= need_texture_area;
+bool RenderContext::IsTextureShared(int id) const
+{
+	auto itr = m_dedup_textures.find(id);
+	return itr != m_dedup_textures.end() && itr->second.refs > 1;
 }
 
-void RenderContext::EnableFlushCB(bool enable)
+void RenderContext::DetachDedupTexture(int id)
 {
-	if (!enable) {
-		++m_cb_enable;
+	if (m_dedup_textures.empty()) {
+		return;
+	}
+
+	// contents no longer match the key, later uploads get a new texture
+	auto itr = m_dedup_textures.find(id);
+	if (itr != m_dedup_textures.end() && itr->second.attached) {
+		m_dedup_keys.erase(itr->second.key);
+		itr->second.attached = false;
+		itr->second.pixels.clear();
+		itr->second.pixels.shrink_to_fit();
+	}
+}
+
+void RenderContext::FlushDirtyTexture(int id)
+{
+	auto itr = m_dirty_textures.find(id);
+	if (itr == m_dirty_textures.end()) {
+		return;
+	}
+
+	render_object_info info;
+	if (render_query(m_render, EJ_TEXTURE, id, &info) && info.format < EJ_TEXTURE_DEPTH)
+	{
+		// rows are read from the whole image
+		const size_t bpp = Utility::CalcClientSize(info.format, 1, 1);
+		UnbindPixelBuffer();
+		SetUnpackRowLength(info.width);
+		for (auto& r : itr->second.rects.GetRects()) {
+			const uint8_t* src = itr->second.image + (static_cast<size_t>(r.y) * info.width + r.x) * bpp;
+			UpdateSubTexture(src, r.x, r.y, r.w, r.h, id);
+		}
+		SetUnpackRowLength(0);
+	}
+
+	m_dirty_textures.erase(itr);
+}
+
+void RenderContext::FlushBoundDirtyTextures()
+{
+	if (m_dirty_textures.empty()) {
+		return;
+	}
+	for (int i = 0; i < MAX_TEXTURE_CHANNEL; ++i) {
+		if (m_textures[i] != 0) {
+			FlushDirtyTexture(m_textures[i]);
+		}
+	}
+}
+
+bool RenderContext::NeedTranscode(int format) const
+{
+	return TextureTranscoder::IsDecodable(static_cast<TEXTURE_FORMAT>(format))
+		&& !m_caps.IsSupportFormat(static_cast<TEXTURE_FORMAT>(format));
+}
+
+const void* RenderContext::TranscodePixels(const void* pixels, int width, int height, int src_format, int dst_format)
+{
+	if ((!pixels && m_pbo == 0) || src_format == dst_format) {
+		return pixels;
+	}
+
+	const void* src = pixels;
+	if (m_pbo != 0)
+	{
+		const size_t offset = reinterpret_cast<size_t>(pixels);
+		const size_t size = Utility::CalcTextureSize(src_format, width, height);
+		src = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, GL_MAP_READ_BIT);
+		if (!src) {
+			LOGW("Can't map pixel buffer %d for transcoding\n", m_pbo);
+		}
+	}
+
+	bool ok = src && m_transcoder.Transcode(src, width, height, static_cast<TEXTURE_FORMAT>(src_format),
+		static_cast<TEXTURE_FORMAT>(dst_format), m_transcode_buf);
+
+	// the transcoded pixels are client memory
+	if (m_pbo != 0)
+	{
+		if (src) {
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		UnbindPixelBuffer();
+	}
+
+	if (!ok)
+	{
+		// the storage is sized for dst_format, don't read past the source
+		LOGW("Can't transcode texture format %d to %d\n", src_format, dst_format);
+		return nullptr;
+	}
+	return m_transcode_buf.data();
+}
+
+void RenderContext::EnforceTextureBudget()
+{
+	if (m_tex_budget == 0) {
+		return;
+	}
+
+	size_t used = GetMemoryUsage(MEMORY_TEXTURE);
+	// the pool gives way before live textures are evicted
+	if (used + m_tex_pool_size > m_tex_budget) {
+		TrimTexturePool(m_tex_budget > used ? m_tex_budget - used : 0);
+	}
+	if (used <= m_tex_budget) {
+		return;
+	}
+
+	// last bound frame, id
+	std::vector<std::pair<int, int>> lru;
+	lru.reserve(m_tex_reloaders.size());
+	for (auto& itr : m_tex_reloaders)
+	{
+		int id = itr.first;
+		if (!render_texture_resident(m_render, id)) {
+			continue;
+		}
+		// keep textures used by the current frame
+		int frame = render_texture_last_frame(m_render, id);
+		if (frame >= m_frame) {
+			continue;
+		}
+		lru.push_back({ frame, id });
+	}
+	std::sort(lru.begin(), lru.end());
+
+	for (auto& tex : lru)
+	{
+		if (used <= m_tex_budget) {
+			break;
+		}
+		used -= render_texture_memsize(m_render, tex.second);
+		render_texture_evict(m_render, tex.second);
+	}
+}
+
+void RenderContext::ReloadTexture(int id)
+{
+	auto itr = m_tex_reloaders.find(id);
+	if (itr != m_tex_reloaders.end()) {
+		// the reloader passes client memory, not offsets into the caller's
+		// unpack buffer
+		const uint32_t pbo = m_pbo;
+		UnbindPixelBuffer();
+		itr->second.front().second(id);
+		if (pbo != 0) {
+			BindPixelBuffer(pbo);
+		}
 	} else {
-		--m_cb_enable;
+		LOGW("Texture %d evicted without reloader.\n", id);
 	}
 }
 
-void RenderContext::CallFlushCB()
+void RenderContext::ReloadTextureCB(void* ud, unsigned int id)
 {
-	if (m_cb_enable == 0 && m_flush_shader) {
-		m_flush_shader(*this);
+	static_cast<RenderContext*>(ud)->ReloadTexture(static_cast<int>(id));
+}
+
+void RenderContext::TrackBuffer(uint32_t id, MEMORY_TYPE type, size_t size) const
+{
+	UntrackBuffer(id);
+
+	RawObject obj;
+	obj.mem = type;
+	obj.size = size;
+	obj.create_frame = m_frame;
+	m_raw_buffers.insert({ id, obj });
+	m_raw_memory[type] += size;
+}
+
+void RenderContext::UntrackBuffer(uint32_t id) const
+{
+	auto itr = m_raw_buffers.find(id);
+	if (itr != m_raw_buffers.end()) {
+		m_raw_memory[itr->second.mem] -= itr->second.size;
+		m_raw_buffers.erase(itr);
 	}
+	EraseResourceLabel(PIXELBUFFER, id);
+}
+
+/************************************************************************/
+/* Debug                                                                */
+/************************************************************************/
+
+int RenderContext::GetRealTexID(int id)
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
+
+	return render_get_texture_gl_id(m_render, id);
 }
 
-bool RenderContext::CheckETC2Support()
+void RenderContext::SetResourceLabel(RENDER_OBJ what, int id, const std::string& label,
+	                                 const std::string& owner)
 {
 #ifdef CHECK_MT
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-	bool etc2 = CheckETC2SupportFast();
-	if (!etc2) {
-		etc2 = CheckETC2SupportSlow();
+	auto& dst = m_labels[resource_key(what, id)];
+	dst.label = label;
+	dst.owner = owner;
+
+#ifdef GL_VERSION_4_3
+	if (label.empty() || !m_caps.IsSupportExtension("GL_KHR_debug")) {
+		return;
+	}
+
+	GLenum identifier = 0;
+	GLuint glid = id;
+	switch (what)
+	{
+	case VERTEXBUFFER:
+	case INDEXBUFFER:
+	case TEXTURE:
+	case SHADER:
+	{
+		render_object_info info;
+		if (!render_query(m_render, static_cast<EJ_RENDER_OBJ>(what), id, &info)) {
+			return;
+		}
+		glid = info.glid;
+		identifier = what == TEXTURE ? GL_TEXTURE : (what == SHADER ? GL_PROGRAM : GL_BUFFER);
 	}
-	return etc2;
+		break;
+	case TARGET:
+		identifier = GL_FRAMEBUFFER;
+		break;
+	case RENDERBUFFER:
+		identifier = GL_RENDERBUFFER;
+		break;
+	case PIXELBUFFER:
+		identifier = GL_BUFFER;
+		break;
+	default:
+		return;
+	}
+	glObjectLabel(identifier, glid, static_cast<GLsizei>(label.size()), label.c_str());
+#endif // GL_VERSION_4_3
 }
 
-bool RenderContext::CheckETC2SupportFast()
+void RenderContext::QueryResources(std::vector<ResourceInfo>& resources) const
 {
 #ifdef CHECK_MT
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-	bool ret = false;
-#if defined( __APPLE__ ) && !defined(__MACOSX)
-#elif defined _WIN32
-	GLint n;
-	glGetIntegerv(GL_NUM_EXTENSIONS, &n);
-	for (GLint i = 0; i < n; ++i) {
-		if (strcmp((const char*)(glGetStringi(GL_EXTENSIONS, i)), "GL_ARB_ES3_compatibility") == 0) {
-			ret = true;
-			break;
+	struct Visitor
+	{
+		const RenderContext* rc;
+		std::vector<ResourceInfo>* dst;
+	};
+	Visitor visitor = { this, &resources };
+
+	auto visit = [](void* ud, const render_object_info* src)
+	{
+		auto v = static_cast<Visitor*>(ud);
+		// released, waiting in the pool for reuse
+		if (src->type == EJ_TEXTURE && v->rc->IsPooledTexture(src->id)) {
+			return;
 		}
+		ResourceInfo info;
+		info.type         = static_cast<RENDER_OBJ>(src->type);
+		info.id           = src->id;
+		info.size         = src->size;
+		info.width        = src->width;
+		info.height       = src->height;
+		info.depth        = src->depth;
+		info.format       = src->type == EJ_TEXTURE ? src->format : TEXTURE_INVALID;
+		info.create_frame = src->create_frame;
+		info.last_frame   = src->last_frame;
+		v->rc->FillResourceLabel(info);
+		v->dst->push_back(info);
+	};
+
+	const EJ_RENDER_OBJ pooled[] = {
+		EJ_VERTEXLAYOUT, EJ_VERTEXBUFFER, EJ_INDEXBUFFER, EJ_TEXTURE, EJ_TARGET, EJ_SHADER
+	};
+	for (auto what : pooled) {
+		render_foreach(m_render, what, visit, &visitor);
 	}
-#else
-	GLint num;
-	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &num);
-	CU_VEC<GLint> fmt_list;
-	fmt_list.resize(num);
-	glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, &fmt_list[0]);
-	for (int i = 0, n = fmt_list.size(); i < n; ++i) {
-		if (fmt_list[i] == 0x9278) {
-			ret = true;
-			break;
+
+	auto add_raw = [&](RENDER_OBJ type, uint32_t id, const RawObject& obj, bool labeled)
+	{
+		ResourceInfo info;
+		info.type         = type;
+		info.id           = id;
+		info.size         = obj.size;
+		info.create_frame = obj.create_frame;
+		info.last_frame   = obj.last_frame;
+		if (labeled) {
+			FillResourceLabel(info);
 		}
+		resources.push_back(info);
+	};
+	for (auto& itr : m_raw_targets) {
+		add_raw(TARGET, itr.first, itr.second, true);
+	}
+	for (auto& itr : m_raw_rbos) {
+		add_raw(RENDERBUFFER, itr.first, itr.second, true);
+	}
+	// vao and compute buffers are listed as vertex buffers, their gl ids
+	// would clash with the labels of the pooled ones
+	for (auto& itr : m_raw_buffers)
+	{
+		bool pbo = itr.second.mem == MEMORY_PIXELBUFFER;
+		add_raw(pbo ? PIXELBUFFER : VERTEXBUFFER, itr.first, itr.second, pbo);
+	}
+}
+
+void RenderContext::QueryOwnerMemory(std::map<std::string, size_t>& owners) const
+{
+	std::vector<ResourceInfo> resources;
+	QueryResources(resources);
+	for (auto& res : resources) {
+		owners[res.owner] += res.size;
 	}
-#endif
-	return ret;
 }
 
-bool RenderContext::CheckETC2SupportSlow()
+void RenderContext::FillResourceLabel(ResourceInfo& info) const
+{
+	auto itr = m_labels.find(resource_key(info.type, info.id));
+	if (itr != m_labels.end()) {
+		info.label = itr->second.label;
+		info.owner = itr->second.owner;
+	}
+}
+
+void RenderContext::EraseResourceLabel(RENDER_OBJ what, uint32_t id) const
+{
+	if (!m_labels.empty()) {
+		m_labels.erase(resource_key(what, id));
+	}
+}
+
+/************************************************************************/
+/* Other                                                                */
+/************************************************************************/
+
+void RenderContext::ReadBuffer()
 {
 #ifdef CHECK_MT
 	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
 #endif // CHECK_MT
 
-#if defined( __APPLE__ ) && !defined(__MACOSX)
-    return false;
-#endif
+#if OPENGLES != 2
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+#endif // OPENGLES
+}
 
-	bool ret = false;
+void RenderContext::ReadPixels(const unsigned char* pixels, int channels, int x, int y, int w, int h)
+{
+    ReadPixelsImpl(pixels, channels, x, y, w, h, GL_UNSIGNED_BYTE);
+}
 
-	const int WIDTH = 4;
-	const int HEIGHT = 4;
-	const int BPP = 8;
-	const int SIZE = WIDTH * HEIGHT * BPP / 8;
-	char pixels[SIZE];
-	memset(pixels, 0, SIZE);
+void RenderContext::ReadPixels(const short* pixels, int channels, int x, int y, int w, int h)
+{
+    ReadPixelsImpl(pixels, channels, x, y, w, h, GL_SHORT);
+}
 
-	GLuint tex_id;
-	glGenTextures(1, &tex_id);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex_id);
+void RenderContext::EnableFlushCB(bool enable)
+{
+	if (!enable) {
+		++m_cb_enable;
+	} else {
+		--m_cb_enable;
+	}
+}
 
-	glGetError();
-	glCompressedTexImage2D(GL_TEXTURE_2D, 0, 0x9278, 4, 4, 0, SIZE, pixels);
-	GLenum error = glGetError();
-	ret = error == GL_NO_ERROR;
+void RenderContext::CallFlushCB()
+{
+	if (m_cb_enable == 0 && m_flush_shader) {
+		m_flush_shader(*this);
+	}
+}
+
+void RenderContext::EndFrame()
+{
+#ifdef CHECK_MT
+	assert(std::this_thread::get_id() == MAIN_THREAD_ID);
+#endif // CHECK_MT
 
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glDeleteTextures(1, &tex_id);
+	++m_frame;
+	render_set_frame(m_render, m_frame);
 
-	return ret;
+	EnforceTextureBudget();
 }
 
 RenderContext::VertBuf::~VertBuf()